@@ -0,0 +1,788 @@
+// Host benchmarks for the playback pipeline. Prints one JSON object on
+// stdout; the pipeline's own log lines go to stderr.
+//
+//   program [file.mp3] > results.json
+//
+// Without an MP3 file the decode benchmark is reported as skipped.
+
+#include <Arduino.h>
+#include <SD.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <new>
+#include <vector>
+#include "AudioCodec.h"
+#include "CpuGovernor.h"
+#include "CrossfadeMixer.h"
+#include "GainStage.h"
+#include "LoudnessMeter.h"
+#include "M3uParser.h"
+#include "Mp3FrameDecoder.h"
+#include "PcmResampler.h"
+#include "PcmRingBuffer.h"
+#include "ReadAheadStream.h"
+#include "ShufflePermutation.h"
+#include "TrackSearchIndex.h"
+#include "TrackTable.h"
+#include "WavPcmDecoder.h"
+
+// Same sizes as the device build (main.cpp, AudioProcessor.cpp)
+static const size_t PCM_RING_BYTES = 32 * 1024;
+static const size_t SD_READ_BURST_BYTES = 4 * 1024;
+static const size_t A2DP_BLOCK_BYTES = 512;
+static const uint32_t OUTPUT_BYTES_PER_SECOND = 44100 * 4;
+
+static const uint32_t CALLBACK_AUDIO_SECONDS = 120;
+static const uint32_t KERNEL_AUDIO_SECONDS = 60;
+static const uint32_t WAV_AUDIO_SECONDS = 60;
+static const size_t PLAYLIST_DIRECTORIES = 500;
+static const size_t PLAYLIST_FILES_PER_DIRECTORY = 20;
+static const size_t PLAYLIST_LOOKUPS = 1000;
+static const size_t SEARCH_PAGE = 10;
+static const size_t M3U_ENTRIES = 2000;
+static const size_t M3U_READ_BYTES = 256; // PLAYLIST_READ_BYTES in PlaylistManager.cpp
+static const uint32_t SHUFFLE_TRACKS = 50000;
+static const uint32_t SHUFFLE_RESHUFFLES = 100000;
+static const uint32_t CPU_STEPS_MHZ[] = {80, 160, 240};
+static const uint32_t GOVERNOR_POLL_MS = 250;
+
+// --- Heap accounting: every operator new in the process is counted ---
+
+static std::atomic<uint64_t> allocation_count(0);
+static std::atomic<uint64_t> allocation_bytes(0);
+
+static void* countedAllocation(size_t size) {
+    allocation_count++;
+    allocation_bytes += size;
+    return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size) {
+    void* memory = countedAllocation(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    void* memory = countedAllocation(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAllocation(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return countedAllocation(size); }
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+
+struct AllocationScope {
+    uint64_t count;
+    uint64_t bytes;
+    
+    AllocationScope() : count(allocation_count), bytes(allocation_bytes) {}
+    uint64_t countSince() const { return allocation_count - count; }
+    uint64_t bytesSince() const { return allocation_bytes - bytes; }
+};
+
+// --- Timing and output ---
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t percentile(std::vector<uint64_t>& samples, double fraction) {
+    if (samples.empty()) return 0;
+    size_t index = (size_t)(fraction * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+// Minimal JSON writer: nested objects with number and string values
+class JsonWriter {
+private:
+    int depth;
+    bool first;
+    
+public:
+    JsonWriter() : depth(0), first(true) {}
+    
+    void beginObject(const char* key = nullptr) {
+        separator(key);
+        printf("{");
+        depth++;
+        first = true;
+    }
+    
+    void endObject() {
+        depth--;
+        printf("\n%*s}", depth * 2, "");
+        first = false;
+        if (depth == 0) printf("\n");
+    }
+    
+    void number(const char* key, double value) {
+        separator(key);
+        if (value == floor(value) && fabs(value) < 1e15) printf("%.0f", value);
+        else printf("%.3f", value);
+    }
+    
+    void string(const char* key, const char* value) {
+        separator(key);
+        printf("\"%s\"", value);
+    }
+    
+    void percentiles(const char* key, std::vector<uint64_t>& samples_ns) {
+        beginObject(key);
+        number("p50", percentile(samples_ns, 0.50));
+        number("p90", percentile(samples_ns, 0.90));
+        number("p99", percentile(samples_ns, 0.99));
+        number("p999", percentile(samples_ns, 0.999));
+        number("max", samples_ns.empty() ? 0 : *std::max_element(samples_ns.begin(), samples_ns.end()));
+        endObject();
+    }
+    
+private:
+    void separator(const char* key) {
+        if (depth > 0) printf(first ? "\n" : ",\n");
+        printf("%*s", depth * 2, "");
+        if (key) printf("\"%s\": ", key);
+        first = false;
+    }
+};
+
+static void fillSine(int16_t* pcm, size_t frames, double frequency, uint32_t rate, uint16_t channels) {
+    for (size_t i = 0; i < frames; i++) {
+        int16_t value = (int16_t)lrint(16000.0 * sin(2.0 * M_PI * frequency * i / rate));
+        for (uint16_t c = 0; c < channels; c++) pcm[i * channels + c] = value;
+    }
+}
+
+// --- Benchmarks ---
+
+// SD stand-in -> ReadAheadStream -> Mp3FrameDecoder -> PcmResampler, as in
+// AudioProcessor::readSlot, one whole frame per step
+static void benchDecode(JsonWriter& json, const char* path) {
+    json.beginObject("decode");
+    if (!path) {
+        json.string("status", "skipped: no MP3 file given");
+        json.endObject();
+        return;
+    }
+    
+    AllocationScope setup_allocations;
+    ReadAheadStream input;
+    Mp3FrameDecoder decoder;
+    PcmResampler resampler;
+    std::vector<uint8_t> decoded(Mp3FrameDecoder::MAX_FRAME_BYTES);
+    std::vector<int16_t> converted(Mp3FrameDecoder::MAX_FRAME_BYTES * 3);
+    std::vector<uint8_t> compressed(Mp3FrameDecoder::INPUT_BYTES);
+    std::vector<int16_t> carry(Mp3FrameDecoder::MAX_FRAME_BYTES / sizeof(int16_t));
+    DecoderBuffers buffers = {compressed.data(), compressed.size(), carry.data(), Mp3FrameDecoder::MAX_FRAME_BYTES};
+    if (!input.begin(SD_READ_BURST_BYTES) || !input.open(path) || !decoder.begin(input, buffers) ||
+        !decoder.prepare() || !resampler.configure(decoder.getSampleRate(), decoder.getChannels())) {
+        json.string("status", "failed: cannot open or decode the file");
+        json.endObject();
+        return;
+    }
+    uint64_t setup_count = setup_allocations.countSince();
+    
+    uint32_t rate = decoder.getSampleRate();
+    uint16_t channels = decoder.getChannels();
+    size_t samples_per_frame = rate >= 32000 ? 1152 : 576;
+    
+    std::vector<uint64_t> step_ns;
+    step_ns.reserve(input.size() / 24 + 1); // Smallest MP3 frame is 24 bytes
+    uint64_t pcm_samples = 0;
+    uint64_t output_frames = 0;
+    AllocationScope loop_allocations;
+    uint64_t started = nowNs();
+    while (true) {
+        uint64_t step_start = nowNs();
+        size_t bytes = decoder.read(decoded.data(), decoded.size());
+        if (bytes == 0) break;
+        output_frames += resampler.process(decoded.data(), bytes, converted.data(), converted.size() / 2);
+        step_ns.push_back(nowNs() - step_start);
+        pcm_samples += bytes / sizeof(int16_t);
+    }
+    uint64_t elapsed = nowNs() - started;
+    uint64_t loop_count = loop_allocations.countSince();
+    
+    double mp3_frames = (double)pcm_samples / channels / samples_per_frame;
+    double audio_seconds = (double)pcm_samples / channels / rate;
+    json.string("status", "ok");
+    json.number("sample_rate", rate);
+    json.number("channels", channels);
+    json.number("resampled", resampler.isPassthrough() ? 0 : 1);
+    json.number("mp3_frames", mp3_frames);
+    json.number("frames_per_second", mp3_frames * 1e9 / elapsed);
+    json.number("ns_per_frame", elapsed / mp3_frames);
+    json.number("realtime_factor", audio_seconds * 1e9 / elapsed);
+    json.number("output_frames", output_frames);
+    json.percentiles("step_ns", step_ns);
+    json.number("setup_allocations", setup_count);
+    json.number("allocations_per_frame", loop_count / mp3_frames);
+    json.endObject();
+}
+
+// 44.1 kHz stereo WAV written to a scratch file and read back the way
+// readSlot does in passthrough: straight from the read-ahead buffer into
+// the ring block, with no decode step at all
+static void benchWav(JsonWriter& json) {
+    json.beginObject("wav");
+    const char* path = "bench_passthrough.wav";
+    uint32_t frames = 44100 * WAV_AUDIO_SECONDS;
+    uint32_t data_bytes = frames * 4;
+    std::vector<int16_t> pcm((size_t)frames * 2);
+    fillSine(pcm.data(), frames, 440.0, 44100, 2);
+    
+    uint8_t header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+                          'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0,
+                          0x44, 0xAC, 0, 0, 0x10, 0xB1, 2, 0, 4, 0, 16, 0,
+                          'd', 'a', 't', 'a'};
+    uint32_t riff_bytes = data_bytes + 36;
+    memcpy(header + 4, &riff_bytes, 4);
+    memcpy(header + 40, &data_bytes, 4);
+    FILE* out = fopen(path, "wb");
+    if (!out || fwrite(header, 1, sizeof(header), out) != sizeof(header) ||
+        fwrite(pcm.data(), 1, data_bytes, out) != data_bytes) {
+        if (out) fclose(out);
+        json.string("status", "failed: cannot write scratch file");
+        json.endObject();
+        return;
+    }
+    fclose(out);
+    
+    size_t tag_bytes;
+    AudioCodec codec = codecForHeader(header, CODEC_SNIFF_BYTES, tag_bytes);
+    
+    ReadAheadStream input;
+    WavPcmDecoder decoder;
+    DecoderBuffers unused = {};
+    std::vector<uint8_t> block(Mp3FrameDecoder::MAX_FRAME_BYTES); // DECODE_CHUNK_BYTES
+    if (!input.begin(SD_READ_BURST_BYTES) || !input.open(path) || !decoder.begin(input, unused) ||
+        !decoder.prepare()) {
+        remove(path);
+        json.string("status", "failed: cannot parse the file");
+        json.endObject();
+        return;
+    }
+    
+    // Same bytes out as went in, in ring-sized steps
+    size_t mismatches = 0;
+    size_t offset = 0;
+    AllocationScope loop_allocations;
+    uint64_t started = nowNs();
+    while (true) {
+        size_t bytes = decoder.read(block.data(), block.size());
+        if (bytes == 0) break;
+        if (offset + bytes > data_bytes ||
+            memcmp(block.data(), reinterpret_cast<uint8_t*>(pcm.data()) + offset, bytes) != 0) {
+            mismatches++;
+        }
+        offset += bytes;
+    }
+    uint64_t elapsed = nowNs() - started;
+    uint64_t loop_count = loop_allocations.countSince();
+    input.close();
+    remove(path);
+    
+    json.string("status", "ok");
+    json.string("detected", codecName(codec));
+    json.number("sample_rate", decoder.getSampleRate());
+    json.number("channels", decoder.getChannels());
+    json.number("bytes", offset);
+    json.number("mismatches", mismatches + (offset != data_bytes ? 1 : 0));
+    json.number("ns_per_kib", elapsed * 1024.0 / data_bytes);
+    json.number("realtime_factor", WAV_AUDIO_SECONDS * 1e9 / elapsed);
+    json.number("allocations", loop_count);
+    json.endObject();
+}
+
+// Producer fills the ring a frame at a time; the callback side does what
+// AudioProcessor::readAudioData does per A2DP block: ring read and gain,
+// with a volume ramp running part of the time
+static void benchCallback(JsonWriter& json) {
+    PcmRingBuffer ring;
+    ring.allocate(PCM_RING_BYTES);
+    GainStage gain;
+    gain.setTrackGain(GainStage::TRACK_UNITY * 3 / 4);
+    
+    std::vector<int16_t> frame(Mp3FrameDecoder::MAX_FRAME_BYTES / sizeof(int16_t));
+    fillSine(frame.data(), frame.size() / 2, 1000.0, 44100, 2);
+    std::vector<uint8_t> block(A2DP_BLOCK_BYTES);
+    
+    size_t calls = (size_t)CALLBACK_AUDIO_SECONDS * OUTPUT_BYTES_PER_SECOND / A2DP_BLOCK_BYTES;
+    std::vector<uint64_t> callback_ns;
+    callback_ns.reserve(calls);
+    AllocationScope allocations;
+    for (size_t call = 0; call < calls; call++) {
+        while (ring.availableToWrite() >= frame.size() * sizeof(int16_t)) {
+            ring.write(reinterpret_cast<const uint8_t*>(frame.data()), frame.size() * sizeof(int16_t));
+        }
+        if (call % 2000 == 0) {
+            gain.rampTo(call % 4000 == 0 ? GainStage::dbToGain(-20) : GainStage::UNITY, 300);
+        }
+        
+        uint64_t start = nowNs();
+        size_t bytes = ring.read(block.data(), block.size());
+        gain.process(block.data(), bytes);
+        callback_ns.push_back(nowNs() - start);
+    }
+    
+    json.beginObject("callback");
+    json.number("block_bytes", A2DP_BLOCK_BYTES);
+    json.number("calls", calls);
+    json.percentiles("latency_ns", callback_ns);
+    json.number("budget_ns", (double)A2DP_BLOCK_BYTES * 1e9 / OUTPUT_BYTES_PER_SECOND);
+    json.number("allocations_per_call", (double)allocations.countSince() / calls);
+    json.endObject();
+    ring.release();
+}
+
+static void benchResampler(JsonWriter& json, uint32_t rate, uint16_t channels, const char* key) {
+    AllocationScope setup_allocations;
+    PcmResampler resampler;
+    resampler.configure(rate, channels);
+    uint64_t setup_count = setup_allocations.countSince();
+    uint64_t setup_bytes = setup_allocations.bytesSince();
+    
+    size_t input_frames = 1024;
+    std::vector<int16_t> input(input_frames * channels);
+    fillSine(input.data(), input_frames, 997.0, rate, channels);
+    std::vector<int16_t> output(input_frames * 12 * 2);
+    
+    uint64_t total_frames = 0;
+    uint64_t target_frames = (uint64_t)KERNEL_AUDIO_SECONDS * PcmResampler::OUTPUT_RATE;
+    AllocationScope loop_allocations;
+    uint64_t started = nowNs();
+    while (total_frames < target_frames) {
+        total_frames += resampler.process(reinterpret_cast<const uint8_t*>(input.data()),
+                                          input.size() * sizeof(int16_t), output.data(), output.size() / 2);
+    }
+    uint64_t elapsed = nowNs() - started;
+    
+    json.beginObject(key);
+    json.number("ns_per_output_frame", (double)elapsed / total_frames);
+    json.number("realtime_factor", (double)total_frames / PcmResampler::OUTPUT_RATE * 1e9 / elapsed);
+    json.number("setup_allocations", setup_count);
+    json.number("setup_bytes", setup_bytes);
+    json.number("loop_allocations", loop_allocations.countSince());
+    json.endObject();
+}
+
+static void benchCrossfade(JsonWriter& json) {
+    CrossfadeMixer mixer;
+    size_t block_frames = Mp3FrameDecoder::MAX_FRAME_BYTES / 4;
+    std::vector<int16_t> outgoing(block_frames * 2);
+    std::vector<int16_t> incoming(block_frames * 2);
+    fillSine(incoming.data(), block_frames, 440.0, 44100, 2);
+    
+    uint64_t total_frames = (uint64_t)KERNEL_AUDIO_SECONDS * 44100;
+    mixer.begin((uint32_t)total_frames, GainStage::TRACK_UNITY);
+    uint64_t started = nowNs();
+    for (uint64_t done = 0; done < total_frames; done += block_frames) {
+        fillSine(outgoing.data(), 1, 440.0, 44100, 2); // Keep the buffer live
+        mixer.mix(reinterpret_cast<uint32_t*>(outgoing.data()),
+                  reinterpret_cast<const uint32_t*>(incoming.data()), block_frames);
+    }
+    uint64_t elapsed = nowNs() - started;
+    
+    json.beginObject("crossfade_mix");
+    json.number("ns_per_frame", (double)elapsed / total_frames);
+    json.endObject();
+}
+
+// Analysis pass of the library scan, one MP3 frame of stereo PCM at a time
+static void benchLoudness(JsonWriter& json) {
+    size_t block_frames = 1152;
+    std::vector<int16_t> pcm(block_frames * 2);
+    fillSine(pcm.data(), block_frames, 1000.0, 44100, 2);
+    
+    AllocationScope setup_allocations;
+    LoudnessMeter meter;
+    meter.begin(44100, 2);
+    uint64_t setup_bytes = setup_allocations.bytesSince();
+    
+    uint64_t total_frames = (uint64_t)KERNEL_AUDIO_SECONDS * 44100;
+    AllocationScope loop_allocations;
+    uint64_t started = nowNs();
+    for (uint64_t done = 0; done < total_frames; done += block_frames) {
+        meter.addSamples(pcm.data(), block_frames);
+    }
+    uint64_t elapsed = nowNs() - started;
+    
+    json.beginObject("loudness");
+    json.number("ns_per_frame", (double)elapsed / total_frames);
+    json.number("realtime_factor", (double)total_frames / 44100 * 1e9 / elapsed);
+    json.number("integrated_lufs", meter.integratedLufs());
+    json.number("track_gain_centidb", meter.trackGainCentiDb());
+    json.number("setup_bytes", setup_bytes);
+    json.number("loop_allocations", loop_allocations.countSince());
+    json.endObject();
+}
+
+// Word-start test written the slow, obvious way, to check the index against
+static bool hasWordStartingWith(const std::string& text, const std::string& query) {
+    for (size_t i = 0; i + query.size() <= text.size(); i++) {
+        if (i > 0 && isalnum((unsigned char)text[i - 1])) continue;
+        if (!isalnum((unsigned char)text[i])) continue;
+        size_t k = 0;
+        while (k < query.size() && tolower((unsigned char)text[i + k]) == query[k]) k++;
+        if (k == query.size()) return true;
+    }
+    return false;
+}
+
+static void benchSearch(JsonWriter& json, const TrackTable& table) {
+    const size_t root_length = strlen("/Music/");
+    TrackSearchIndex index;
+    AllocationScope build_allocations;
+    uint64_t started = nowNs();
+    index.build(table, root_length);
+    uint64_t build_ns = nowNs() - started;
+    uint64_t build_count = build_allocations.countSince();
+    
+    // A common word, a rare one, a folder and a miss
+    const char* queries[] = { "track", "title number 4711", "artist 042", "zzz" };
+    const int query_count = sizeof(queries) / sizeof(queries[0]);
+    std::vector<uint32_t> page;
+    uint64_t prefix_ns = 0;
+    uint64_t substring_ns = 0;
+    size_t matches = 0;
+    int mismatches = 0;
+    for (int q = 0; q < query_count; q++) {
+        started = nowNs();
+        size_t total = index.search(queries[q], SearchMode::PREFIX, 0, SEARCH_PAGE, page);
+        prefix_ns += nowNs() - started;
+        matches += total;
+        
+        size_t expected = 0;
+        for (size_t i = 0; i < table.size(); i++) {
+            std::string name(table.fileName(i), table.stemLength(i));
+            std::string folder(table.directory(i) + root_length);
+            if (hasWordStartingWith(name, queries[q]) || hasWordStartingWith(folder, queries[q])) expected++;
+        }
+        if (expected != total) mismatches++;
+        
+        started = nowNs();
+        index.search(queries[q] + 1, SearchMode::SUBSTRING, 0, SEARCH_PAGE, page);
+        substring_ns += nowNs() - started;
+    }
+    
+    json.beginObject("search");
+    json.number("tracks", table.size());
+    json.number("words", index.wordCount());
+    json.number("memory_bytes", index.memoryUsage());
+    json.number("build_ms", build_ns / 1e6);
+    json.number("build_allocations", build_count);
+    json.number("prefix_us", prefix_ns / 1e3 / query_count);
+    json.number("substring_us", substring_ns / 1e3 / query_count);
+    json.number("prefix_matches", matches);
+    json.number("prefix_mismatches", mismatches);
+    json.endObject();
+}
+
+// A playlist in a folder of its own, written the ways players export
+// them: relative with either slash, absolute with a drive letter, with
+// #EXTINF lines and CRLF, and a few entries that are not on the card
+static void benchM3u(JsonWriter& json, const TrackTable& table) {
+    std::string text = "\xEF\xBB\xBF#EXTM3U\r\n";
+    std::vector<int> expected;
+    for (size_t i = 0; i < M3U_ENTRIES; i++) {
+        size_t index = (i * 7919) % table.size();
+        std::string folder(table.directory(index) + strlen("/Music/"));
+        std::string entry;
+        switch (i % 4) {
+            case 0: entry = "../" + folder; break;
+            case 1: entry = "C:\\Music\\" + folder; break;
+            case 2: entry = "./../../Music/" + folder; break;
+            default: entry = "/Music/" + folder; break;
+        }
+        if (i % 4 == 1) std::replace(entry.begin(), entry.end(), '/', '\\');
+        entry += table.fileName(index);
+        if (i % 50 == 49) {
+            entry += ".missing";
+            index = (size_t)-1;
+        }
+        text += "#EXTINF:180,Artist - Title\r\n" + entry + "\r\n";
+        expected.push_back((int)index);
+    }
+    
+    std::vector<int> resolved;
+    resolved.reserve(M3U_ENTRIES);
+    M3uParser parser("/Music/Playlists/mix.m3u", [&](const char* path) {
+        resolved.push_back(table.findPath(path));
+    });
+    AllocationScope allocations;
+    uint64_t started = nowNs();
+    for (size_t offset = 0; offset < text.size(); offset += M3U_READ_BYTES) {
+        parser.feed(text.data() + offset, std::min(M3U_READ_BYTES, text.size() - offset));
+    }
+    parser.finish();
+    uint64_t parse_ns = nowNs() - started;
+    uint64_t parse_count = allocations.countSince();
+    
+    int found = 0;
+    int mismatches = resolved.size() == expected.size() ? 0 : 1;
+    for (size_t i = 0; i < resolved.size() && i < expected.size(); i++) {
+        if (resolved[i] >= 0) found++;
+        if (resolved[i] != expected[i]) mismatches++;
+    }
+    
+    json.beginObject("m3u");
+    json.number("entries", parser.getEntries());
+    json.number("bytes", text.size());
+    json.number("ns_per_entry", (double)parse_ns / M3U_ENTRIES);
+    json.number("allocations", parse_count);
+    json.number("found", found);
+    json.number("mismatches", mismatches);
+    json.endObject();
+}
+
+// A synthetic card of artist/album directories, listed in a scrambled
+// order the way FAT directory order rarely matches the sorted one
+static void benchPlaylist(JsonWriter& json) {
+    std::vector<std::string> directories;
+    std::vector<std::string> names;
+    for (size_t d = 0; d < PLAYLIST_DIRECTORIES; d++) {
+        char directory[64];
+        snprintf(directory, sizeof(directory), "/Music/Artist %03u/Album %02u/", (unsigned)(d / 5), (unsigned)(d % 5));
+        for (size_t f = 0; f < PLAYLIST_FILES_PER_DIRECTORY; f++) {
+            char name[64];
+            snprintf(name, sizeof(name), "%02u - Track title number %u.mp3", (unsigned)(f + 1), (unsigned)(d * 31 + f));
+            directories.push_back(directory);
+            names.push_back(name);
+        }
+    }
+    uint32_t state = 12345;
+    std::vector<size_t> order(names.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    for (size_t i = order.size() - 1; i > 0; i--) {
+        state = state * 1664525u + 1013904223u;
+        std::swap(order[i], order[state % (i + 1)]);
+    }
+    
+    TrackTable table;
+    AllocationScope add_allocations;
+    uint64_t started = nowNs();
+    for (size_t i : order) {
+        table.add(directories[i].c_str(), names[i].c_str());
+    }
+    uint64_t add_ns = nowNs() - started;
+    uint64_t add_count = add_allocations.countSince();
+    
+    AllocationScope sort_allocations;
+    started = nowNs();
+    table.sort();
+    table.finish();
+    uint64_t sort_ns = nowNs() - started;
+    uint64_t sort_count = sort_allocations.countSince();
+    
+    int order_errors = 0;
+    for (size_t i = 1; i < table.size(); i++) {
+        if (table.comparePaths(i - 1, i) >= 0) order_errors++;
+    }
+    
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < PLAYLIST_LOOKUPS; i++) {
+        size_t index = (i * 7919) % names.size();
+        paths.push_back(directories[index] + names[index]);
+    }
+    int found = 0;
+    started = nowNs();
+    for (const std::string& path : paths) {
+        if (table.findPath(path.c_str()) >= 0) found++;
+    }
+    uint64_t lookup_ns = nowNs() - started;
+    
+    json.beginObject("playlist");
+    json.number("tracks", table.size());
+    json.number("add_ns_per_track", (double)add_ns / names.size());
+    json.number("add_allocations_per_track", (double)add_count / names.size());
+    json.number("sort_ms", sort_ns / 1e6);
+    json.number("sort_allocations", sort_count);
+    json.number("order_errors", order_errors);
+    json.number("lookup_ns", (double)lookup_ns / paths.size());
+    json.number("lookups_found", found);
+    json.number("memory_bytes", table.memoryUsage());
+    json.endObject();
+    
+    benchSearch(json, table);
+    benchM3u(json, table);
+}
+
+static void benchShuffle(JsonWriter& json) {
+    // One full pass must visit every track exactly once, and stepping
+    // back must land where it came from
+    ShufflePermutation order;
+    std::vector<bool> seen(SHUFFLE_TRACKS);
+    order.reset(SHUFFLE_TRACKS, 2024);
+    
+    AllocationScope pass_allocations;
+    uint32_t duplicates = 0;
+    uint32_t inverse_errors = 0;
+    uint64_t started = nowNs();
+    for (uint32_t position = 0; position < SHUFFLE_TRACKS; position++) {
+        uint32_t index = order.at(position);
+        if (index >= SHUFFLE_TRACKS || seen[index]) duplicates++;
+        else seen[index] = true;
+        if (order.positionOf(index) != position) inverse_errors++;
+    }
+    uint64_t pass_ns = nowNs() - started;
+    uint64_t pass_count = pass_allocations.countSince();
+    
+    uint32_t checksum = 0;
+    started = nowNs();
+    for (uint32_t pass = 0; pass < SHUFFLE_RESHUFFLES; pass++) {
+        order.reset(SHUFFLE_TRACKS, pass);
+        checksum += order.at(0);
+    }
+    uint64_t reshuffle_ns = nowNs() - started;
+    
+    json.beginObject("shuffle");
+    json.number("tracks", SHUFFLE_TRACKS);
+    json.number("state_bytes", sizeof(ShufflePermutation));
+    json.number("duplicates", duplicates);
+    json.number("inverse_errors", inverse_errors);
+    json.number("step_ns", (double)pass_ns / SHUFFLE_TRACKS / 2);
+    json.number("step_allocations", pass_count);
+    json.number("reshuffle_ns", (double)reshuffle_ns / SHUFFLE_RESHUFFLES);
+    json.number("checksum", checksum);
+    json.endObject();
+}
+
+// One stretch of a simulated load trace: decoder CPU per unit of audio at
+// 240 MHz, and SD stalls (no input at all) of stall_ms every stall_every_ms
+struct LoadPhase {
+    uint32_t duration_ms;
+    uint32_t cost_percent;
+    uint32_t stall_ms;
+    uint32_t stall_every_ms;
+};
+
+// Replays a trace through CpuGovernor in 1 ms steps: the A2DP side drains
+// the ring in real time, the decoder refills it as fast as the simulated
+// clock allows, and the governor runs every GOVERNOR_POLL_MS and whenever
+// the ring crosses its low watermark, as in main.cpp
+static void simulateGovernor(JsonWriter& json, const char* key, const LoadPhase* phases, size_t phase_count) {
+    const double ring_ms = PCM_RING_BYTES * 1000.0 / OUTPUT_BYTES_PER_SECOND;
+    const double low_ms = ring_ms * CpuGovernor::LOW_FILL_PERCENT / 100;
+    CpuGovernor governor(CPU_STEPS_MHZ, sizeof(CPU_STEPS_MHZ) / sizeof(CPU_STEPS_MHZ[0]));
+    
+    double fill_ms = ring_ms;
+    double busy_ms = 0;
+    double audio_ms = 0;
+    double mhz_ms = 0;
+    double min_fill_percent = 100;
+    uint32_t underrun_ms = 0;
+    uint32_t step_ms[3] = {0, 0, 0};
+    uint32_t total_ms = 0;
+    bool was_low = false;
+    uint32_t updates = 0;
+    uint64_t update_ns = 0;
+    
+    for (size_t p = 0; p < phase_count; p++) {
+        const LoadPhase& phase = phases[p];
+        for (uint32_t t = 0; t < phase.duration_ms; t++, total_ms++) {
+            uint32_t mhz = governor.getFrequency();
+            
+            // Callback side
+            if (fill_ms < 1) {
+                underrun_ms++;
+                fill_ms = 0;
+            } else {
+                fill_ms -= 1;
+            }
+            
+            // Decoder side: 1 ms of CPU at the current clock
+            bool stalled = phase.stall_every_ms && t % phase.stall_every_ms < phase.stall_ms;
+            if (!stalled) {
+                double cost = phase.cost_percent / 100.0 * CPU_STEPS_MHZ[2] / mhz;
+                double produced = std::min(ring_ms - fill_ms, 1 / cost);
+                fill_ms += produced;
+                audio_ms += produced;
+                busy_ms += produced * cost;
+            }
+            
+            double fill_percent = fill_ms * 100 / ring_ms;
+            min_fill_percent = std::min(min_fill_percent, fill_percent);
+            bool low = fill_ms < low_ms;
+            if (total_ms % GOVERNOR_POLL_MS == 0 || (low && !was_low)) {
+                GovernorSample sample;
+                sample.busy_us = (uint64_t)(busy_ms * 1000);
+                sample.audio_us = (uint64_t)(audio_ms * 1000);
+                sample.fill_percent = (uint32_t)fill_percent;
+                sample.playing = true;
+                uint64_t started = nowNs();
+                governor.update(sample);
+                update_ns += nowNs() - started;
+                updates++;
+                busy_ms = 0;
+                audio_ms = 0;
+            }
+            was_low = low;
+            
+            mhz_ms += mhz;
+            for (int s = 0; s < 3; s++) {
+                if (mhz == CPU_STEPS_MHZ[s]) step_ms[s]++;
+            }
+        }
+    }
+    
+    const GovernorStats& stats = governor.getStats();
+    json.beginObject(key);
+    json.number("seconds", total_ms / 1000.0);
+    json.number("average_mhz", mhz_ms / total_ms);
+    json.number("share_80", (double)step_ms[0] / total_ms);
+    json.number("share_160", (double)step_ms[1] / total_ms);
+    json.number("share_240", (double)step_ms[2] / total_ms);
+    json.number("changes", stats.changes);
+    json.number("boosts", stats.boosts);
+    json.number("min_fill_percent", min_fill_percent);
+    json.number("underrun_ms", underrun_ms);
+    json.number("update_ns", (double)update_ns / updates);
+    json.endObject();
+}
+
+static void benchGovernor(JsonWriter& json) {
+    // Steady 44.1 kHz MP3
+    static const LoadPhase steady[] = {{60000, 10, 0, 0}};
+    // MP3, then 48 kHz resampled during a crossfade, then back
+    static const LoadPhase mixed[] = {{20000, 10, 0, 0}, {10000, 40, 0, 0}, {5000, 60, 0, 0}, {25000, 10, 0, 0}};
+    // SD card pausing for 150 ms every 3 s (wear levelling, a slow card)
+    static const LoadPhase stalls[] = {{60000, 10, 150, 3000}};
+    
+    json.beginObject("governor");
+    simulateGovernor(json, "steady", steady, sizeof(steady) / sizeof(steady[0]));
+    simulateGovernor(json, "mixed", mixed, sizeof(mixed) / sizeof(mixed[0]));
+    simulateGovernor(json, "stalls", stalls, sizeof(stalls) / sizeof(stalls[0]));
+    json.endObject();
+}
+
+// The tests in test/ are linked against the same sources and bring their own main
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char** argv) {
+    JsonWriter json;
+    json.beginObject();
+    json.string("schema", "esp32mp3-bench/1");
+    benchDecode(json, argc > 1 ? argv[1] : nullptr);
+    benchWav(json);
+    benchCallback(json);
+    json.beginObject("resampler");
+    benchResampler(json, 48000, 2, "48000_stereo");
+    benchResampler(json, 22050, 2, "22050_stereo");
+    benchResampler(json, 22050, 1, "22050_mono");
+    benchResampler(json, 44100, 1, "44100_mono");
+    json.endObject();
+    benchCrossfade(json);
+    benchLoudness(json);
+    benchPlaylist(json);
+    benchShuffle(json);
+    benchGovernor(json);
+    json.endObject();
+    return 0;
+}
+#endif
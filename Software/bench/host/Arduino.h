@@ -0,0 +1,99 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Just enough of the Arduino core for the pipeline components to build on
+// a desktop. Serial goes to stderr so stdout stays free for results.
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class String {
+private:
+    std::string text;
+    
+public:
+    String() {}
+    String(const char* value) : text(value ? value : "") {}
+    String(const std::string& value) : text(value) {}
+    
+    const char* c_str() const { return text.c_str(); }
+    unsigned length() const { return text.size(); }
+    bool isEmpty() const { return text.empty(); }
+    
+    bool operator==(const String& other) const { return text == other.text; }
+    bool operator!=(const String& other) const { return text != other.text; }
+    String& operator+=(const String& other) { text += other.text; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.text + b.text); }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; i++) write(data[i]);
+        return len;
+    }
+    
+    size_t print(const String& value) { return write(reinterpret_cast<const uint8_t*>(value.c_str()), value.length()); }
+    size_t println(const String& value) { return print(value) + print("\n"); }
+    size_t println() { return print("\n"); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if (len < 0) return 0;
+        return write(reinterpret_cast<const uint8_t*>(line), (size_t)len < sizeof(line) ? len : sizeof(line) - 1);
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t readBytes(char* data, size_t len) {
+        size_t count = 0;
+        while (count < len) {
+            int value = read();
+            if (value < 0) break;
+            data[count++] = (char)value;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t* data, size_t len) { return readBytes(reinterpret_cast<char*>(data), len); }
+};
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    operator bool() const { return true; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t write(uint8_t value) override { return fputc(value, stderr) == EOF ? 0 : 1; }
+    size_t write(const uint8_t* data, size_t len) override { return fwrite(data, 1, len, stderr); }
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// Free heap has no meaning on the host; reported as plenty
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return 256 * 1024; }
+};
+
+extern EspClass ESP;
+
+#endif
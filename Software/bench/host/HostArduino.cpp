@@ -0,0 +1,47 @@
+#include "Arduino.h"
+#include "SD.h"
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+SDFS SD;
+
+static const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+File::File(FILE* file) : handle(file), length(0) {
+    if (handle && fseek(handle, 0, SEEK_END) == 0) {
+        length = (size_t)ftell(handle);
+        fseek(handle, 0, SEEK_SET);
+    }
+}
+
+void File::close() {
+    if (handle) {
+        fclose(handle);
+        handle = nullptr;
+    }
+}
+
+File SDFS::open(const String& path) {
+    return File(fopen(path.c_str(), "rb"));
+}
+
+bool SDFS::exists(const String& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    fclose(file);
+    return true;
+}
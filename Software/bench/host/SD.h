@@ -0,0 +1,34 @@
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+// SD card stand-in: paths are host filesystem paths, files are read-only
+// stdio handles. Covers what ReadAheadStream needs.
+
+#include "Arduino.h"
+
+class File {
+private:
+    FILE* handle;
+    size_t length;
+    
+public:
+    File() : handle(nullptr), length(0) {}
+    explicit File(FILE* file);
+    
+    explicit operator bool() const { return handle != nullptr; }
+    size_t read(uint8_t* data, size_t len) { return handle ? fread(data, 1, len, handle) : 0; }
+    bool seek(size_t position) { return handle && fseek(handle, (long)position, SEEK_SET) == 0; }
+    size_t position() const { return handle ? (size_t)ftell(handle) : 0; }
+    size_t size() const { return length; }
+    void close();
+};
+
+class SDFS {
+public:
+    File open(const String& path);
+    bool exists(const String& path);
+};
+
+extern SDFS SD;
+
+#endif
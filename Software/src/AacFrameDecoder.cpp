@@ -0,0 +1,76 @@
+#include "AacFrameDecoder.h"
+
+AacFrameDecoder::AacFrameDecoder() :
+    FrameDecoder(MAX_FRAME_BYTES, INPUT_BYTES),
+    helix(nullptr) {
+}
+
+AacFrameDecoder::~AacFrameDecoder() {
+    end();
+}
+
+bool AacFrameDecoder::startCodec() {
+    helix = AACInitDecoder();
+    return helix != nullptr;
+}
+
+void AacFrameDecoder::stopCodec() {
+    if (helix) {
+        AACFreeDecoder(helix);
+        helix = nullptr;
+    }
+}
+
+void AacFrameDecoder::reset() {
+    // Overlap from before a seek would bleed into the first frame after it
+    FrameDecoder::reset();
+    if (helix) {
+        AACFlushCodec(helix);
+    }
+}
+
+size_t AacFrameDecoder::decodeFrame(int16_t* output) {
+    while (true) {
+        if (bytes_left < 2 && !fillInput()) {
+            bytes_left = 0;
+            return 0;
+        }
+        
+        int offset = AACFindSyncWord(read_ptr, bytes_left);
+        if (offset < 0) {
+            read_ptr += bytes_left - 1;
+            bytes_left = 1;
+            if (!fillInput()) {
+                bytes_left = 0;
+                return 0;
+            }
+            continue;
+        }
+        read_ptr += offset;
+        bytes_left -= offset;
+        
+        if (bytes_left < AAC_MAINBUF_SIZE) {
+            fillInput();
+        }
+        
+        uint8_t* frame_start = read_ptr;
+        int result = AACDecode(helix, &read_ptr, &bytes_left, output);
+        if (result == ERR_AAC_NONE) {
+            AACFrameInfo info;
+            AACGetLastFrameInfo(helix, &info);
+            sample_rate = info.sampRateOut;
+            channels = info.nChans;
+            if (info.outputSamps > 0) {
+                return info.outputSamps * sizeof(int16_t);
+            }
+        } else if (result == ERR_AAC_INDATA_UNDERFLOW && !input->available()) {
+            // Truncated last frame
+            bytes_left = 0;
+            return 0;
+        } else if (read_ptr == frame_start) {
+            // False sync or damaged frame: search again past this sync word
+            read_ptr++;
+            bytes_left--;
+        }
+    }
+}
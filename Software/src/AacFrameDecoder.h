@@ -0,0 +1,32 @@
+#ifndef AACFRAMEDECODER_H
+#define AACFRAMEDECODER_H
+
+#include <Arduino.h>
+#include "AudioDecoder.h"
+#include "libhelix-aac/aacdec.h"
+
+// Frame-granular AAC decoding (ADTS streams, LC and HE-AAC) on the
+// Helix C API. The Helix instance is only allocated between begin() and end().
+class AacFrameDecoder : public FrameDecoder {
+public:
+    // PCM of the largest frame: 1024 samples per channel, twice that with
+    // spectral band replication
+    static const size_t MAX_FRAME_BYTES = AAC_MAX_NSAMPS * 2 * AAC_MAX_NCHANS * sizeof(int16_t);
+    static const size_t INPUT_BYTES = AAC_MAINBUF_SIZE * 2;
+    
+private:
+    HAACDecoder helix;
+    
+public:
+    AacFrameDecoder();
+    ~AacFrameDecoder();
+    
+    void reset() override;
+    
+protected:
+    bool startCodec() override;
+    void stopCodec() override;
+    size_t decodeFrame(int16_t* output) override;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "AudioCodec.h"
+#include <cstring>
+#include <strings.h>
+
+const char* codecName(AudioCodec codec) {
+    switch (codec) {
+        case AudioCodec::MP3:  return "MP3";
+        case AudioCodec::AAC:  return "AAC";
+        case AudioCodec::FLAC: return "FLAC";
+        case AudioCodec::WAV:  return "WAV";
+        default:               return "unknown";
+    }
+}
+
+AudioCodec codecForExtension(const char* file_name) {
+    const char* dot = strrchr(file_name, '.');
+    if (!dot) return AudioCodec::UNKNOWN;
+    
+    const char* extension = dot + 1;
+    if (strcasecmp(extension, "mp3") == 0) return AudioCodec::MP3;
+    if (strcasecmp(extension, "aac") == 0) return AudioCodec::AAC;
+    if (strcasecmp(extension, "flac") == 0) return AudioCodec::FLAC;
+    if (strcasecmp(extension, "wav") == 0) return AudioCodec::WAV;
+    return AudioCodec::UNKNOWN;
+}
+
+AudioCodec codecForHeader(const uint8_t* data, size_t len, size_t& tag_bytes) {
+    tag_bytes = 0;
+    
+    if (len >= 10 && memcmp(data, "ID3", 3) == 0) {
+        // Syncsafe size, plus the header and an optional footer
+        size_t size = (size_t)(data[6] & 0x7F) << 21 | (size_t)(data[7] & 0x7F) << 14 |
+                      (size_t)(data[8] & 0x7F) << 7 | (size_t)(data[9] & 0x7F);
+        tag_bytes = 10 + size + ((data[5] & 0x10) ? 10 : 0);
+        return AudioCodec::UNKNOWN;
+    }
+    if (len >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0) {
+        return AudioCodec::WAV;
+    }
+    if (len >= 4 && memcmp(data, "fLaC", 4) == 0) return AudioCodec::FLAC;
+    
+    // Both start with a frame sync; ADTS has layer 0, which MPEG audio never uses
+    if (len >= 2 && data[0] == 0xFF) {
+        if ((data[1] & 0xF6) == 0xF0) return AudioCodec::AAC;
+        if ((data[1] & 0xE0) == 0xE0 && (data[1] & 0x06) != 0) return AudioCodec::MP3;
+    }
+    return AudioCodec::UNKNOWN;
+}
@@ -0,0 +1,30 @@
+#ifndef AUDIOCODEC_H
+#define AUDIOCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Which decoder a track needs, from its name and its first bytes. No
+// Arduino dependencies.
+enum class AudioCodec {
+    UNKNOWN,
+    MP3,
+    AAC,  // ADTS stream (.aac)
+    FLAC,
+    WAV   // 16-bit PCM
+};
+
+// Bytes codecForHeader() wants to see
+static const size_t CODEC_SNIFF_BYTES = 12;
+
+const char* codecName(AudioCodec codec);
+
+// From the file name alone; UNKNOWN for anything that is not audio
+AudioCodec codecForExtension(const char* file_name);
+
+// From the first bytes of the file, which win over the extension. An
+// ID3v2 tag hides what follows: UNKNOWN is returned with tag_bytes set to
+// its size, and the caller looks again behind it.
+AudioCodec codecForHeader(const uint8_t* data, size_t len, size_t& tag_bytes);
+
+#endif
@@ -0,0 +1,108 @@
+#include "AudioDecoder.h"
+
+FrameDecoder::FrameDecoder(size_t frame_bytes, size_t input_bytes) :
+    input(nullptr),
+    read_ptr(nullptr),
+    bytes_left(0),
+    carry_offset(0),
+    carry_bytes(0),
+    sample_rate(0),
+    channels(0),
+    max_frame_bytes(frame_bytes),
+    min_input_bytes(input_bytes) {
+    memset(&buffers, 0, sizeof(buffers));
+}
+
+bool FrameDecoder::begin(ReadAheadStream& source, const DecoderBuffers& shared) {
+    end();
+    
+    if (!shared.input || shared.input_bytes < min_input_bytes ||
+        !shared.carry || shared.carry_bytes < max_frame_bytes || !startCodec()) {
+        return false;
+    }
+    
+    buffers = shared;
+    input = &source;
+    sample_rate = 0;
+    channels = 0;
+    reset();
+    return true;
+}
+
+void FrameDecoder::end() {
+    if (input) {
+        stopCodec();
+    }
+    input = nullptr;
+    read_ptr = nullptr;
+    bytes_left = 0;
+    carry_offset = 0;
+    carry_bytes = 0;
+}
+
+void FrameDecoder::reset() {
+    read_ptr = buffers.input;
+    bytes_left = 0;
+    carry_offset = 0;
+    carry_bytes = 0;
+}
+
+bool FrameDecoder::prepare() {
+    if (!input) return false;
+    if (sample_rate != 0) return true;
+    
+    size_t bytes = decodeFrame(buffers.carry);
+    carry_offset = 0;
+    carry_bytes = bytes;
+    return bytes > 0;
+}
+
+size_t FrameDecoder::read(uint8_t* buffer, size_t len) {
+    if (!input) return 0;
+    
+    size_t written = takeCarry(buffer, len);
+    while (written < len) {
+        uint8_t* target = buffer + written;
+        size_t room = len - written;
+        if (room >= max_frame_bytes && (reinterpret_cast<uintptr_t>(target) & 1) == 0) {
+            // The common case: Helix writes the frame where it is needed
+            size_t bytes = decodeFrame(reinterpret_cast<int16_t*>(target));
+            if (bytes == 0) break;
+            written += bytes;
+        } else {
+            size_t bytes = decodeFrame(buffers.carry);
+            if (bytes == 0) break;
+            carry_offset = 0;
+            carry_bytes = bytes;
+            written += takeCarry(target, room);
+        }
+    }
+    return written;
+}
+
+bool FrameDecoder::fillInput() {
+    if (bytes_left > 0 && read_ptr != buffers.input) {
+        memmove(buffers.input, read_ptr, bytes_left);
+    }
+    read_ptr = buffers.input;
+    
+    size_t room = buffers.input_bytes - bytes_left;
+    if (room == 0) return false;
+    size_t got = input->readBytes(reinterpret_cast<char*>(buffers.input + bytes_left), room);
+    bytes_left += got;
+    return got > 0;
+}
+
+size_t FrameDecoder::takeCarry(uint8_t* buffer, size_t len) {
+    size_t bytes = carry_bytes - carry_offset;
+    if (bytes > len) bytes = len;
+    if (bytes == 0) return 0;
+    
+    memcpy(buffer, reinterpret_cast<uint8_t*>(buffers.carry) + carry_offset, bytes);
+    carry_offset += bytes;
+    if (carry_offset == carry_bytes) {
+        carry_offset = 0;
+        carry_bytes = 0;
+    }
+    return bytes;
+}
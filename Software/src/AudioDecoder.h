@@ -0,0 +1,93 @@
+#ifndef AUDIODECODER_H
+#define AUDIODECODER_H
+
+#include <Arduino.h>
+#include "ReadAheadStream.h"
+
+// Working memory of a decoder. The decoder slot owns it for its whole
+// life, so switching codecs from one track to the next never reallocates it.
+struct DecoderBuffers {
+    uint8_t* input;     // Compressed data
+    size_t input_bytes;
+    int16_t* carry;     // A decoded frame that did not fit the caller's buffer
+    size_t carry_bytes;
+};
+
+// One track's decoder, picked per file by AudioProcessor. Only state of
+// the codec's own is allocated, between begin() and end().
+class AudioDecoder {
+public:
+    virtual ~AudioDecoder() {}
+    
+    virtual bool begin(ReadAheadStream& source, const DecoderBuffers& buffers) = 0;
+    virtual void end() = 0;
+    virtual bool isActive() const = 0;
+    
+    // Drops buffered input and PCM, e.g. after the source was repositioned
+    virtual void reset() = 0;
+    
+    // Reads ahead until the format is known, before any PCM is handed out;
+    // false when the input holds nothing playable
+    virtual bool prepare() = 0;
+    
+    // Fills up to len bytes with 16-bit PCM in the stream's own format;
+    // 0 once the input is exhausted
+    virtual size_t read(uint8_t* buffer, size_t len) = 0;
+    
+    // Of the most recently decoded data; 0 before prepare()
+    virtual uint32_t getSampleRate() const = 0;
+    virtual uint16_t getChannels() const = 0;
+    
+    // Formats where time maps straight to a byte offset answer here;
+    // false means a seek index is needed, or seeking is not possible
+    virtual bool offsetForTime(uint32_t /* position_ms */, uint32_t& /* offset */, uint32_t& /* actual_ms */) const {
+        return false;
+    }
+};
+
+// Common part of the Helix frame decoders. Whole frames are decoded
+// straight into the caller's buffer; only when it has less room than a
+// frame is one decoded aside, and the part that did not fit is handed out
+// first on the next call.
+class FrameDecoder : public AudioDecoder {
+protected:
+    ReadAheadStream* input;
+    DecoderBuffers buffers;
+    uint8_t* read_ptr;
+    int bytes_left;
+    size_t carry_offset;
+    size_t carry_bytes;
+    uint32_t sample_rate;
+    uint16_t channels;
+    
+private:
+    size_t max_frame_bytes;
+    size_t min_input_bytes;
+    
+public:
+    FrameDecoder(size_t frame_bytes, size_t input_bytes);
+    
+    bool begin(ReadAheadStream& source, const DecoderBuffers& shared) override;
+    void end() override;
+    bool isActive() const override { return input != nullptr; }
+    void reset() override;
+    bool prepare() override;
+    size_t read(uint8_t* buffer, size_t len) override;
+    uint32_t getSampleRate() const override { return sample_rate; }
+    uint16_t getChannels() const override { return channels; }
+    
+protected:
+    // The codec: its own state, and one frame of PCM into output (bytes
+    // written, 0 at the end of the input)
+    virtual bool startCodec() = 0;
+    virtual void stopCodec() = 0;
+    virtual size_t decodeFrame(int16_t* output) = 0;
+    
+    // Moves the unread tail to the front and appends behind it
+    bool fillInput();
+    
+private:
+    size_t takeCarry(uint8_t* buffer, size_t len);
+};
+
+#endif
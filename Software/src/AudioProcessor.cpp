@@ -1,49 +1,777 @@
 #include "AudioProcessor.h"
+#include "FileBlockReader.h"
 
-AudioProcessor::AudioProcessor() : decoder(&current_file, &mp3) {
-    // Decoder is initialized with references to the file and mp3 objects.
+// Largest chunk decoded per mutex hold (one whole frame of any codec, so
+// it can go straight into the ring), and the free space the ring must
+// have before the decoder task bothers waking the decoder.
+static const size_t DECODE_CHUNK_BYTES = Mp3FrameDecoder::MAX_FRAME_BYTES > AacFrameDecoder::MAX_FRAME_BYTES ?
+                                         Mp3FrameDecoder::MAX_FRAME_BYTES : AacFrameDecoder::MAX_FRAME_BYTES;
+
+// Per slot, big enough for every codec: compressed input, and one frame of
+// PCM that did not fit the caller's buffer
+static const size_t DECODER_INPUT_BYTES = Mp3FrameDecoder::INPUT_BYTES > AacFrameDecoder::INPUT_BYTES ?
+                                          Mp3FrameDecoder::INPUT_BYTES : AacFrameDecoder::INPUT_BYTES;
+static const size_t DECODER_CARRY_BYTES = DECODE_CHUNK_BYTES;
+
+// Decoder PCM per chunk before conversion: 48 kHz input needs ~9% more
+static const size_t CONVERT_BUFFER_BYTES = DECODE_CHUNK_BYTES * 9 / 8;
+static const size_t DECODE_MIN_SPACE = 1024;
+static const TickType_t DECODER_IDLE_TICKS = pdMS_TO_TICKS(5);
+
+// Output room below which a resampled source cannot fit one more frame
+// (inputBytesFor() gives 0); 64 output frames cover inputs down to 8 kHz
+static const size_t DECODE_MIN_REGION = PcmRingBuffer::SPILL_BYTES;
+
+// One frame of the codec per step: a bigger chunk would only decode the
+// next frame aside and copy part of it
+static size_t chunkBytes(AudioCodec codec) {
+    return codec == AudioCodec::AAC ? AacFrameDecoder::MAX_FRAME_BYTES : Mp3FrameDecoder::MAX_FRAME_BYTES;
+}
+
+// Open the next track once this many bytes of the current file remain,
+// or once this much audio is left before a crossfade has to start
+static const int PRELOAD_REMAINING_BYTES = 64 * 1024;
+static const uint32_t PRELOAD_MARGIN_MS = 2000;
+
+// Input to decode before the PCM-per-input-byte ratio is trusted
+static const size_t REMAINING_ESTIMATE_MIN_INPUT = 16 * 1024;
+
+// The second Helix instance needs roughly 30 KB; without this much free
+// heap a crossfade falls back to a gapless transition
+static const uint32_t CROSSFADE_MIN_FREE_HEAP = 48 * 1024;
+
+// PCM leaving the ring: 44.1 kHz, 16-bit stereo
+static const uint32_t OUTPUT_BYTES_PER_SECOND = 44100 * 4;
+
+AudioProcessor::AudioProcessor() :
+    active_slot(&slots[0]),
+    next_slot(&slots[1]),
+    decoder_task(nullptr),
+    decoder_mutex(nullptr),
+    flush_pending(false),
+    end_of_stream(true),
+    next_path_mutex(nullptr),
+    pending_next_gain(GainStage::TRACK_UNITY),
+    track_boundary(0),
+    boundary_pending(false),
+    track_changed(false),
+    boundary_track_gain(GainStage::TRACK_UNITY),
+    track_start_position(0),
+    track_start_ms(0),
+    pending_start_ms(0),
+    pending_track_gain(GainStage::TRACK_UNITY),
+    mix_buffer(nullptr),
+    convert_buffer(nullptr),
+    crossfade_ms(0),
+    crossfade_requested(false),
+    mixing(false),
+    heap_warned(false),
+    output_primed(false),
+    low_water_bytes(0),
+    buffer_low_callback(nullptr),
+    buffer_low(false) {
+    memset(&decode_load, 0, sizeof(decode_load));
+    memset(&mix_load, 0, sizeof(mix_load));
 }
 
-bool AudioProcessor::openFile(const String& filepath) {
-    if (current_file) {
-        current_file.close();
+bool AudioProcessor::begin(size_t ring_bytes, size_t read_burst_bytes, int task_core, int task_priority) {
+    if (decoder_task) return true;
+    
+    if (!pcm_ring.allocate(ring_bytes)) {
+        Serial.println("Failed to allocate PCM ring buffer");
+        return false;
     }
     
-    current_file = SD.open(filepath);
-    if (!current_file) {
+    for (DecoderSlot& slot : slots) {
+        if (!slot.input.begin(read_burst_bytes)) {
+            Serial.println("Failed to allocate SD read-ahead buffers");
+            releaseBuffers();
+            return false;
+        }
+        slot.input.setLatencyHistogram(&metrics.sd_read_us);
+        
+        // Allocated once: codecs change from track to track, these stay
+        slot.buffers.input = static_cast<uint8_t*>(malloc(DECODER_INPUT_BYTES));
+        slot.buffers.input_bytes = DECODER_INPUT_BYTES;
+        slot.buffers.carry = static_cast<int16_t*>(malloc(DECODER_CARRY_BYTES));
+        slot.buffers.carry_bytes = DECODER_CARRY_BYTES;
+        if (!slot.buffers.input || !slot.buffers.carry) {
+            Serial.println("Failed to allocate decode buffers");
+            releaseBuffers();
+            return false;
+        }
+    }
+    
+    // Incoming track's PCM during a crossfade; word-aligned for the mixer
+    mix_buffer = static_cast<uint8_t*>(malloc(DECODE_CHUNK_BYTES));
+    convert_buffer = static_cast<uint8_t*>(malloc(CONVERT_BUFFER_BYTES));
+    if (!mix_buffer || !convert_buffer) {
+        Serial.println("Failed to allocate decode buffers");
+        releaseBuffers();
+        return false;
+    }
+    
+    decoder_mutex = xSemaphoreCreateMutex();
+    next_path_mutex = xSemaphoreCreateMutex();
+    if (!decoder_mutex || !next_path_mutex) {
+        Serial.println("Failed to create decoder mutex");
+        releaseBuffers();
+        return false;
+    }
+    
+    if (xTaskCreatePinnedToCore(decoderTaskEntry, "mp3_decoder", 8192, this,
+                                task_priority, &decoder_task, task_core) != pdPASS) {
+        Serial.println("Failed to start decoder task");
+        decoder_task = nullptr;
+        releaseBuffers();
+        return false;
+    }
+    
+    Serial.printf("Decoder task started (core %d, priority %d, ring %u bytes)\n",
+                  task_core, task_priority, (unsigned)pcm_ring.getCapacity());
+    return true;
+}
+
+void AudioProcessor::releaseBuffers() {
+    // Undoes a partial begin(), so a failed start holds no memory
+    pcm_ring.release();
+    for (DecoderSlot& slot : slots) {
+        slot.input.end();
+        free(slot.buffers.input);
+        free(slot.buffers.carry);
+        slot.buffers = DecoderBuffers();
+    }
+    free(mix_buffer);
+    free(convert_buffer);
+    mix_buffer = nullptr;
+    convert_buffer = nullptr;
+    
+    if (decoder_mutex) vSemaphoreDelete(decoder_mutex);
+    if (next_path_mutex) vSemaphoreDelete(next_path_mutex);
+    decoder_mutex = nullptr;
+    next_path_mutex = nullptr;
+}
+
+bool AudioProcessor::openSlot(DecoderSlot& slot, const String& filepath, bool start_decoder) {
+    closeSlot(slot);
+    
+    if (!slot.input.open(filepath)) {
         Serial.println("Failed to open file: " + filepath);
         return false;
     }
     
-    decoder.transformationReader().resizeResultQueue(1024 * 8);
-    if (!decoder.begin()) {
-        Serial.println("Decoder begin() failed");
-        current_file.close();
+    AudioDecoder* decoder = selectDecoder(slot, filepath);
+    if (!decoder) {
+        Serial.printf("Unsupported format (%s): %s\n", codecName(slot.codec), filepath.c_str());
+        slot.input.close();
+        return false;
+    }
+    slot.decoder = decoder;
+    
+    if (start_decoder && !startDecoder(slot)) {
+        slot.input.close();
         return false;
     }
     
-    Serial.printf("Opened file: %s\n", filepath.c_str());
+    slot.path = filepath;
     return true;
 }
 
-void AudioProcessor::closeFile() {
-    if (current_file) {
-        current_file.close();
+AudioDecoder* AudioProcessor::selectDecoder(DecoderSlot& slot, const String& filepath) {
+    // Magic bytes first, looking behind an ID3 tag if there is one; the
+    // extension only when they say nothing. The first read is served from
+    // the read-ahead burst the decoder needs anyway.
+    uint8_t header[CODEC_SNIFF_BYTES];
+    size_t offset = 0;
+    slot.codec = AudioCodec::UNKNOWN;
+    for (int look = 0; look < 2; look++) {
+        size_t tag_bytes;
+        if (!slot.input.seek(offset)) break;
+        size_t got = slot.input.readBytes(reinterpret_cast<char*>(header), sizeof(header));
+        slot.codec = codecForHeader(header, got, tag_bytes);
+        if (tag_bytes == 0) break;
+        offset += tag_bytes;
+    }
+    slot.input.seek(0);
+    if (slot.codec == AudioCodec::UNKNOWN) {
+        slot.codec = codecForExtension(filepath.c_str());
+    }
+    
+    switch (slot.codec) {
+        case AudioCodec::MP3: return &slot.mp3;
+        case AudioCodec::AAC: return &slot.aac;
+        case AudioCodec::WAV: return &slot.wav;
+        default:              return nullptr; // No FLAC decoder in this build
+    }
+}
+
+bool AudioProcessor::startDecoder(DecoderSlot& slot) {
+    if (slot.decoder->isActive()) return true;
+    
+    if (!slot.decoder->begin(slot.input, slot.buffers)) {
+        Serial.printf("Failed to start %s decoder\n", codecName(slot.codec));
+        return false;
+    }
+    slot.input_start = slot.input.position();
+    slot.pcm_bytes = 0;
+    slot.resampler.reset();
+    return true;
+}
+
+void AudioProcessor::closeSlot(DecoderSlot& slot) {
+    slot.decoder->end();
+    if (slot.input.isOpen()) {
+        slot.input.close();
     }
-    decoder.end();
+    slot.path = "";
+    slot.format_known = false;
+}
+
+void AudioProcessor::skipUnplayable(DecoderSlot& slot) {
+    // The input then reads as finished, so the track ends like any other
+    // and the player moves on instead of waiting on silence
+    if (slot.input.available()) {
+        Serial.println("Cannot play, skipping: " + slot.path);
+        slot.input.seek(slot.input.size());
+    }
+}
+
+size_t AudioProcessor::readSlot(DecoderSlot& slot, uint8_t* buffer, size_t len) {
+    if (!slot.decoder->isActive() && !startDecoder(slot)) {
+        skipUnplayable(slot);
+        return 0;
+    }
+    
+    // The first frame is decoded ahead, so no PCM leaves before its format
+    // is known. Nothing playable (a WAV in a sample format we do not
+    // convert, a file that is not what its name says) ends the track.
+    if (!slot.format_known) {
+        if (!slot.decoder->prepare()) {
+            skipUnplayable(slot);
+            return 0;
+        }
+        updateFormat(slot);
+    }
+    
+    size_t bytes;
+    if (slot.resampler.isPassthrough()) {
+        // 44.1 kHz stereo: whole frames are decoded straight into the ring,
+        // and WAV samples are copied there with no decoding at all
+        bytes = slot.decoder->read(buffer, len);
+    } else {
+        size_t budget = slot.resampler.inputBytesFor(len);
+        if (budget > CONVERT_BUFFER_BYTES) budget = CONVERT_BUFFER_BYTES;
+        size_t decoded = slot.decoder->read(convert_buffer, budget);
+        bytes = slot.resampler.process(convert_buffer, decoded, reinterpret_cast<int16_t*>(buffer), len / 4) * 4;
+    }
+    
+    // The rate may change mid-stream; later reads follow it
+    if (bytes > 0) updateFormat(slot);
+    slot.pcm_bytes += bytes;
+    return bytes;
+}
+
+void AudioProcessor::updateFormat(DecoderSlot& slot) {
+    uint32_t rate = slot.decoder->getSampleRate();
+    uint16_t channels = slot.decoder->getChannels();
+    if (rate == 0 || channels == 0) return;
+    
+    bool changed = !slot.resampler.matches(rate, channels);
+    if (changed && !slot.resampler.configure(rate, channels)) {
+        // Plays at the wrong speed rather than not at all; reported once
+        if (!slot.format_known) Serial.printf("Unsupported audio format: %u Hz, %u channels\n", (unsigned)rate, (unsigned)channels);
+    } else if (changed) {
+        Serial.printf("Converting %u Hz %s to %u Hz stereo\n", (unsigned)rate,
+                      channels == 1 ? "mono" : "stereo", (unsigned)PcmResampler::OUTPUT_RATE);
+    }
+    slot.format_known = true;
+}
+
+uint64_t AudioProcessor::remainingPcmBytes(DecoderSlot& slot) {
+    // Scale the input left by how much PCM each input byte has produced
+    size_t consumed = slot.input.position() - slot.input_start;
+    if (!slot.decoder->isActive() || consumed < REMAINING_ESTIMATE_MIN_INPUT || slot.pcm_bytes == 0) {
+        return UINT64_MAX;
+    }
+    return (uint64_t)slot.input.available() * slot.pcm_bytes / consumed;
+}
+
+void AudioProcessor::setCrossfade(uint32_t duration_ms) {
+    crossfade_ms = duration_ms > MAX_CROSSFADE_MS ? MAX_CROSSFADE_MS : duration_ms;
+}
+
+void AudioProcessor::setBufferLowCallback(size_t low_bytes, BufferLowCallback callback) {
+    low_water_bytes = low_bytes;
+    buffer_low_callback = callback;
+}
+
+bool AudioProcessor::canCrossfade() const {
+    // A stream that has already ended has nothing left to fade out of
+    return crossfade_ms > 0 && !end_of_stream.load(std::memory_order_acquire) &&
+           ESP.getFreeHeap() >= CROSSFADE_MIN_FREE_HEAP;
+}
+
+void AudioProcessor::getDecodeLoad(DecodeLoad& decoding, DecodeLoad& crossfading) {
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    decoding = decode_load;
+    crossfading = mix_load;
+    xSemaphoreGive(decoder_mutex);
+}
+
+bool AudioProcessor::openFile(const String& filepath, uint32_t track_gain) {
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    
+    // An explicit track change invalidates whatever was preloaded or mixing
+    closeSlot(*next_slot);
+    mixing = false;
+    mixer.reset();
+    crossfade_requested = false;
+    xSemaphoreTake(next_path_mutex, portMAX_DELAY);
+    pending_next_path = "";
+    xSemaphoreGive(next_path_mutex);
+    
+    bool opened = openSlot(*active_slot, filepath);
+    active_slot->track_gain = track_gain;
+    
+    // The decoder task holds off until the callback has dropped the old PCM
+    end_of_stream = !opened;
+    pending_start_ms = 0;
+    pending_track_gain = track_gain;
+    flush_pending = true;
+    xSemaphoreGive(decoder_mutex);
+    
+    if (opened) {
+        Serial.printf("Opened file: %s\n", filepath.c_str());
+    }
+    return opened;
+}
+
+void AudioProcessor::closeFile() {
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    closeSlot(*active_slot);
+    closeSlot(*next_slot);
+    mixing = false;
+    mixer.reset();
+    crossfade_requested = false;
+    end_of_stream = true;
+    flush_pending = true;
+    xSemaphoreGive(decoder_mutex);
+}
+
+void AudioProcessor::setNextFile(const String& filepath, uint32_t track_gain) {
+    xSemaphoreTake(next_path_mutex, portMAX_DELAY);
+    pending_next_path = filepath;
+    pending_next_gain = track_gain;
+    xSemaphoreGive(next_path_mutex);
 }
 
 int32_t AudioProcessor::readAudioData(uint8_t* buffer, int32_t len) {
-    if (!current_file || !current_file.available()) {
-        return 0; // Signal end of track
+    uint32_t started = micros();
+    
+    if (flush_pending.load(std::memory_order_acquire)) {
+        pcm_ring.discardAll();
+        boundary_pending.store(false, std::memory_order_relaxed);
+        track_start_position.store(pcm_ring.getReadPosition(), std::memory_order_relaxed);
+        track_start_ms.store(pending_start_ms.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        gain_stage.setTrackGain(pending_track_gain.load(std::memory_order_relaxed));
+        flush_pending.store(false, std::memory_order_release);
+        output_primed = false;
+        buffer_low = false;
     }
     
-    int32_t bytes_read = decoder.readBytes(buffer, len);
+    size_t buffered = pcm_ring.availableToRead();
+    size_t start = pcm_ring.getReadPosition();
+    size_t bytes_read = pcm_ring.read(buffer, len);
+    size_t split = len; // Bytes that still belong to the previous track
+    bool crossed = false;
+    
+    // Report the transition once playback has actually crossed into the next track
+    if (boundary_pending.load(std::memory_order_acquire) &&
+        pcm_ring.getReadPosition() - track_boundary < pcm_ring.getCapacity()) {
+        split = (track_boundary - start) & ~(size_t)3; // Whole frames, keeps word alignment
+        crossed = true;
+        boundary_pending.store(false, std::memory_order_relaxed);
+        track_start_position.store(track_boundary, std::memory_order_relaxed);
+        track_start_ms.store(0, std::memory_order_relaxed);
+        track_changed.store(true, std::memory_order_release);
+    }
     
-    // If we didn't get the full buffer, fill the rest with silence
-    if (bytes_read < len) {
+    if (bytes_read == 0 && end_of_stream.load(std::memory_order_acquire)) {
+        metrics.callback_us.record(micros() - started);
+        return 0; // Signal end of track
+    }
+    
+    // Decoder fell behind: fill the rest with silence. Only a dropout if
+    // audio was already flowing and the file has more to give.
+    size_t silence = 0;
+    if (bytes_read < (size_t)len) {
         memset(buffer + bytes_read, 0, len - bytes_read);
+        if (output_primed && !end_of_stream.load(std::memory_order_relaxed)) {
+            silence = len - bytes_read;
+        }
+    } else {
+        output_primed = true;
+    }
+    
+    // The new track's loudness correction starts exactly at its first sample,
+    // which may be the first byte of the next callback
+    gain_stage.process(buffer, split);
+    if (crossed) {
+        gain_stage.setTrackGain(boundary_track_gain.load(std::memory_order_relaxed));
+        gain_stage.process(buffer + split, len - split);
     }
     
+    if (output_primed) {
+        metrics.noteCallback(buffered, silence);
+        
+        // Edge-triggered, so a ring sitting low does not call back every block
+        bool low = buffered - bytes_read < low_water_bytes;
+        if (low && !buffer_low && buffer_low_callback) {
+            buffer_low_callback();
+        }
+        buffer_low = low;
+    }
+    metrics.callback_us.record(micros() - started);
     return len; // Always return the requested length for A2DP
-}
\ No newline at end of file
+}
+
+void AudioProcessor::decoderTaskEntry(void* param) {
+    static_cast<AudioProcessor*>(param)->decoderLoop();
+}
+
+void AudioProcessor::decoderLoop() {
+    while (true) {
+        bool produced = decodeStep();
+        preloadNextTrack();
+        metrics.noteFreeHeap(ESP.getFreeHeap());
+        if (!produced && !prefetchInput()) {
+            vTaskDelay(DECODER_IDLE_TICKS);
+        }
+    }
+}
+
+bool AudioProcessor::decodeStep() {
+    if (flush_pending.load(std::memory_order_acquire) ||
+        end_of_stream.load(std::memory_order_acquire) ||
+        pcm_ring.availableToWrite() < DECODE_MIN_SPACE) {
+        return false;
+    }
+    
+    bool produced = false;
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    
+    // Re-check under the lock: openFile/closeFile may have run meanwhile
+    if (!flush_pending && !end_of_stream && active_slot->input.isOpen()) {
+        uint32_t started = micros();
+        uint8_t* region;
+        size_t space = pcm_ring.writeRegion(&region, DECODE_MIN_REGION);
+        
+        if (!mixing && shouldStartCrossfade()) {
+            startCrossfade();
+        }
+        
+        // While mixing, the incoming track sets the chunk size
+        size_t chunk = chunkBytes(mixing ? next_slot->codec : active_slot->codec);
+        if (space > chunk) space = chunk;
+        
+        size_t bytes_decoded;
+        bool was_mixing = mixing;
+        if (mixing) {
+            bytes_decoded = mixStep(region, space);
+            produced = bytes_decoded > 0;
+        } else {
+            bytes_decoded = readSlot(*active_slot, region, space);
+            if (bytes_decoded > 0) {
+                pcm_ring.commitWrite(bytes_decoded);
+                produced = true;
+            } else if (!active_slot->input.available()) {
+                // Current track fully drained: continue straight into the next one
+                if (swapToNextSlot()) {
+                    produced = true;
+                } else {
+                    end_of_stream = true;
+                }
+            }
+        }
+        
+        // CPU headroom: time spent against the audio time produced
+        if (bytes_decoded > 0) {
+            uint32_t elapsed = micros() - started;
+            DecodeLoad& load = was_mixing ? mix_load : decode_load;
+            load.busy_us += elapsed;
+            load.audio_us += (uint64_t)bytes_decoded * 1000000 / OUTPUT_BYTES_PER_SECOND;
+            load.steps++;
+            if (elapsed > load.max_step_us) load.max_step_us = elapsed;
+            metrics.decode_us.record(elapsed);
+        }
+    }
+    
+    xSemaphoreGive(decoder_mutex);
+    return produced;
+}
+
+bool AudioProcessor::shouldStartCrossfade() {
+    // Called with decoder_mutex held
+    uint32_t fade_ms = crossfade_ms;
+    bool requested = crossfade_requested;
+    if (fade_ms == 0) {
+        crossfade_requested = false;
+        return false;
+    }
+    
+    if (!requested) {
+        uint64_t fade_bytes = (uint64_t)fade_ms * OUTPUT_BYTES_PER_SECOND / 1000;
+        if (remainingPcmBytes(*active_slot) > fade_bytes) return false;
+    }
+    
+    uint32_t track_gain;
+    String wanted = pendingNextPath(&track_gain);
+    if (wanted.isEmpty()) {
+        crossfade_requested = false;
+        return false;
+    }
+    
+    // Only the overlap pays for a second decoder, and only if it fits
+    if (ESP.getFreeHeap() < CROSSFADE_MIN_FREE_HEAP) {
+        if (!heap_warned) {
+            Serial.println("Not enough memory for a crossfade, using a gapless transition");
+            heap_warned = true;
+        }
+        crossfade_requested = false;
+        return false;
+    }
+    
+    if (next_slot->path != wanted && !openSlot(*next_slot, wanted, false)) {
+        crossfade_requested = false;
+        return false;
+    }
+    next_slot->track_gain = track_gain;
+    return startDecoder(*next_slot);
+}
+
+void AudioProcessor::startCrossfade() {
+    // Called with decoder_mutex held; the next slot is open and decoding
+    uint64_t frames = (uint64_t)crossfade_ms * (OUTPUT_BYTES_PER_SECOND / 4) / 1000;
+    uint64_t remaining = remainingPcmBytes(*active_slot);
+    if (remaining != UINT64_MAX && remaining / 4 < frames) {
+        frames = remaining / 4;
+    }
+    
+    // The output stage switches to the incoming gain at the boundary, so
+    // the outgoing track is scaled by its own gain relative to that
+    uint32_t outgoing_scale = next_slot->track_gain ?
+        active_slot->track_gain * GainStage::TRACK_UNITY / next_slot->track_gain : GainStage::TRACK_UNITY;
+    mixer.begin((uint32_t)frames, outgoing_scale);
+    mixing = true;
+    crossfade_requested = false;
+    
+    // From the listener's point of view the next track starts with the fade
+    track_boundary = pcm_ring.getWritePosition();
+    boundary_track_gain.store(next_slot->track_gain, std::memory_order_relaxed);
+    boundary_pending.store(true, std::memory_order_release);
+}
+
+size_t AudioProcessor::mixStep(uint8_t* region, size_t space) {
+    // The incoming track leads; the outgoing one fills in under it and is
+    // silence once it runs out before the fade does
+    size_t incoming = readSlot(*next_slot, mix_buffer, space) & ~(size_t)3;
+    if (incoming == 0) {
+        if (!next_slot->input.available()) {
+            finishCrossfade();
+        }
+        return 0;
+    }
+    
+    size_t outgoing = active_slot->input.isOpen() ? readSlot(*active_slot, region, incoming) : 0;
+    if (outgoing < incoming) {
+        memset(region + outgoing, 0, incoming - outgoing);
+    }
+    
+    mixer.mix(reinterpret_cast<uint32_t*>(region), reinterpret_cast<const uint32_t*>(mix_buffer), incoming / 4);
+    pcm_ring.commitWrite(incoming);
+    
+    if (!mixer.isActive()) {
+        finishCrossfade();
+    }
+    return incoming;
+}
+
+void AudioProcessor::finishCrossfade() {
+    mixing = false;
+    mixer.reset();
+    promoteNextSlot();
+}
+
+bool AudioProcessor::prefetchInput() {
+    // The ring is full, so use the idle time to read the next SD burst
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    bool fetched = active_slot->input.isOpen() && active_slot->input.prefetch();
+    xSemaphoreGive(decoder_mutex);
+    return fetched;
+}
+
+void AudioProcessor::promoteNextSlot() {
+    // Called with decoder_mutex held: the next slot becomes the active one
+    closeSlot(*active_slot);
+    DecoderSlot* finished = active_slot;
+    active_slot = next_slot;
+    next_slot = finished;
+    
+    // Consumed; the player queues the one after once it hears of the change
+    xSemaphoreTake(next_path_mutex, portMAX_DELAY);
+    if (pending_next_path == active_slot->path) {
+        pending_next_path = "";
+    }
+    xSemaphoreGive(next_path_mutex);
+}
+
+bool AudioProcessor::prepareSeekIndex(const String& filepath) {
+    if (seek_index_path == filepath) return seek_index.getMode() != SeekIndex::Mode::NONE;
+    
+    // A second handle, so the decoder keeps reading while the map is built
+    File file = SD.open(filepath);
+    if (!file) return false;
+    FileBlockReader reader(file);
+    bool built = seek_index.build(reader);
+    file.close();
+    
+    seek_index_path = filepath;
+    return built;
+}
+
+String AudioProcessor::activePath() {
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    String filepath = active_slot->path;
+    xSemaphoreGive(decoder_mutex);
+    return filepath;
+}
+
+bool AudioProcessor::repositionActive(const String& filepath, uint32_t byte_offset, uint32_t position_ms) {
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    
+    // The track may have moved on while the index was being built; during
+    // a crossfade two files are playing, so seeking waits until it is over
+    bool seeked = !mixing && !filepath.isEmpty() && active_slot->path == filepath &&
+                  active_slot->input.seek(byte_offset);
+    if (seeked) {
+        // Drop buffered input and PCM so nothing from the old position leaks through
+        active_slot->decoder->reset();
+        active_slot->resampler.reset();
+        active_slot->input_start = byte_offset;
+        active_slot->pcm_bytes = 0;
+        end_of_stream = false;
+        pending_start_ms = position_ms;
+        flush_pending = true;
+    }
+    
+    xSemaphoreGive(decoder_mutex);
+    return seeked;
+}
+
+bool AudioProcessor::offsetForTime(const String& filepath, uint32_t position_ms, uint32_t& offset, uint32_t& actual_ms) {
+    if (filepath.isEmpty()) return false;
+    
+    // WAV maps time to bytes directly; MP3 needs the seek map, and for AAC
+    // there is none
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    bool current = active_slot->path == filepath;
+    AudioCodec codec = active_slot->codec;
+    bool direct = current && active_slot->decoder->offsetForTime(position_ms, offset, actual_ms);
+    xSemaphoreGive(decoder_mutex);
+    
+    if (direct) return true;
+    if (!current || codec != AudioCodec::MP3 || !prepareSeekIndex(filepath)) return false;
+    offset = seek_index.offsetForTime(position_ms, actual_ms);
+    return true;
+}
+
+bool AudioProcessor::seekTo(uint32_t position_ms, uint32_t& actual_ms) {
+    String filepath = activePath();
+    uint32_t offset;
+    if (!offsetForTime(filepath, position_ms, offset, actual_ms)) {
+        return false;
+    }
+    return repositionActive(filepath, offset, actual_ms);
+}
+
+bool AudioProcessor::seekToOffset(uint32_t byte_offset, uint32_t position_ms) {
+    return repositionActive(activePath(), byte_offset, position_ms);
+}
+
+bool AudioProcessor::getResumePoint(const String& filepath, uint32_t& byte_offset, uint32_t& position_ms) {
+    // Around a gapless change the decoder is already on the next file
+    return offsetForTime(filepath, getPositionMs(), byte_offset, position_ms);
+}
+
+uint32_t AudioProcessor::getPositionMs() {
+    size_t played = pcm_ring.getReadPosition() - track_start_position.load(std::memory_order_relaxed);
+    return track_start_ms.load(std::memory_order_relaxed) +
+           (uint32_t)((uint64_t)played * 1000 / OUTPUT_BYTES_PER_SECOND);
+}
+
+ReadAheadStats AudioProcessor::getReadStats() {
+    ReadAheadStats total = {};
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    for (DecoderSlot& slot : slots) {
+        const ReadAheadStats& stats = slot.input.getStats();
+        total.bursts += stats.bursts;
+        total.stalls += stats.stalls;
+        total.bytes += stats.bytes;
+        total.busy_us += stats.busy_us;
+        if (stats.max_burst_us > total.max_burst_us) total.max_burst_us = stats.max_burst_us;
+    }
+    xSemaphoreGive(decoder_mutex);
+    return total;
+}
+
+String AudioProcessor::pendingNextPath(uint32_t* track_gain) {
+    xSemaphoreTake(next_path_mutex, portMAX_DELAY);
+    String path = pending_next_path;
+    if (track_gain) *track_gain = pending_next_gain;
+    xSemaphoreGive(next_path_mutex);
+    return path;
+}
+
+void AudioProcessor::preloadNextTrack() {
+    xSemaphoreTake(decoder_mutex, portMAX_DELAY);
+    
+    // The incoming track of a running crossfade is not to be touched
+    if (mixing) {
+        xSemaphoreGive(decoder_mutex);
+        return;
+    }
+    
+    uint64_t preload_bytes = (uint64_t)(crossfade_ms + PRELOAD_MARGIN_MS) * OUTPUT_BYTES_PER_SECOND / 1000;
+    uint32_t track_gain;
+    String wanted = pendingNextPath(&track_gain);
+    if (wanted.isEmpty() || !active_slot->input.isOpen()) {
+        closeSlot(*next_slot);
+    } else if (next_slot->path != wanted &&
+               (active_slot->input.available() < PRELOAD_REMAINING_BYTES ||
+                remainingPcmBytes(*active_slot) < preload_bytes)) {
+        // File only: the decoder starts when the overlap or the swap begins
+        openSlot(*next_slot, wanted, false);
+    }
+    next_slot->track_gain = track_gain;
+    
+    xSemaphoreGive(decoder_mutex);
+}
+
+bool AudioProcessor::swapToNextSlot() {
+    // Called with decoder_mutex held. Normally the next track is already
+    // open; for very short tracks it may still have to be opened here.
+    uint32_t track_gain;
+    String wanted = pendingNextPath(&track_gain);
+    if (wanted.isEmpty()) return false;
+    if (next_slot->path != wanted && !openSlot(*next_slot, wanted)) return false;
+    if (!startDecoder(*next_slot)) return false;
+    next_slot->track_gain = track_gain;
+    
+    promoteNextSlot();
+    
+    // First byte of the new track lands at the current write position
+    track_boundary = pcm_ring.getWritePosition();
+    boundary_track_gain.store(active_slot->track_gain, std::memory_order_relaxed);
+    boundary_pending.store(true, std::memory_order_release);
+    return true;
+}
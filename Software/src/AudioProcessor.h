@@ -3,22 +3,204 @@
 
 #include <Arduino.h>
 #include <SD.h>
-#include "AudioTools.h"
-#include "AudioTools/AudioCodecs/CodecMP3Helix.h"
+#include <atomic>
+#include "PcmRingBuffer.h"
+#include "ReadAheadStream.h"
+#include "SeekIndex.h"
+#include "GainStage.h"
+#include "CrossfadeMixer.h"
+#include "PcmResampler.h"
+#include "AudioCodec.h"
+#include "Mp3FrameDecoder.h"
+#include "AacFrameDecoder.h"
+#include "WavPcmDecoder.h"
+#include "PlaybackMetrics.h"
+
+// One open file with its own read-ahead buffers and decoders. The codec is
+// picked when the file is opened, and only started (and its state
+// allocated) on first use, so a preloaded slot costs no decoder memory
+// until it is actually played. The input and carry buffers are allocated
+// once and serve whichever codec the file needs.
+struct DecoderSlot {
+    ReadAheadStream input;
+    Mp3FrameDecoder mp3;
+    AacFrameDecoder aac;
+    WavPcmDecoder wav;
+    AudioDecoder* decoder; // One of the above, for the open file
+    AudioCodec codec;
+    DecoderBuffers buffers;
+    String path;
+    uint32_t track_gain; // Q12 loudness correction for this file
+    size_t input_start;  // Input position when decoding started
+    uint64_t pcm_bytes;  // PCM produced since, for the remaining-time estimate
+    PcmResampler resampler; // Decoder format to 44.1 kHz stereo
+    bool format_known;      // Resampler is set up for the decoder's format
+    
+    DecoderSlot() : decoder(&mp3), codec(AudioCodec::UNKNOWN), buffers(), track_gain(GainStage::TRACK_UNITY),
+                    input_start(0), pcm_bytes(0), format_known(false) {}
+};
+
+// Runs in the A2DP callback, so it must be short and must not block
+typedef void (*BufferLowCallback)();
+
+// Time the decoder task spent per unit of audio it produced; below 100%
+// it keeps ahead of the A2DP callback
+struct DecodeLoad {
+    uint64_t busy_us;
+    uint64_t audio_us;
+    uint32_t max_step_us; // Longest single decode step
+    uint32_t steps;
+    
+    uint32_t percent() const { return audio_us ? (uint32_t)(busy_us * 100 / audio_us) : 0; }
+};
 
 class AudioProcessor {
+public:
+    static const uint32_t MAX_CROSSFADE_MS = 10000;
+    
 private:
-    File current_file;
-    MP3DecoderHelix mp3;
-    EncodedAudioStream decoder;
+    // Two slots so the next track can be opened while the current one plays
+    DecoderSlot slots[2];
+    DecoderSlot* active_slot;
+    DecoderSlot* next_slot;
+    
+    // Decode-ahead: the decoder task fills pcm_ring, the A2DP callback drains it
+    PcmRingBuffer pcm_ring;
+    TaskHandle_t decoder_task;
+    SemaphoreHandle_t decoder_mutex;
+    std::atomic<bool> flush_pending; // Ring holds stale PCM from a previous file
+    std::atomic<bool> end_of_stream; // Decoder has nothing more to produce
+    
+    // Next track handoff, guarded by its own short-held mutex
+    SemaphoreHandle_t next_path_mutex;
+    String pending_next_path;
+    uint32_t pending_next_gain;
+    
+    // Ring position where the next track's first sample was written
+    size_t track_boundary;
+    std::atomic<bool> boundary_pending;
+    std::atomic<bool> track_changed;
+    std::atomic<uint32_t> boundary_track_gain;
+    
+    // Playback position: ring read position where the current track (or the
+    // last seek) started, and the track time it corresponds to
+    std::atomic<size_t> track_start_position;
+    std::atomic<uint32_t> track_start_ms;
+    std::atomic<uint32_t> pending_start_ms; // Applied with the next flush
+    std::atomic<uint32_t> pending_track_gain;
+    
+    // Volume and fades, applied to the PCM on its way out
+    GainStage gain_stage;
+    
+    // Crossfade: both slots decode during the overlap and are mixed into the ring
+    CrossfadeMixer mixer;
+    uint8_t* mix_buffer;
+    uint8_t* convert_buffer; // Decoder PCM awaiting rate/channel conversion
+    std::atomic<uint32_t> crossfade_ms;
+    std::atomic<bool> crossfade_requested; // Fade into the next file now
+    bool mixing;
+    bool heap_warned;
+    DecodeLoad decode_load;
+    DecodeLoad mix_load;
+    
+    // Playback health; output_primed is callback-owned and set once audio
+    // has flowed since the last flush, so start-up silence is no dropout
+    PlaybackMetrics metrics;
+    bool output_primed;
+    
+    // Low-water notification; buffer_low is callback-owned
+    size_t low_water_bytes;
+    BufferLowCallback buffer_low_callback;
+    bool buffer_low;
+    
+    // Seek map of the last track seeked in; only touched by the player task
+    SeekIndex seek_index;
+    String seek_index_path;
     
 public:
     AudioProcessor();
     
-    bool openFile(const String& filepath);
+    // Allocates the PCM ring and SD read bursts, then starts the decoder task
+    bool begin(size_t ring_bytes, size_t read_burst_bytes, int task_core, int task_priority);
+    
+    // track_gain is the Q12 loudness correction, applied from the first sample
+    bool openFile(const String& filepath, uint32_t track_gain = GainStage::TRACK_UNITY);
     void closeFile();
     
+    // Track to continue with, without a gap, once the current one ends
+    void setNextFile(const String& filepath, uint32_t track_gain = GainStage::TRACK_UNITY);
+    
+    // Called from the A2DP callback: bounded copy out of the PCM ring
     int32_t readAudioData(uint8_t* buffer, int32_t len);
+    
+    // Non-blocking fade to a Q15 gain; the callback applies it frame by frame
+    void fadeTo(uint32_t gain_q15, uint32_t ramp_ms) { gain_stage.rampTo(gain_q15, ramp_ms); }
+    bool isFading() const { return gain_stage.isRamping(); }
+    
+    // 0 for gapless transitions, up to MAX_CROSSFADE_MS
+    void setCrossfade(uint32_t duration_ms);
+    uint32_t getCrossfade() const { return crossfade_ms; }
+    
+    // Fades into the file set with setNextFile() right away (manual skip)
+    void crossfadeToNext() { crossfade_requested = true; }
+    bool canCrossfade() const;
+    bool isCrossfading() const { return mixing || crossfade_requested; }
+    
+    // Decoder CPU load, with and without a crossfade running
+    void getDecodeLoad(DecodeLoad& decoding, DecodeLoad& crossfading);
+    
+    // Dropouts and timing histograms, safe to read from any task
+    void getMetrics(PlaybackMetricsSnapshot& snapshot) const { metrics.snapshot(snapshot); }
+    void resetMetrics() { metrics.reset(); }
+    size_t getBufferedBytes() const { return pcm_ring.availableToRead(); }
+    size_t getBufferCapacity() const { return pcm_ring.getCapacity(); }
+    
+    // Called once each time the ring drops below low_bytes while audio is
+    // flowing, from the A2DP callback. Set before playback starts.
+    void setBufferLowCallback(size_t low_bytes, BufferLowCallback callback);
+    
+    // True once per gapless transition, after its first sample was played
+    bool consumeTrackChange() { return track_changed.exchange(false); }
+    
+    // Repositions the playing file without reopening it; actual_ms is the
+    // frame-aligned time playback resumes from
+    bool seekTo(uint32_t position_ms, uint32_t& actual_ms);
+    
+    // Resume support: a saved offset is seeked to directly, no map needed
+    bool seekToOffset(uint32_t byte_offset, uint32_t position_ms);
+    bool getResumePoint(const String& filepath, uint32_t& byte_offset, uint32_t& position_ms);
+    
+    uint32_t getPositionMs();
+    
+    // SD read-ahead statistics summed over both slots
+    ReadAheadStats getReadStats();
+    
+private:
+    void releaseBuffers();
+    static void decoderTaskEntry(void* param);
+    void decoderLoop();
+    bool decodeStep();
+    bool prefetchInput();
+    String pendingNextPath(uint32_t* track_gain = nullptr);
+    void preloadNextTrack();
+    bool openSlot(DecoderSlot& slot, const String& filepath, bool start_decoder = true);
+    AudioDecoder* selectDecoder(DecoderSlot& slot, const String& filepath);
+    bool startDecoder(DecoderSlot& slot);
+    void updateFormat(DecoderSlot& slot);
+    void closeSlot(DecoderSlot& slot);
+    void skipUnplayable(DecoderSlot& slot);
+    size_t readSlot(DecoderSlot& slot, uint8_t* buffer, size_t len);
+    uint64_t remainingPcmBytes(DecoderSlot& slot);
+    bool swapToNextSlot();
+    void promoteNextSlot();
+    bool shouldStartCrossfade();
+    void startCrossfade();
+    size_t mixStep(uint8_t* region, size_t space);
+    void finishCrossfade();
+    bool prepareSeekIndex(const String& filepath);
+    bool offsetForTime(const String& filepath, uint32_t position_ms, uint32_t& offset, uint32_t& actual_ms);
+    String activePath();
+    bool repositionActive(const String& filepath, uint32_t byte_offset, uint32_t position_ms);
 };
 
 #endif
@@ -67,22 +67,22 @@ int32_t BluetoothManager::audioDataCallback(uint8_t* data, int32_t len) {
         return len;
     }
     
-    if (instance->music_player->isBusy()) {
-        memset(data, 0, len);
-        return len;
-    }
-
+    // Keep playing while a pause or stop fades out
     PlayerState state = instance->music_player->getState();
-    if (state == PlayerState::STOPPED || state == PlayerState::PAUSED) {
+    if ((state == PlayerState::STOPPED || state == PlayerState::PAUSED) && !audio_processor.isFading()) {
         memset(data, 0, len);
         return len;
     }
     
     int32_t result = audio_processor.readAudioData(data, len);
     
+    if (audio_processor.consumeTrackChange()) {
+        instance->music_player->notifyTrackAdvanced();
+    }
+    
     if (result == 0) {
-        Serial.println("Track finished, moving to next...");
-        if (instance->music_player) {
+        if (state == PlayerState::PLAYING) {
+            Serial.println("Track finished, moving to next...");
             instance->music_player->notifyTrackFinished();
         }
         memset(data, 0, len);
@@ -125,7 +125,7 @@ void BluetoothManager::connectionStateCallback(esp_a2d_connection_state_t state,
 }
 
 void BluetoothManager::avrcCommandCallback(uint8_t key, bool isReleased) {
-    if (!instance || !instance->music_player || !isReleased || instance->music_player->isBusy()) return;
+    if (!instance || !instance->music_player || !isReleased) return;
     
     Serial.print("AVRC Command: ");
     
@@ -0,0 +1,76 @@
+#include "CpuGovernor.h"
+
+CpuGovernor::CpuGovernor(const uint32_t* steps_mhz, int count) :
+    step_count(0),
+    current(0),
+    calm_samples(0),
+    stats() {
+    for (int i = 0; i < count && i < MAX_STEPS; i++) {
+        steps[step_count++] = steps_mhz[i];
+    }
+    if (step_count == 0) {
+        steps[step_count++] = 240; // The ESP32's default clock
+    }
+    current = step_count - 1;
+}
+
+uint32_t CpuGovernor::update(const GovernorSample& sample) {
+    stats.samples++;
+    
+    // Running dry: the reason does not matter, more clock is the cure
+    if (sample.playing && sample.fill_percent < LOW_FILL_PERCENT) {
+        if (current != step_count - 1) {
+            stats.boosts++;
+            setStep(step_count - 1);
+        }
+        calm_samples = 0;
+        return steps[current];
+    }
+    
+    // Nothing decoded while playing (a stall, a seek) says nothing about the load
+    uint64_t load_percent;
+    if (sample.audio_us > 0) {
+        load_percent = sample.busy_us * 100 / sample.audio_us;
+    } else if (!sample.playing) {
+        load_percent = 0;
+    } else {
+        calm_samples = 0;
+        return steps[current];
+    }
+    
+    int wanted = stepFor(load_percent);
+    if (load_percent > UP_LOAD_PERCENT && wanted > current) {
+        setStep(wanted);
+        calm_samples = 0;
+        return steps[current];
+    }
+    
+    // After a boost this also waits for the ring to refill; the load
+    // measured meanwhile tells how far down is safe
+    bool settled = !sample.playing || sample.fill_percent >= HIGH_FILL_PERCENT;
+    if (wanted < current && settled) {
+        if (++calm_samples >= DOWN_SAMPLES) {
+            setStep(wanted);
+            calm_samples = 0;
+        }
+    } else {
+        calm_samples = 0;
+    }
+    return steps[current];
+}
+
+int CpuGovernor::stepFor(uint64_t load_percent) const {
+    // Lowest step where the load, scaled from the current clock, stays on target
+    for (int i = 0; i < step_count; i++) {
+        if (load_percent * steps[current] <= (uint64_t)TARGET_LOAD_PERCENT * steps[i]) {
+            return i;
+        }
+    }
+    return step_count - 1;
+}
+
+void CpuGovernor::setStep(int step) {
+    if (step == current) return;
+    current = step;
+    stats.changes++;
+}
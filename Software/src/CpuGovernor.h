@@ -0,0 +1,61 @@
+#ifndef CPUGOVERNOR_H
+#define CPUGOVERNOR_H
+
+#include <cstdint>
+
+// What the playback path looked like since the previous sample
+struct GovernorSample {
+    uint64_t busy_us;      // Decoder task time spent decoding
+    uint64_t audio_us;     // Audio it produced in that time
+    uint32_t fill_percent; // PCM ring fill now
+    bool playing;          // Something is being played; otherwise only idling counts
+};
+
+struct GovernorStats {
+    uint32_t samples;
+    uint32_t changes; // Frequency switches
+    uint32_t boosts;  // Jumps to the top because the ring ran low
+};
+
+// Picks the CPU clock for playback from the decoder's load and the PCM
+// ring's fill; the caller measures and applies the frequency. Decode time
+// is taken to scale inversely with the clock. The clock goes up at once
+// when the load passes UP_LOAD_PERCENT, and straight to the top when the
+// ring falls below LOW_FILL_PERCENT. It comes down only after DOWN_SAMPLES
+// samples in a row where the ring stayed above HIGH_FILL_PERCENT and a
+// lower step would still be under TARGET_LOAD_PERCENT; the gap between
+// the two load thresholds is the hysteresis. No Arduino dependencies, so
+// load traces can be replayed on the host.
+class CpuGovernor {
+public:
+    static const int MAX_STEPS = 4;
+    static const uint32_t UP_LOAD_PERCENT = 70;
+    static const uint32_t TARGET_LOAD_PERCENT = 50;
+    static const uint32_t LOW_FILL_PERCENT = 25;
+    static const uint32_t HIGH_FILL_PERCENT = 75;
+    static const uint32_t DOWN_SAMPLES = 6;
+
+private:
+    uint32_t steps[MAX_STEPS]; // MHz, ascending
+    int step_count;
+    int current;
+    uint32_t calm_samples; // In a row that would allow a lower step
+    GovernorStats stats;
+    
+public:
+    // Up to MAX_STEPS frequencies in ascending order; starts at the highest
+    CpuGovernor(const uint32_t* steps_mhz, int count);
+    
+    // Returns the frequency to run at from now on
+    uint32_t update(const GovernorSample& sample);
+    
+    uint32_t getFrequency() const { return steps[current]; }
+    uint32_t getMaxFrequency() const { return steps[step_count - 1]; }
+    const GovernorStats& getStats() const { return stats; }
+    
+private:
+    int stepFor(uint64_t load_percent) const;
+    void setStep(int step);
+};
+
+#endif
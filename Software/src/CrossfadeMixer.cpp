@@ -0,0 +1,63 @@
+#include "CrossfadeMixer.h"
+#include <cmath>
+
+// Mix coefficients are Q14 so that two products still sum inside 32 bits
+static const int32_t MAX_COEFFICIENT = 32767;
+
+CrossfadeMixer::CrossfadeMixer() :
+    total_frames(0),
+    done_frames(0),
+    phase(0),
+    phase_step(0),
+    outgoing_scale(4096) {
+    for (size_t i = 0; i <= CURVE_POINTS; i++) {
+        double angle = (M_PI / 2.0) * i / CURVE_POINTS;
+        double value = sin(angle) * 32768.0 + 0.5;
+        curve[i] = value >= 32768.0 ? 32768 : (uint16_t)value;
+    }
+}
+
+void CrossfadeMixer::begin(uint32_t frames, uint32_t outgoing_scale_q12) {
+    total_frames = frames;
+    done_frames = 0;
+    phase = 0;
+    phase_step = frames ? (uint32_t)(((uint64_t)CURVE_POINTS << 16) / frames) : 0;
+    outgoing_scale = outgoing_scale_q12 > 8191 ? 8191 : outgoing_scale_q12;
+}
+
+void CrossfadeMixer::mix(uint32_t* out, const uint32_t* in, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        // Past the end of the fade the incoming track plays alone
+        int32_t gain_in = 16384;
+        int32_t gain_out = 0;
+        if (done_frames < total_frames) {
+            uint32_t index = phase >> 16;
+            uint32_t fraction = phase & 0xFFFF;
+            if (index >= CURVE_POINTS) {
+                index = CURVE_POINTS - 1;
+                fraction = 0xFFFF;
+            }
+            
+            // Interpolated sin for the incoming track, mirrored cos for the outgoing
+            int32_t sin_q15 = curve[index] + (int32_t)(((curve[index + 1] - curve[index]) * (int64_t)fraction) >> 16);
+            int32_t cos_q15 = curve[CURVE_POINTS - index] -
+                              (int32_t)(((curve[CURVE_POINTS - index] - curve[CURVE_POINTS - index - 1]) * (int64_t)fraction) >> 16);
+            gain_in = sin_q15 >> 1;
+            gain_out = (int32_t)(((int64_t)cos_q15 * outgoing_scale) >> 13);
+            if (gain_out > MAX_COEFFICIENT) gain_out = MAX_COEFFICIENT;
+            
+            phase += phase_step;
+            done_frames++;
+        }
+        
+        uint32_t a = out[i];
+        uint32_t b = in[i];
+        int32_t left = ((int32_t)(int16_t)(a & 0xFFFF) * gain_out + (int32_t)(int16_t)(b & 0xFFFF) * gain_in) >> 14;
+        int32_t right = ((int32_t)(int16_t)(a >> 16) * gain_out + (int32_t)(int16_t)(b >> 16) * gain_in) >> 14;
+        if (left > 32767) left = 32767;
+        if (left < -32768) left = -32768;
+        if (right > 32767) right = 32767;
+        if (right < -32768) right = -32768;
+        out[i] = (uint16_t)left | ((uint32_t)(uint16_t)right << 16);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef CROSSFADEMIXER_H
+#define CROSSFADEMIXER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Equal-power crossfade of two 16-bit stereo streams: the outgoing track
+// follows cos, the incoming one sin, over a quarter turn, so the summed
+// power stays constant. Coefficients come from a Q15 table and a
+// fixed-point phase accumulator; each frame's two channels share one
+// 32-bit load and store. No Arduino dependencies.
+class CrossfadeMixer {
+public:
+    static const size_t CURVE_POINTS = 256;
+    
+private:
+    uint16_t curve[CURVE_POINTS + 1]; // sin over a quarter turn, Q15
+    uint32_t total_frames;
+    uint32_t done_frames;
+    uint32_t phase;      // Curve position, Q16
+    uint32_t phase_step;
+    uint32_t outgoing_scale; // Q12, outgoing loudness relative to incoming
+    
+public:
+    CrossfadeMixer();
+    
+    // outgoing_scale_q12 lets both tracks keep their own loudness
+    // correction while the output stage already applies the incoming one
+    void begin(uint32_t frames, uint32_t outgoing_scale_q12);
+    void reset() { total_frames = 0; done_frames = 0; }
+    
+    bool isActive() const { return done_frames < total_frames; }
+    uint32_t remainingFrames() const { return total_frames - done_frames; }
+    
+    // out holds the outgoing track and receives the mix; in is the incoming
+    void mix(uint32_t* out, const uint32_t* in, size_t frames);
+};
+
+#endif
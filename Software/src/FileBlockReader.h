@@ -0,0 +1,20 @@
+#ifndef FILEBLOCKREADER_H
+#define FILEBLOCKREADER_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "ReadAheadBuffer.h"
+
+// Parses a track through a plain SD file; header reads are small and few
+class FileBlockReader : public BlockReader {
+private:
+    File& file;
+    
+public:
+    explicit FileBlockReader(File& source) : file(source) {}
+    size_t readBlock(uint8_t* buffer, size_t len) override { return file.read(buffer, len); }
+    bool seekBlock(size_t position) override { return file.seek(position); }
+    size_t totalSize() override { return file.size(); }
+};
+
+#endif
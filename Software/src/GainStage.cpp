@@ -0,0 +1,144 @@
+#include "GainStage.h"
+#include "Mp3HeaderParser.h"
+#include <cmath>
+#include <cstring>
+
+// round(32768 * 10^(-dB / 20)) for 0..80 dB of attenuation
+static constexpr uint16_t DB_TO_Q15[] = {
+    32768, 29205, 26029, 23198, 20675, 18427, 16423, 14637, 13045, 11627,
+    10362, 9235, 8231, 7336, 6538, 5827, 5193, 4629, 4125, 3677,
+    3277, 2920, 2603, 2320, 2068, 1843, 1642, 1464, 1305, 1163,
+    1036, 924, 823, 734, 654, 583, 519, 463, 413, 368,
+    328, 292, 260, 232, 207, 184, 164, 146, 130, 116,
+    104, 92, 82, 73, 65, 58, 52, 46, 41, 37,
+    33, 29, 26, 23, 21, 18, 16, 15, 13, 12,
+    10, 9, 8, 7, 7, 6, 5, 5, 4, 4,
+    3
+};
+
+static_assert(sizeof(DB_TO_Q15) / sizeof(DB_TO_Q15[0]) == 1 - GainStage::MIN_DB,
+              "DB_TO_Q15 must cover 0..MIN_DB");
+
+static const uint32_t REQUEST_NEW = 0x80000000u;
+static const uint32_t MAX_RAMP_MS = 0x7FFF;
+
+GainStage::GainStage() :
+    request(0),
+    current(UNITY << 16),
+    step(0),
+    target(UNITY << 16),
+    remaining_frames(0),
+    ramping(false),
+    track_gain(TRACK_UNITY) {
+}
+
+uint32_t GainStage::dbToGain(int db) {
+    if (db >= 0) return UNITY;
+    if (db < MIN_DB) return 0;
+    return DB_TO_Q15[-db];
+}
+
+uint32_t GainStage::replayGainToTrackGain(int16_t gain_cdb, uint16_t peak_q15) {
+    if (gain_cdb == REPLAY_GAIN_UNKNOWN) return TRACK_UNITY;
+    
+    // Once per track, so plain float is fine here
+    float gain = powf(10.0f, gain_cdb / 2000.0f);
+    if (peak_q15 > 0) {
+        float limit = (float)UNITY / peak_q15;
+        if (gain > limit) gain = limit;
+    }
+    
+    float scaled = gain * TRACK_UNITY + 0.5f;
+    return scaled >= MAX_TRACK_GAIN ? MAX_TRACK_GAIN : (uint32_t)scaled;
+}
+
+void GainStage::rampTo(uint32_t gain_q15, uint32_t ramp_ms) {
+    if (gain_q15 > UNITY) gain_q15 = UNITY;
+    if (ramp_ms > MAX_RAMP_MS) ramp_ms = MAX_RAMP_MS;
+    request.store(REQUEST_NEW | (ramp_ms << 16) | gain_q15, std::memory_order_release);
+}
+
+bool GainStage::isRamping() const {
+    // A posted target counts as ramping until process() picks it up
+    return (request.load(std::memory_order_acquire) & REQUEST_NEW) ||
+           ramping.load(std::memory_order_acquire);
+}
+
+void GainStage::startRamp(uint32_t packed) {
+    uint32_t gain = packed & 0xFFFF;
+    if (gain > UNITY) gain = UNITY; // 0x8000 fits; anything above is clamped
+    uint32_t ramp_ms = (packed >> 16) & MAX_RAMP_MS;
+    
+    target = gain << 16;
+    remaining_frames = ramp_ms * SAMPLE_RATE / 1000;
+    if (remaining_frames == 0) {
+        current = target;
+        step = 0;
+    } else {
+        step = (int32_t)(((int64_t)target - (int64_t)current) / (int64_t)remaining_frames);
+    }
+}
+
+void GainStage::scaleFrames(uint32_t* frames, size_t count, uint32_t gain) {
+    // Both channels share one 32-bit load and store; |sample * gain| >> 15
+    // never exceeds 16 bits because gain is at most unity
+    for (size_t i = 0; i < count; i++) {
+        uint32_t frame = frames[i];
+        int32_t left = (int16_t)(frame & 0xFFFF);
+        int32_t right = (int16_t)(frame >> 16);
+        left = (left * (int32_t)gain) >> 15;
+        right = (right * (int32_t)gain) >> 15;
+        frames[i] = (uint16_t)left | ((uint32_t)(uint16_t)right << 16);
+    }
+}
+
+void GainStage::scaleFramesSaturating(uint32_t* frames, size_t count, uint32_t gain) {
+    // Above unity a loud sample can overshoot; clip instead of wrapping
+    for (size_t i = 0; i < count; i++) {
+        uint32_t frame = frames[i];
+        int32_t left = ((int32_t)(int16_t)(frame & 0xFFFF) * (int32_t)gain) >> 15;
+        int32_t right = ((int32_t)(int16_t)(frame >> 16) * (int32_t)gain) >> 15;
+        if (left > 32767) left = 32767;
+        if (left < -32768) left = -32768;
+        if (right > 32767) right = 32767;
+        if (right < -32768) right = -32768;
+        frames[i] = (uint16_t)left | ((uint32_t)(uint16_t)right << 16);
+    }
+}
+
+void GainStage::process(uint8_t* pcm, size_t bytes) {
+    uint32_t packed = request.exchange(0, std::memory_order_acquire);
+    if (packed & REQUEST_NEW) {
+        startRamp(packed);
+    }
+    
+    // The A2DP buffer is word-aligned and holds whole stereo frames
+    uint32_t* frames = reinterpret_cast<uint32_t*>(pcm);
+    size_t count = bytes / 4;
+    
+    // Ramp part: the gain moves every frame
+    size_t ramped = count < remaining_frames ? count : remaining_frames;
+    for (size_t i = 0; i < ramped; i++) {
+        current += step;
+        scaleFramesSaturating(frames + i, 1, effectiveGain(current >> 16));
+    }
+    remaining_frames -= ramped;
+    if (remaining_frames == 0) {
+        current = target; // Drop the rounding left over by the integer step
+    }
+    
+    // Settled part: unity is a no-op, silence is a memset
+    size_t rest = count - ramped;
+    uint32_t gain = effectiveGain(current >> 16);
+    if (rest > 0 && gain != UNITY) {
+        if (gain == 0) {
+            memset(frames + ramped, 0, rest * 4);
+        } else if (gain < UNITY) {
+            scaleFrames(frames + ramped, rest, gain);
+        } else {
+            scaleFramesSaturating(frames + ramped, rest, gain);
+        }
+    }
+    
+    ramping.store(remaining_frames > 0, std::memory_order_release);
+}
@@ -0,0 +1,61 @@
+#ifndef GAINSTAGE_H
+#define GAINSTAGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-point gain with sample-accurate linear ramps, applied to 16-bit
+// stereo PCM in place. Targets may be posted from any task; the ramp
+// itself only advances inside process(), on the audio callback. No
+// Arduino dependencies.
+class GainStage {
+public:
+    static const uint32_t UNITY = 32768;     // Q15
+    static const uint32_t TRACK_UNITY = 4096; // Q12
+    static const uint32_t MAX_TRACK_GAIN = 8191; // Just under +6 dB: sample * gain stays in 32 bits
+    static const int MIN_DB = -80;            // Quietest table entry
+    static const uint32_t SAMPLE_RATE = 44100;
+    
+private:
+    // Posted target: bit 31 set when new, ramp ms in bits 30..16, gain below
+    std::atomic<uint32_t> request;
+    
+    // Callback-owned ramp state; gain is Q15 << 16 so steps stay exact
+    uint32_t current;
+    int32_t step;
+    uint32_t target;
+    uint32_t remaining_frames;
+    std::atomic<bool> ramping;
+    uint32_t track_gain; // Q12 loudness correction, callback-owned
+    
+public:
+    GainStage();
+    
+    // Q15 gain for an attenuation in whole dB (0 down to MIN_DB)
+    static uint32_t dbToGain(int db);
+    
+    // Q12 track gain from a ReplayGain value in 0.01 dB, lowered so the
+    // track's peak cannot exceed full scale
+    static uint32_t replayGainToTrackGain(int16_t gain_cdb, uint16_t peak_q15);
+    
+    // Any task: ramp from wherever the gain is now to gain_q15
+    void rampTo(uint32_t gain_q15, uint32_t ramp_ms);
+    
+    // Audio callback: switches the loudness correction at a track boundary
+    void setTrackGain(uint32_t gain_q12) { track_gain = gain_q12 > MAX_TRACK_GAIN ? MAX_TRACK_GAIN : gain_q12; }
+    
+    // Audio callback: interleaved L/R int16, one 32-bit word per frame
+    void process(uint8_t* pcm, size_t bytes);
+    
+    bool isRamping() const;
+    uint32_t getGain() const { return current >> 16; }
+    
+private:
+    void startRamp(uint32_t packed);
+    uint32_t effectiveGain(uint32_t volume) const { return (volume * track_gain) >> 12; }
+    static void scaleFrames(uint32_t* frames, size_t count, uint32_t gain);
+    static void scaleFramesSaturating(uint32_t* frames, size_t count, uint32_t gain);
+};
+
+#endif
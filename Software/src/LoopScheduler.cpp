@@ -0,0 +1,171 @@
+#include "LoopScheduler.h"
+
+// Deadlines are free-running milliseconds; compare them across the wrap
+static bool reached(uint32_t now_ms, uint32_t deadline_ms) {
+    return (int32_t)(now_ms - deadline_ms) >= 0;
+}
+
+static bool before(uint32_t a_ms, uint32_t b_ms) {
+    return (int32_t)(a_ms - b_ms) < 0;
+}
+
+LoopScheduler::LoopScheduler(LoopClock now_ms, LoopClock now_us) :
+    task_count(0),
+    wheel_tick(0),
+    millis_clock(now_ms),
+    micros_clock(now_us) {
+    for (int i = 0; i < MAX_TASKS; i++) {
+        woken[i].store(false, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < WHEEL_SLOTS; i++) {
+        slots[i] = -1;
+    }
+}
+
+int LoopScheduler::addTask(const char* name, LoopStep step, uint32_t period_ms) {
+    if (task_count >= MAX_TASKS || !step) return -1;
+    
+    int id = task_count;
+    Task& task = tasks[id];
+    task.name = name;
+    task.step = step;
+    task.period_ms = period_ms;
+    task.deadline_ms = millis_clock();
+    task.next = -1;
+    task.queued = false;
+    task.stats.name = name;
+    task.stats.period_ms = period_ms;
+    task.stats.runs = 0;
+    task.stats.max_slice_us = 0;
+    task.stats.max_late_ms = 0;
+    
+    if (task_count == 0) wheel_tick = task.deadline_ms / TICK_MS;
+    task_count++;
+    insert(id);
+    return id;
+}
+
+void LoopScheduler::setPeriod(int id, uint32_t period_ms) {
+    if (id < 0 || id >= task_count) return;
+    
+    Task& task = tasks[id];
+    task.period_ms = period_ms;
+    task.stats.period_ms = period_ms;
+    if (task.queued) {
+        unlink(id);
+        task.deadline_ms = millis_clock() + period_ms;
+        insert(id);
+    }
+}
+
+void LoopScheduler::wake(int id) {
+    if (id < 0 || id >= MAX_TASKS) return;
+    woken[id].store(true, std::memory_order_release);
+}
+
+uint32_t LoopScheduler::runDue() {
+    uint32_t now = millis_clock();
+    int due[MAX_TASKS];
+    int due_count = 0;
+    
+    // Woken steps are due now, whatever their deadline
+    for (int id = 0; id < task_count; id++) {
+        if (woken[id].exchange(false, std::memory_order_acquire) && tasks[id].queued) {
+            unlink(id);
+            tasks[id].deadline_ms = now;
+            due[due_count++] = id;
+        }
+    }
+    
+    // Every slot from the last serviced tick up to now; after a long stall
+    // one full turn covers them all. Lists are in deadline order, so each
+    // slot is only read up to its first step that is not due yet.
+    uint32_t now_tick = now / TICK_MS;
+    uint32_t tick = now_tick - wheel_tick >= (uint32_t)WHEEL_SLOTS ? now_tick - WHEEL_SLOTS + 1 : wheel_tick;
+    for (; before(tick, now_tick + 1); tick++) {
+        int& head = slots[tick % WHEEL_SLOTS];
+        while (head >= 0 && reached(now, tasks[head].deadline_ms)) {
+            int id = head;
+            head = tasks[id].next;
+            tasks[id].next = -1;
+            tasks[id].queued = false;
+            due[due_count++] = id;
+        }
+    }
+    wheel_tick = now_tick;
+    
+    // Earliest deadline first across slots
+    for (int i = 1; i < due_count; i++) {
+        int id = due[i];
+        int j = i;
+        while (j > 0 && before(tasks[id].deadline_ms, tasks[due[j - 1]].deadline_ms)) {
+            due[j] = due[j - 1];
+            j--;
+        }
+        due[j] = id;
+    }
+    
+    for (int i = 0; i < due_count; i++) {
+        run(due[i], now);
+    }
+    
+    // Sleep until the earliest deadline, or not at all if a wake came in
+    uint32_t sleep_ms = MAX_SLEEP_MS;
+    now = millis_clock();
+    for (int id = 0; id < task_count; id++) {
+        if (woken[id].load(std::memory_order_acquire)) return 0;
+        if (!tasks[id].queued) continue;
+        if (reached(now, tasks[id].deadline_ms)) return 0;
+        uint32_t wait = tasks[id].deadline_ms - now;
+        if (wait < sleep_ms) sleep_ms = wait;
+    }
+    return sleep_ms;
+}
+
+bool LoopScheduler::getStats(int id, LoopTaskStats& stats) const {
+    if (id < 0 || id >= task_count) return false;
+    stats = tasks[id].stats;
+    return true;
+}
+
+void LoopScheduler::insert(int id) {
+    // Into its slot's list, behind steps with an earlier or equal deadline
+    Task& task = tasks[id];
+    int* link = &slots[slotFor(task.deadline_ms)];
+    while (*link >= 0 && !before(task.deadline_ms, tasks[*link].deadline_ms)) {
+        link = &tasks[*link].next;
+    }
+    task.next = *link;
+    *link = id;
+    task.queued = true;
+}
+
+void LoopScheduler::unlink(int id) {
+    Task& task = tasks[id];
+    int* link = &slots[slotFor(task.deadline_ms)];
+    while (*link >= 0 && *link != id) {
+        link = &tasks[*link].next;
+    }
+    if (*link == id) *link = task.next;
+    task.next = -1;
+    task.queued = false;
+}
+
+void LoopScheduler::run(int id, uint32_t now_ms) {
+    Task& task = tasks[id];
+    uint32_t late = now_ms - task.deadline_ms;
+    if (late > task.stats.max_late_ms) task.stats.max_late_ms = late;
+    
+    uint32_t started = micros_clock();
+    bool more = task.step();
+    uint32_t slice = micros_clock() - started;
+    
+    task.stats.runs++;
+    if (slice > task.stats.max_slice_us) task.stats.max_slice_us = slice;
+    
+    // The period counts from the end of this run, so a slow step cannot
+    // pile up runs behind itself
+    uint32_t finished = millis_clock();
+    task.deadline_ms = more ? finished : finished + task.period_ms;
+    insert(id);
+}
@@ -0,0 +1,82 @@
+#ifndef LOOPSCHEDULER_H
+#define LOOPSCHEDULER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// A step returns true if it stopped with work left (a spent budget), so
+// it runs again on the next pass instead of after its period
+typedef std::function<bool()> LoopStep;
+
+typedef uint32_t (*LoopClock)();
+
+struct LoopTaskStats {
+    const char* name;
+    uint32_t period_ms;
+    uint32_t runs;
+    uint32_t max_slice_us; // Longest single run
+    uint32_t max_late_ms;  // Furthest a run started past its deadline
+};
+
+// Cooperative scheduler for the Arduino loop. Steps wait on a hashed timer
+// wheel: one slot per tick, each slot a list kept in deadline order, so a
+// pass only looks at the slots whose time has come. wake() may be called
+// from any task or callback to run a step on the next pass, which is how
+// input events cut the wait short. No Arduino dependencies; the clocks are
+// passed in.
+class LoopScheduler {
+public:
+    static const int MAX_TASKS = 8;
+    static const int WHEEL_SLOTS = 32;
+    static const uint32_t TICK_MS = 5;
+    
+private:
+    struct Task {
+        const char* name;
+        LoopStep step;
+        uint32_t period_ms;
+        uint32_t deadline_ms;
+        int next; // Next task in the same slot, -1 at the end
+        bool queued;
+        LoopTaskStats stats;
+    };
+    
+    Task tasks[MAX_TASKS];
+    std::atomic<bool> woken[MAX_TASKS];
+    int task_count;
+    int slots[WHEEL_SLOTS]; // First task of each slot, -1 if empty
+    uint32_t wheel_tick;    // Last tick whose slot was serviced
+    LoopClock millis_clock;
+    LoopClock micros_clock;
+    
+public:
+    static const uint32_t MAX_SLEEP_MS = 1000;
+    
+    LoopScheduler(LoopClock now_ms, LoopClock now_us);
+    
+    // Returns the task id, or -1 when MAX_TASKS are taken. The first run
+    // is due right away.
+    int addTask(const char* name, LoopStep step, uint32_t period_ms);
+    void setPeriod(int id, uint32_t period_ms); // Loop task only
+    
+    // Any task or callback: run this step on the next pass
+    void wake(int id);
+    
+    // Runs every step that is due or woken, in deadline order, and returns
+    // how long the caller may sleep before the next deadline (at most
+    // MAX_SLEEP_MS)
+    uint32_t runDue();
+    
+    int getTaskCount() const { return task_count; }
+    bool getStats(int id, LoopTaskStats& stats) const;
+    
+private:
+    int slotFor(uint32_t deadline_ms) const { return (deadline_ms / TICK_MS) % WHEEL_SLOTS; }
+    void insert(int id);
+    void unlink(int id);
+    void run(int id, uint32_t now_ms);
+};
+
+#endif
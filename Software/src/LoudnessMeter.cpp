@@ -0,0 +1,146 @@
+#include "LoudnessMeter.h"
+#include <cmath>
+
+// Histogram of gated block loudness: 0.1 LU bins from -70 to +5 LUFS
+static const float HISTOGRAM_FLOOR = -70.0f;
+static const float HISTOGRAM_STEP = 0.1f;
+static const size_t HISTOGRAM_BINS = 750;
+
+static const float ABSOLUTE_GATE = -70.0f;
+static const float RELATIVE_GATE = -10.0f;
+
+static float energyToLufs(double energy) {
+    return -0.691f + 10.0f * log10f((float)energy);
+}
+
+static double lufsToEnergy(float lufs) {
+    return pow(10.0, (lufs + 0.691) / 10.0);
+}
+
+LoudnessMeter::LoudnessMeter() :
+    channels(0),
+    subblock_frames(0),
+    subblock_fill(0),
+    subblock_energy(0),
+    subblock_count(0),
+    gated_energy(0),
+    gated_blocks(0),
+    peak(0) {
+}
+
+bool LoudnessMeter::begin(uint32_t sample_rate, uint8_t channel_count) {
+    if (sample_rate < 8000 || channel_count == 0 || channel_count > 2) {
+        return false;
+    }
+    
+    // K-weighting for any rate, via the bilinear transform (as in libebur128)
+    double fs = sample_rate;
+    double f0 = 1681.974450955533;
+    double gain_db = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / fs);
+    double vh = pow(10.0, gain_db / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    shelf.b1 = 2.0 * (k * k - vh) / a0;
+    shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+    shelf.a2 = (1.0 - k / q + k * k) / a0;
+    
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / fs);
+    a0 = 1.0 + k / q + k * k;
+    highpass.b0 = 1.0f;
+    highpass.b1 = -2.0f;
+    highpass.b2 = 1.0f;
+    highpass.a1 = 2.0 * (k * k - 1.0) / a0;
+    highpass.a2 = (1.0 - k / q + k * k) / a0;
+    
+    for (int c = 0; c < 2; c++) {
+        shelf.z1[c] = shelf.z2[c] = 0;
+        highpass.z1[c] = highpass.z2[c] = 0;
+    }
+    
+    channels = channel_count;
+    subblock_frames = sample_rate / 10;
+    subblock_fill = 0;
+    subblock_energy = 0;
+    subblock_count = 0;
+    histogram.assign(HISTOGRAM_BINS, 0);
+    gated_energy = 0;
+    gated_blocks = 0;
+    peak = 0;
+    return true;
+}
+
+float LoudnessMeter::filter(Biquad& biquad, uint8_t channel, float x) {
+    // Transposed direct form II
+    float y = biquad.b0 * x + biquad.z1[channel];
+    biquad.z1[channel] = biquad.b1 * x - biquad.a1 * y + biquad.z2[channel];
+    biquad.z2[channel] = biquad.b2 * x - biquad.a2 * y;
+    return y;
+}
+
+void LoudnessMeter::addSamples(const int16_t* interleaved, size_t frames) {
+    if (!channels) return;
+    
+    for (size_t f = 0; f < frames; f++) {
+        for (uint8_t c = 0; c < channels; c++) {
+            int32_t sample = interleaved[f * channels + c];
+            int32_t magnitude = sample < 0 ? -sample : sample;
+            if (magnitude > peak) peak = magnitude;
+            
+            float y = filter(highpass, c, filter(shelf, c, sample / 32768.0f));
+            subblock_energy += y * y;
+        }
+        
+        if (++subblock_fill == subblock_frames) {
+            finishSubblock();
+        }
+    }
+}
+
+void LoudnessMeter::finishSubblock() {
+    subblocks[subblock_count % 4] = subblock_energy / subblock_frames;
+    subblock_count++;
+    subblock_fill = 0;
+    subblock_energy = 0;
+    
+    // A 400 ms block ends every 100 ms once four sub-blocks are in
+    if (subblock_count < 4) return;
+    
+    double energy = (subblocks[0] + subblocks[1] + subblocks[2] + subblocks[3]) / 4.0;
+    if (energy <= 0) return;
+    float lufs = energyToLufs(energy);
+    if (lufs < ABSOLUTE_GATE) return;
+    
+    size_t bin = (size_t)((lufs - HISTOGRAM_FLOOR) / HISTOGRAM_STEP);
+    if (bin >= HISTOGRAM_BINS) bin = HISTOGRAM_BINS - 1;
+    histogram[bin]++;
+    gated_energy += energy;
+    gated_blocks++;
+}
+
+float LoudnessMeter::integratedLufs() const {
+    if (!gated_blocks) return HISTOGRAM_FLOOR;
+    
+    // Relative gate from the exact mean; the final mean uses bin centres
+    float threshold = energyToLufs(gated_energy / gated_blocks) + RELATIVE_GATE;
+    size_t first_bin = threshold > HISTOGRAM_FLOOR ? (size_t)((threshold - HISTOGRAM_FLOOR) / HISTOGRAM_STEP) : 0;
+    
+    double energy = 0;
+    uint32_t blocks = 0;
+    for (size_t bin = first_bin; bin < HISTOGRAM_BINS; bin++) {
+        if (!histogram[bin]) continue;
+        energy += histogram[bin] * lufsToEnergy(HISTOGRAM_FLOOR + (bin + 0.5f) * HISTOGRAM_STEP);
+        blocks += histogram[bin];
+    }
+    return blocks ? energyToLufs(energy / blocks) : HISTOGRAM_FLOOR;
+}
+
+int16_t LoudnessMeter::trackGainCentiDb() const {
+    float gain = TARGET_LUFS - integratedLufs();
+    return (int16_t)lroundf(gain * 100.0f);
+}
@@ -0,0 +1,54 @@
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Integrated loudness after ITU-R BS.1770: K-weighting, 400 ms blocks
+// with 75% overlap, absolute (-70 LUFS) and relative (-10 LU) gates. Gated
+// blocks go into a 0.1 LU histogram, so memory does not grow with track
+// length. Also tracks the sample peak. No Arduino dependencies.
+class LoudnessMeter {
+public:
+    static const int TARGET_LUFS = -18; // ReplayGain 2.0 reference level
+    
+private:
+    struct Biquad {
+        float b0, b1, b2, a1, a2;
+        float z1[2], z2[2]; // Per channel state
+    };
+    
+    Biquad shelf;    // High-frequency shelf
+    Biquad highpass; // RLB high-pass
+    uint8_t channels;
+    uint32_t subblock_frames;
+    uint32_t subblock_fill;
+    float subblock_energy;
+    float subblocks[4];
+    uint32_t subblock_count;
+    
+    std::vector<uint32_t> histogram;
+    double gated_energy;
+    uint32_t gated_blocks;
+    int32_t peak;
+    
+public:
+    LoudnessMeter();
+    
+    bool begin(uint32_t sample_rate, uint8_t channel_count);
+    void addSamples(const int16_t* interleaved, size_t frames);
+    
+    bool hasResult() const { return gated_blocks > 0; }
+    float integratedLufs() const;
+    uint16_t peakQ15() const { return (uint16_t)peak; }
+    
+    // ReplayGain-style track gain: TARGET_LUFS minus the measured loudness
+    int16_t trackGainCentiDb() const;
+    
+private:
+    void finishSubblock();
+    static float filter(Biquad& biquad, uint8_t channel, float x);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "M3uParser.h"
+#include <cstring>
+
+static bool isSeparator(char c) {
+    return c == '/' || c == '\\';
+}
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+M3uParser::M3uParser(const char* playlist_path, M3uEntryCallback entry_callback) :
+    line_length(0),
+    line_too_long(false),
+    first_line(true),
+    base_length(0),
+    callback(entry_callback),
+    entries(0),
+    skipped(0) {
+    const char* slash = strrchr(playlist_path, '/');
+    size_t length = slash ? slash - playlist_path + 1 : 0;
+    if (length == 0 || length > MAX_PATH) {
+        base[0] = '/';
+        length = 1;
+    } else {
+        memcpy(base, playlist_path, length);
+    }
+    base_length = length;
+    path[0] = '\0';
+}
+
+void M3uParser::feed(const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (c == '\n' || c == '\r') {
+            // CRLF just adds an empty line, which is ignored
+            endLine();
+        } else if (line_length < MAX_LINE) {
+            line[line_length++] = c;
+        } else {
+            line_too_long = true;
+        }
+    }
+}
+
+void M3uParser::finish() {
+    endLine();
+}
+
+void M3uParser::endLine() {
+    const char* text = line;
+    size_t len = line_length;
+    bool too_long = line_too_long;
+    line_length = 0;
+    line_too_long = false;
+    
+    if (first_line && len >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) {
+        text += 3;
+        len -= 3;
+    }
+    if (len > 0 || too_long) first_line = false;
+    
+    while (len > 0 && isBlank(*text)) {
+        text++;
+        len--;
+    }
+    while (len > 0 && isBlank(text[len - 1])) len--;
+    if (len == 0 || text[0] == '#') return;
+    
+    if (too_long || !resolve(text, len)) {
+        skipped++;
+        return;
+    }
+    entries++;
+    callback(path);
+}
+
+bool M3uParser::resolve(const char* text, size_t len) {
+    // Streams and other remote entries cannot be played from the card
+    for (size_t i = 0; i + 2 < len; i++) {
+        if (text[i] == ':' && text[i + 1] == '/' && text[i + 2] == '/') return false;
+    }
+    
+    const char* end = text + len;
+    if (len >= 2 && text[1] == ':' && ((text[0] | 0x20) >= 'a' && (text[0] | 0x20) <= 'z')) {
+        text += 2; // "D:\Music\..." from a PC: the card's own root is meant
+    }
+    
+    // Absolute entries start over from the root
+    size_t out = 1;
+    path[0] = '/';
+    if (text == end || !isSeparator(*text)) {
+        memcpy(path, base, base_length);
+        out = base_length;
+    }
+    
+    while (text < end) {
+        const char* segment = text;
+        while (text < end && !isSeparator(*text)) text++;
+        size_t segment_length = text - segment;
+        bool last = text == end;
+        if (!last) text++;
+        
+        if (segment_length == 0 || (segment_length == 1 && segment[0] == '.')) {
+            if (last) return false; // Names a folder
+            continue;
+        }
+        if (segment_length == 2 && segment[0] == '.' && segment[1] == '.') {
+            if (last) return false;
+            // Back to the previous slash; the root has no parent
+            if (out > 1) {
+                out--;
+                while (out > 1 && path[out - 1] != '/') out--;
+            }
+            continue;
+        }
+        
+        if (out + segment_length + (last ? 0 : 1) > MAX_PATH) return false;
+        memcpy(path + out, segment, segment_length);
+        out += segment_length;
+        if (!last) path[out++] = '/';
+    }
+    
+    if (out == 0 || path[out - 1] == '/') return false;
+    path[out] = '\0';
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef M3UPARSER_H
+#define M3UPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Receives each playlist entry as a full path on the card
+typedef std::function<void(const char* path)> M3uEntryCallback;
+
+// Streaming M3U/M3U8 reader. The file is fed in chunks of any size and
+// each entry is handed out as soon as its line ends, so only one line is
+// ever held, whatever the size of the file. Comments and #EXT directives,
+// a UTF-8 byte order mark and URLs are skipped. Backslashes count as '/',
+// a drive letter is dropped, relative entries are taken from the
+// playlist's own folder, and "." and ".." are resolved. Lines or paths
+// over the limits are skipped whole. No Arduino dependencies.
+class M3uParser {
+public:
+    static const size_t MAX_LINE = 255;
+    static const size_t MAX_PATH = 255;
+    
+private:
+    char line[MAX_LINE + 1];
+    size_t line_length;
+    bool line_too_long;
+    bool first_line;
+    char base[MAX_PATH + 1]; // The playlist's folder, with its trailing slash
+    size_t base_length;
+    char path[MAX_PATH + 1];
+    M3uEntryCallback callback;
+    uint32_t entries;
+    uint32_t skipped;
+    
+public:
+    // playlist_path is the playlist file's full path on the card
+    M3uParser(const char* playlist_path, M3uEntryCallback entry_callback);
+    
+    void feed(const char* data, size_t len);
+    void finish(); // The last line may end without a line break
+    
+    uint32_t getEntries() const { return entries; }
+    uint32_t getSkipped() const { return skipped; } // URLs and over-long lines or paths
+    
+private:
+    void endLine();
+    bool resolve(const char* text, size_t len);
+};
+
+#endif
@@ -0,0 +1,265 @@
+#include "MetadataIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+// Case-insensitive for ASCII; other UTF-8 bytes compare as they are
+static int compareNames(const char* a, const char* b) {
+    while (*a && *b) {
+        int ca = tolower((unsigned char)*a);
+        int cb = tolower((unsigned char)*b);
+        if (ca != cb) return ca - cb;
+        a++;
+        b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+MetadataIndex::MetadataIndex() {
+    clear();
+}
+
+void MetadataIndex::clear() {
+    title_offsets.clear();
+    artist_ids.clear();
+    album_ids.clear();
+    track_numbers.clear();
+    durations_ms.clear();
+    path_hashes.clear();
+    replay_gains.clear();
+    replay_peaks.clear();
+    artist_names.clear();
+    album_names.clear();
+    album_artists.clear();
+    artist_order.clear();
+    album_order.clear();
+    by_artist.clear();
+    artist_start.clear();
+    by_album.clear();
+    album_start.clear();
+    strings.clear();
+    artist_lookup.clear();
+    album_lookup.clear();
+    
+    // Id 0: unknown artist / album
+    strings.push_back('\0');
+    artist_names.push_back(0);
+    album_names.push_back(0);
+    album_artists.push_back(0);
+    artist_lookup.emplace("", 0);
+    album_lookup.emplace(std::string(1, '\x1f'), 0);
+}
+
+uint32_t MetadataIndex::appendString(const std::string& text) {
+    if (text.empty()) return 0; // Shares the leading NUL
+    uint32_t offset = strings.size();
+    strings.insert(strings.end(), text.begin(), text.end());
+    strings.push_back('\0');
+    return offset;
+}
+
+uint16_t MetadataIndex::intern(std::unordered_map<std::string, uint16_t>& lookup, std::vector<uint32_t>& names,
+                               const std::string& key, const std::string& name) {
+    auto found = lookup.find(key);
+    if (found != lookup.end()) return found->second;
+    if (names.size() >= MAX_NAMES) return 0;
+    
+    uint16_t id = names.size();
+    names.push_back(appendString(name));
+    lookup.emplace(key, id);
+    return id;
+}
+
+void MetadataIndex::add(uint32_t path_hash, const TrackMetadata& metadata) {
+    uint16_t artist_id = intern(artist_lookup, artist_names, metadata.artist, metadata.artist);
+    
+    // Albums are told apart by artist, so two "Greatest Hits" stay separate
+    size_t album_count = album_names.size();
+    uint16_t album_id = 0;
+    if (!metadata.album.empty()) {
+        album_id = intern(album_lookup, album_names, metadata.album + '\x1f' + metadata.artist, metadata.album);
+        if (album_names.size() > album_count) {
+            album_artists.push_back(artist_id);
+        }
+    }
+    
+    title_offsets.push_back(appendString(metadata.title));
+    artist_ids.push_back(artist_id);
+    album_ids.push_back(album_id);
+    track_numbers.push_back(metadata.track_number);
+    durations_ms.push_back(metadata.duration_ms);
+    path_hashes.push_back(path_hash);
+    replay_gains.push_back(metadata.replay_gain);
+    replay_peaks.push_back(metadata.replay_peak);
+}
+
+void MetadataIndex::addFrom(const MetadataIndex& other, size_t index) {
+    TrackMetadata metadata;
+    metadata.title = other.title(index);
+    metadata.artist = other.artist(index);
+    metadata.album = other.album(index);
+    metadata.track_number = other.trackNumber(index);
+    metadata.duration_ms = other.durationMs(index);
+    metadata.replay_gain = other.replayGain(index);
+    metadata.replay_peak = other.replayPeak(index);
+    add(other.pathHash(index), metadata);
+}
+
+void MetadataIndex::setReplayGain(size_t index, int16_t gain, uint16_t peak) {
+    replay_gains[index] = gain;
+    replay_peaks[index] = peak;
+}
+
+void MetadataIndex::buildIndices() {
+    artist_lookup.clear();
+    album_lookup.clear();
+    
+    artist_order.resize(artist_names.size());
+    for (size_t i = 0; i < artist_order.size(); i++) artist_order[i] = i;
+    std::sort(artist_order.begin(), artist_order.end(), [this](uint16_t a, uint16_t b) {
+        return compareNames(artistName(a), artistName(b)) < 0;
+    });
+    
+    album_order.resize(album_names.size());
+    for (size_t i = 0; i < album_order.size(); i++) album_order[i] = i;
+    std::sort(album_order.begin(), album_order.end(), [this](uint16_t a, uint16_t b) {
+        int order = compareNames(albumName(a), albumName(b));
+        return order != 0 ? order < 0 : compareNames(artistName(album_artists[a]), artistName(album_artists[b])) < 0;
+    });
+    
+    // Rank of each album by name, so per-artist listings group albums in order
+    std::vector<uint16_t> album_rank(album_names.size());
+    for (size_t r = 0; r < album_order.size(); r++) album_rank[album_order[r]] = r;
+    
+    size_t count = size();
+    by_artist.resize(count);
+    by_album.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        by_artist[i] = i;
+        by_album[i] = i;
+    }
+    
+    std::sort(by_artist.begin(), by_artist.end(), [&](uint32_t a, uint32_t b) {
+        if (artist_ids[a] != artist_ids[b]) return artist_ids[a] < artist_ids[b];
+        if (album_ids[a] != album_ids[b]) return album_rank[album_ids[a]] < album_rank[album_ids[b]];
+        if (track_numbers[a] != track_numbers[b]) return track_numbers[a] < track_numbers[b];
+        return a < b;
+    });
+    std::sort(by_album.begin(), by_album.end(), [&](uint32_t a, uint32_t b) {
+        if (album_ids[a] != album_ids[b]) return album_ids[a] < album_ids[b];
+        if (track_numbers[a] != track_numbers[b]) return track_numbers[a] < track_numbers[b];
+        return a < b;
+    });
+    
+    // Both lists are grouped by id, so each group is a contiguous range
+    artist_start.assign(artist_names.size() + 1, 0);
+    album_start.assign(album_names.size() + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+        artist_start[artist_ids[i] + 1]++;
+        album_start[album_ids[i] + 1]++;
+    }
+    for (size_t a = 0; a < artist_names.size(); a++) artist_start[a + 1] += artist_start[a];
+    for (size_t a = 0; a < album_names.size(); a++) album_start[a + 1] += album_start[a];
+}
+
+const uint32_t* MetadataIndex::tracksByArtist(uint16_t artist_id, size_t& count) const {
+    if (artist_id + 1u >= artist_start.size()) {
+        count = 0;
+        return nullptr;
+    }
+    count = artist_start[artist_id + 1] - artist_start[artist_id];
+    return by_artist.data() + artist_start[artist_id];
+}
+
+const uint32_t* MetadataIndex::tracksByAlbum(uint16_t album_id, size_t& count) const {
+    if (album_id + 1u >= album_start.size()) {
+        count = 0;
+        return nullptr;
+    }
+    count = album_start[album_id + 1] - album_start[album_id];
+    return by_album.data() + album_start[album_id];
+}
+
+size_t MetadataIndex::memoryUsage() const {
+    size_t total = strings.capacity();
+    total += (title_offsets.capacity() + durations_ms.capacity() + path_hashes.capacity() +
+              by_artist.capacity() + by_album.capacity() + artist_names.capacity() +
+              album_names.capacity() + artist_start.capacity() + album_start.capacity()) * sizeof(uint32_t);
+    total += (artist_ids.capacity() + album_ids.capacity() + track_numbers.capacity() +
+              replay_gains.capacity() + replay_peaks.capacity() + album_artists.capacity() + artist_order.capacity() + album_order.capacity()) * sizeof(uint16_t);
+    return total;
+}
+
+bool MetadataIndex::prepare(size_t track_count, size_t artist_count, size_t album_count, size_t string_bytes) {
+    if (artist_count == 0 || album_count == 0 || artist_count > MAX_NAMES || album_count > MAX_NAMES) {
+        return false;
+    }
+    
+    clear();
+    artist_lookup.clear();
+    album_lookup.clear();
+    
+    title_offsets.resize(track_count);
+    artist_ids.resize(track_count);
+    album_ids.resize(track_count);
+    track_numbers.resize(track_count);
+    durations_ms.resize(track_count);
+    path_hashes.resize(track_count);
+    replay_gains.resize(track_count);
+    replay_peaks.resize(track_count);
+    artist_names.resize(artist_count);
+    album_names.resize(album_count);
+    album_artists.resize(album_count);
+    artist_order.resize(artist_count);
+    album_order.resize(album_count);
+    by_artist.resize(track_count);
+    artist_start.resize(artist_count + 1);
+    by_album.resize(track_count);
+    album_start.resize(album_count + 1);
+    strings.resize(string_bytes);
+    return true;
+}
+
+template <typename T>
+static MetadataIndex::Section sectionOf(std::vector<T>& column) {
+    MetadataIndex::Section section = { column.data(), column.size() * sizeof(T) };
+    return section;
+}
+
+std::vector<MetadataIndex::Section> MetadataIndex::sections() {
+    return {
+        sectionOf(title_offsets), sectionOf(artist_ids), sectionOf(album_ids),
+        sectionOf(track_numbers), sectionOf(durations_ms), sectionOf(path_hashes),
+        sectionOf(replay_gains), sectionOf(replay_peaks),
+        sectionOf(artist_names), sectionOf(album_names), sectionOf(album_artists),
+        sectionOf(artist_order), sectionOf(album_order),
+        sectionOf(by_artist), sectionOf(artist_start),
+        sectionOf(by_album), sectionOf(album_start),
+        sectionOf(strings)
+    };
+}
+
+bool MetadataIndex::validate() const {
+    if (strings.empty() || strings.back() != '\0') return false;
+    
+    size_t count = size();
+    for (size_t i = 0; i < count; i++) {
+        if (title_offsets[i] >= strings.size() || artist_ids[i] >= artist_names.size() ||
+            album_ids[i] >= album_names.size() || by_artist[i] >= count || by_album[i] >= count) {
+            return false;
+        }
+    }
+    for (size_t a = 0; a < artist_names.size(); a++) {
+        if (artist_names[a] >= strings.size() || artist_order[a] >= artist_names.size() ||
+            artist_start[a + 1] < artist_start[a]) {
+            return false;
+        }
+    }
+    for (size_t a = 0; a < album_names.size(); a++) {
+        if (album_names[a] >= strings.size() || album_artists[a] >= artist_names.size() ||
+            album_order[a] >= album_names.size() || album_start[a + 1] < album_start[a]) {
+            return false;
+        }
+    }
+    return artist_start.back() == count && album_start.back() == count;
+}
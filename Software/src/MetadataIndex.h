@@ -0,0 +1,96 @@
+#ifndef METADATAINDEX_H
+#define METADATAINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Mp3HeaderParser.h"
+
+// Columnar per-track metadata, in playlist order, plus artist and album
+// tables with presorted track lists so browsing never touches the card.
+// Artist/album id 0 is the empty "unknown" entry. No Arduino dependencies.
+class MetadataIndex {
+private:
+    // Per track
+    std::vector<uint32_t> title_offsets;
+    std::vector<uint16_t> artist_ids;
+    std::vector<uint16_t> album_ids;
+    std::vector<uint16_t> track_numbers;
+    std::vector<uint32_t> durations_ms;
+    std::vector<uint32_t> path_hashes; // Lets a rebuild reuse unchanged tracks
+    std::vector<int16_t> replay_gains;   // 0.01 dB, REPLAY_GAIN_UNKNOWN until tagged or measured
+    std::vector<uint16_t> replay_peaks;
+    
+    // Per artist / album
+    std::vector<uint32_t> artist_names;
+    std::vector<uint32_t> album_names;
+    std::vector<uint16_t> album_artists;
+    
+    // Sorted views, built once by buildIndices()
+    std::vector<uint16_t> artist_order;   // Artist ids by name
+    std::vector<uint16_t> album_order;    // Album ids by name
+    std::vector<uint32_t> by_artist;      // Tracks by artist, album, track number
+    std::vector<uint32_t> artist_start;   // Per artist id, range into by_artist
+    std::vector<uint32_t> by_album;       // Tracks by album, track number
+    std::vector<uint32_t> album_start;    // Per album id, range into by_album
+    
+    std::vector<char> strings;
+    
+    // Only while building
+    std::unordered_map<std::string, uint16_t> artist_lookup;
+    std::unordered_map<std::string, uint16_t> album_lookup;
+    
+public:
+    static const size_t MAX_NAMES = 0xFFFF;
+    
+    MetadataIndex();
+    
+    void clear();
+    void add(uint32_t path_hash, const TrackMetadata& metadata);
+    void addFrom(const MetadataIndex& other, size_t index);
+    void buildIndices(); // Sorts the views and drops build-time lookups
+    
+    size_t size() const { return title_offsets.size(); }
+    const char* title(size_t index) const { return &strings[title_offsets[index]]; }
+    uint16_t artistId(size_t index) const { return artist_ids[index]; }
+    uint16_t albumId(size_t index) const { return album_ids[index]; }
+    const char* artist(size_t index) const { return artistName(artist_ids[index]); }
+    const char* album(size_t index) const { return albumName(album_ids[index]); }
+    uint16_t trackNumber(size_t index) const { return track_numbers[index]; }
+    uint32_t durationMs(size_t index) const { return durations_ms[index]; }
+    uint32_t pathHash(size_t index) const { return path_hashes[index]; }
+    int16_t replayGain(size_t index) const { return replay_gains[index]; }
+    uint16_t replayPeak(size_t index) const { return replay_peaks[index]; }
+    void setReplayGain(size_t index, int16_t gain, uint16_t peak);
+    
+    size_t artistCount() const { return artist_names.size(); }
+    size_t albumCount() const { return album_names.size(); }
+    const char* artistName(uint16_t artist_id) const { return &strings[artist_names[artist_id]]; }
+    const char* albumName(uint16_t album_id) const { return &strings[album_names[album_id]]; }
+    uint16_t albumArtist(uint16_t album_id) const { return album_artists[album_id]; }
+    uint16_t artistByRank(size_t rank) const { return artist_order[rank]; }
+    uint16_t albumByRank(size_t rank) const { return album_order[rank]; }
+    const uint32_t* tracksByArtist(uint16_t artist_id, size_t& count) const;
+    const uint32_t* tracksByAlbum(uint16_t album_id, size_t& count) const;
+    
+    size_t memoryUsage() const;
+    
+    // Persistence: every vector in a fixed order, sized from four counts
+    struct Section {
+        void* data;
+        size_t bytes;
+    };
+    bool prepare(size_t track_count, size_t artist_count, size_t album_count, size_t string_bytes);
+    std::vector<Section> sections();
+    size_t stringBytes() const { return strings.size(); }
+    bool validate() const;
+    
+private:
+    uint32_t appendString(const std::string& text);
+    uint16_t intern(std::unordered_map<std::string, uint16_t>& lookup, std::vector<uint32_t>& names,
+                    const std::string& key, const std::string& name);
+};
+
+#endif
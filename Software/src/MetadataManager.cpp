@@ -0,0 +1,574 @@
+#include "MetadataManager.h"
+#include "PlaylistManager.h"
+#include "PlaylistIndex.h"
+#include "FileBlockReader.h"
+#include "LoudnessMeter.h"
+#include "AudioCodec.h"
+#include "AudioTools.h"
+#include "AudioTools/AudioCodecs/CodecMP3Helix.h"
+#include <unordered_map>
+
+static const char* METADATA_FILE_NAME = ".metadata.idx";
+static const uint32_t METADATA_INDEX_MAGIC = 0x4154444D; // "MDTA"
+static const uint16_t METADATA_INDEX_VERSION = 2;
+
+// Loudness pass: compressed bytes per decoder write, and how many measured
+// tracks to collect before the index is saved again
+static const size_t LOUDNESS_READ_BYTES = 1024;
+static const uint32_t LOUDNESS_SAVE_INTERVAL = 16;
+
+struct MetadataIndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t playlist_hash; // Of the track table the index was built for
+    uint32_t track_count;
+    uint32_t artist_count;
+    uint32_t album_count;
+    uint32_t string_bytes;
+    uint32_t checksum;      // FNV-1a over all sections
+};
+
+static_assert(sizeof(MetadataIndexHeader) == 32, "MetadataIndexHeader must stay packed");
+
+// Receives the decoder's PCM and feeds whole frames to the meter
+class LoudnessOutput : public Print {
+private:
+    LoudnessMeter& meter;
+    size_t frame_bytes;
+    uint8_t carry[4];
+    size_t carry_bytes;
+    
+public:
+    explicit LoudnessOutput(LoudnessMeter& target) : meter(target), frame_bytes(4), carry_bytes(0) {}
+    
+    void begin(uint8_t channels) {
+        frame_bytes = channels * sizeof(int16_t);
+        carry_bytes = 0;
+    }
+    
+    size_t write(uint8_t value) override {
+        return write(&value, 1);
+    }
+    
+    size_t write(const uint8_t* data, size_t len) override {
+        size_t used = 0;
+        while (carry_bytes > 0 && used < len) {
+            carry[carry_bytes++] = data[used++];
+            if (carry_bytes == frame_bytes) {
+                meter.addSamples(reinterpret_cast<const int16_t*>(carry), 1);
+                carry_bytes = 0;
+            }
+        }
+        
+        size_t frames = (len - used) / frame_bytes;
+        if (frames > 0) {
+            // Helix hands over its own aligned PCM buffer
+            meter.addSamples(reinterpret_cast<const int16_t*>(data + used), frames);
+            used += frames * frame_bytes;
+        }
+        while (used < len) {
+            carry[carry_bytes++] = data[used++];
+        }
+        return len;
+    }
+};
+
+static void formatDuration(uint32_t duration_ms, char* buffer, size_t len) {
+    uint32_t seconds = duration_ms / 1000;
+    snprintf(buffer, len, "%u:%02u", (unsigned)(seconds / 60), (unsigned)(seconds % 60));
+}
+
+MetadataManager::MetadataManager(const String& root) :
+    playlist_manager(nullptr),
+    index_path(root),
+    build_task(nullptr),
+    build_running(false),
+    build_done(0),
+    build_total(0),
+    loudness_pending(0),
+    task_core(1),
+    task_priority(1) {
+    if (!index_path.endsWith("/")) {
+        index_path += "/";
+    }
+    index_path += METADATA_FILE_NAME;
+}
+
+void MetadataManager::setPlaylistManager(PlaylistManager* playlist) {
+    playlist_manager = playlist;
+}
+
+bool MetadataManager::begin(int core, int priority) {
+    if (!playlist_manager) {
+        Serial.println("Error: PlaylistManager not set");
+        return false;
+    }
+    
+    task_core = core;
+    task_priority = priority;
+    
+    std::shared_ptr<const TrackTable> tracks = playlist_manager->getTracks();
+    if (loadIndex(*tracks)) {
+        Serial.printf("Loaded metadata for %d tracks\n", index->size());
+        
+        // Pick up a loudness pass that was cut short by a power cycle
+        for (size_t i = 0; i < index->size(); i++) {
+            if (index->replayGain(i) == REPLAY_GAIN_UNKNOWN) {
+                return startBuild();
+            }
+        }
+        return true;
+    }
+    return startBuild();
+}
+
+std::shared_ptr<const MetadataIndex> MetadataManager::getIndex() {
+    std::shared_ptr<const TrackTable> tracks = playlist_manager ? playlist_manager->getTracks() : nullptr;
+    std::shared_ptr<const MetadataIndex> current = std::atomic_load(&index);
+    
+    if (!current || std::atomic_load(&indexed_tracks) != tracks) {
+        startBuild(); // Built lazily for the playlist as it is now
+        return nullptr;
+    }
+    return current;
+}
+
+bool MetadataManager::startBuild() {
+    if (!playlist_manager || build_running.exchange(true)) {
+        return false;
+    }
+    
+    if (xTaskCreatePinnedToCore(buildTaskEntry, "metadata", 12288, this,
+                                task_priority, &build_task, task_core) != pdPASS) {
+        build_task = nullptr;
+        build_running = false;
+        return false;
+    }
+    return true;
+}
+
+void MetadataManager::buildTaskEntry(void* param) {
+    MetadataManager* self = static_cast<MetadataManager*>(param);
+    self->runBuild();
+    self->build_task = nullptr;
+    self->build_running = false;
+    vTaskDelete(nullptr);
+}
+
+void MetadataManager::runBuild() {
+    std::shared_ptr<const TrackTable> tracks = playlist_manager->getTracks();
+    if (!std::atomic_load(&index) || std::atomic_load(&indexed_tracks) != tracks) {
+        rebuildIndex(tracks);
+    }
+    measureLoudness(tracks);
+}
+
+void MetadataManager::rebuildIndex(const std::shared_ptr<const TrackTable>& tracks) {
+    std::shared_ptr<const MetadataIndex> previous = std::atomic_load(&index);
+    
+    // Tracks whose path is unchanged keep their metadata without a re-read
+    std::unordered_map<uint32_t, uint32_t> reusable;
+    if (previous) {
+        for (size_t i = 0; i < previous->size(); i++) {
+            reusable.emplace(previous->pathHash(i), i);
+        }
+    }
+    
+    std::shared_ptr<MetadataIndex> metadata = std::make_shared<MetadataIndex>();
+    build_total = tracks->size();
+    build_done = 0;
+    uint32_t parsed = 0;
+    
+    for (size_t i = 0; i < tracks->size(); i++) {
+        uint32_t hash = pathHash(*tracks, i);
+        auto found = reusable.find(hash);
+        
+        if (found != reusable.end()) {
+            metadata->addFrom(*previous, found->second);
+        } else {
+            TrackMetadata track;
+            Mp3StreamInfo info;
+            // Tags and duration come from MP3 headers only; other formats
+            // are listed under their file name
+            String path = String(tracks->directory(i)) + tracks->fileName(i);
+            File file;
+            if (codecForExtension(tracks->fileName(i)) == AudioCodec::MP3) {
+                file = SD.open(path);
+            }
+            if (file) {
+                FileBlockReader reader(file);
+                Mp3HeaderParser parser(reader);
+                parser.parse(track, info);
+                file.close();
+            }
+            metadata->add(hash, track);
+            parsed++;
+            
+            // Header reads are short; yield so playback I/O goes first
+            vTaskDelay(1);
+        }
+        build_done = i + 1;
+    }
+    
+    metadata->buildIndices();
+    
+    if (!saveIndex(*metadata, *tracks)) {
+        Serial.println("Failed to write metadata index");
+    }
+    
+    publish(metadata, tracks);
+    Serial.printf("Metadata index ready: %u tracks (%u parsed), %u artists, %u albums\n",
+                  (unsigned)metadata->size(), (unsigned)parsed,
+                  (unsigned)metadata->artistCount() - 1, (unsigned)metadata->albumCount() - 1);
+}
+
+void MetadataManager::publish(const std::shared_ptr<MetadataIndex>& metadata, const std::shared_ptr<const TrackTable>& tracks) {
+    // Handed over, not copied: the builder must not touch it afterwards.
+    // Readers keep whatever snapshot they hold.
+    std::atomic_store(&indexed_tracks, tracks);
+    std::atomic_store(&index, std::shared_ptr<const MetadataIndex>(metadata));
+}
+
+bool MetadataManager::publishGains(const std::vector<MeasuredGain>& gains, const std::shared_ptr<const TrackTable>& tracks) {
+    // One copy of the published index, only while the batch is applied;
+    // the old one goes as soon as no reader holds it
+    std::shared_ptr<MetadataIndex> updated;
+    {
+        std::shared_ptr<const MetadataIndex> current = std::atomic_load(&index);
+        if (!current || std::atomic_load(&indexed_tracks) != tracks) return false;
+        updated = std::make_shared<MetadataIndex>(*current);
+    }
+    for (const MeasuredGain& measured : gains) {
+        updated->setReplayGain(measured.track, measured.gain, measured.peak);
+    }
+    if (!saveIndex(*updated, *tracks)) {
+        Serial.println("Failed to write metadata index");
+    }
+    publish(updated, tracks);
+    return true;
+}
+
+static bool measureTrack(const String& path, MP3DecoderHelix& decoder, LoudnessMeter& meter,
+                         LoudnessOutput& output, uint32_t& duration_ms) {
+    // The meter is fed by the MP3 decoder; other formats keep unity gain
+    if (codecForExtension(path.c_str()) != AudioCodec::MP3) return false;
+    
+    File file = SD.open(path);
+    if (!file) return false;
+    
+    TrackMetadata track;
+    Mp3StreamInfo info;
+    FileBlockReader reader(file);
+    Mp3HeaderParser parser(reader);
+    if (!parser.parse(track, info) || !meter.begin(info.sample_rate, info.channels) ||
+        !file.seek(info.first_frame)) {
+        file.close();
+        return false;
+    }
+    duration_ms = track.duration_ms;
+    output.begin(info.channels);
+    decoder.begin();
+    
+    uint8_t chunk[LOUDNESS_READ_BYTES];
+    size_t remaining = info.audio_end - info.first_frame;
+    while (remaining > 0) {
+        size_t len = file.read(chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+        if (len == 0) break;
+        decoder.write(chunk, len);
+        remaining -= len;
+        
+        // Lowest priority on the card and the CPU: playback always goes first
+        vTaskDelay(1);
+    }
+    
+    decoder.end();
+    file.close();
+    return meter.hasResult();
+}
+
+void MetadataManager::measureLoudness(const std::shared_ptr<const TrackTable>& tracks) {
+    std::shared_ptr<const MetadataIndex> current = std::atomic_load(&index);
+    if (!current || std::atomic_load(&indexed_tracks) != tracks) return;
+    
+    std::vector<uint32_t> pending;
+    for (size_t i = 0; i < current->size(); i++) {
+        if (current->replayGain(i) == REPLAY_GAIN_UNKNOWN) {
+            pending.push_back(i);
+        }
+    }
+    loudness_pending = pending.size();
+    if (pending.empty()) return;
+    
+    Serial.printf("Measuring loudness of %u untagged tracks\n", (unsigned)pending.size());
+    
+    // Only the results are kept between saves, so the pass never holds
+    // more than the published index and, while saving, one copy of it
+    current.reset();
+    std::vector<MeasuredGain> gains;
+    gains.reserve(LOUDNESS_SAVE_INTERVAL);
+    MP3DecoderHelix* decoder = new MP3DecoderHelix();
+    LoudnessMeter meter;
+    LoudnessOutput output(meter);
+    decoder->setOutput(output);
+    
+    uint32_t started = millis();
+    uint64_t audio_ms = 0;
+    uint32_t measured = 0;
+    
+    for (uint32_t track : pending) {
+        // A rescan changed the playlist: stop, the next build starts over
+        if (playlist_manager->getTracks() != tracks) break;
+        
+        String path = String(tracks->directory(track)) + tracks->fileName(track);
+        uint32_t duration_ms = 0;
+        MeasuredGain result = {track, 0, 0}; // Undecodable: leave it alone, don't retry
+        if (measureTrack(path, *decoder, meter, output, duration_ms)) {
+            result.gain = meter.trackGainCentiDb();
+            result.peak = meter.peakQ15();
+        }
+        gains.push_back(result);
+        audio_ms += duration_ms;
+        measured++;
+        loudness_pending--;
+        
+        if (gains.size() == LOUDNESS_SAVE_INTERVAL) {
+            if (!publishGains(gains, tracks)) break;
+            gains.clear();
+        }
+    }
+    
+    delete decoder;
+    
+    if (!gains.empty()) {
+        publishGains(gains, tracks);
+    }
+    
+    // Throughput, so the time a full-card pass takes can be predicted
+    uint32_t elapsed_ms = millis() - started;
+    Serial.printf("Loudness measured for %u tracks: %u s of audio in %u s (%u.%ux realtime)\n",
+                  (unsigned)measured, (unsigned)(audio_ms / 1000), (unsigned)(elapsed_ms / 1000),
+                  (unsigned)(elapsed_ms ? audio_ms / elapsed_ms : 0),
+                  (unsigned)(elapsed_ms ? audio_ms * 10 / elapsed_ms % 10 : 0));
+}
+
+uint32_t MetadataManager::tableHash(const TrackTable& tracks) {
+    uint32_t hash = fnv1a(tracks.entryData(), tracks.size() * sizeof(TrackEntry));
+    hash = fnv1a(tracks.directoryData(), tracks.directoryCount() * sizeof(uint32_t), hash);
+    return fnv1a(tracks.arenaData(), tracks.arenaSize(), hash);
+}
+
+uint32_t MetadataManager::pathHash(const TrackTable& tracks, size_t index) {
+    const char* dir = tracks.directory(index);
+    uint32_t hash = fnv1a(dir, strlen(dir));
+    return fnv1a(tracks.fileName(index), tracks.fileNameLength(index), hash);
+}
+
+bool MetadataManager::loadIndex(const TrackTable& tracks) {
+    File in = SD.open(index_path);
+    if (!in) return false;
+    
+    MetadataIndexHeader header;
+    if (in.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != METADATA_INDEX_MAGIC ||
+        header.version != METADATA_INDEX_VERSION ||
+        header.header_size != sizeof(header) ||
+        header.track_count != tracks.size() ||
+        header.playlist_hash != tableHash(tracks)) {
+        in.close();
+        return false;
+    }
+    
+    std::shared_ptr<MetadataIndex> metadata = std::make_shared<MetadataIndex>();
+    bool ok = metadata->prepare(header.track_count, header.artist_count, header.album_count, header.string_bytes);
+    uint32_t checksum = FNV1A_OFFSET;
+    if (ok) {
+        for (const MetadataIndex::Section& section : metadata->sections()) {
+            if (in.read((uint8_t*)section.data, section.bytes) != section.bytes) {
+                ok = false;
+                break;
+            }
+            checksum = fnv1a(section.data, section.bytes, checksum);
+        }
+    }
+    in.close();
+    
+    if (!ok || checksum != header.checksum || !metadata->validate()) {
+        return false;
+    }
+    
+    // Keyed to the exact table instance that matched the stored hash
+    std::atomic_store(&indexed_tracks, playlist_manager->getTracks());
+    std::atomic_store(&index, std::shared_ptr<const MetadataIndex>(metadata));
+    return true;
+}
+
+bool MetadataManager::saveIndex(MetadataIndex& metadata, const TrackTable& tracks) {
+    File out = SD.open(index_path, FILE_WRITE);
+    if (!out) return false;
+    
+    MetadataIndexHeader header = {};
+    header.magic = METADATA_INDEX_MAGIC;
+    header.version = METADATA_INDEX_VERSION;
+    header.header_size = sizeof(header);
+    header.playlist_hash = tableHash(tracks);
+    header.track_count = metadata.size();
+    header.artist_count = metadata.artistCount();
+    header.album_count = metadata.albumCount();
+    header.string_bytes = metadata.stringBytes();
+    header.checksum = FNV1A_OFFSET;
+    
+    std::vector<MetadataIndex::Section> sections = metadata.sections();
+    for (const MetadataIndex::Section& section : sections) {
+        header.checksum = fnv1a(section.data, section.bytes, header.checksum);
+    }
+    
+    bool ok = out.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    for (size_t s = 0; s < sections.size() && ok; s++) {
+        ok = out.write((const uint8_t*)sections[s].data, sections[s].bytes) == sections[s].bytes;
+    }
+    out.close();
+    
+    if (!ok) {
+        SD.remove(index_path);
+    }
+    return ok;
+}
+
+void MetadataManager::printUnavailable() {
+    if (isBuilding()) {
+        Serial.printf("Metadata index is being built: %u/%u tracks\n",
+                      (unsigned)build_done, (unsigned)build_total);
+    } else {
+        Serial.println("Metadata index not available");
+    }
+}
+
+void MetadataManager::printTrackLine(const MetadataIndex& metadata, uint32_t track) {
+    char duration[16];
+    formatDuration(metadata.durationMs(track), duration, sizeof(duration));
+    
+    const char* title = metadata.title(track);
+    if (*title) {
+        Serial.printf("  %4u: %2u. %s (%s)\n", (unsigned)track + 1,
+                      (unsigned)metadata.trackNumber(track), title, duration);
+    } else {
+        Serial.printf("  %4u: %s (%s)\n", (unsigned)track + 1,
+                      playlist_manager->getTrackName(track).c_str(), duration);
+    }
+}
+
+void MetadataManager::printArtists() {
+    std::shared_ptr<const MetadataIndex> metadata = getIndex();
+    if (!metadata) {
+        printUnavailable();
+        return;
+    }
+    
+    Serial.println("\n--- Artists ---");
+    for (size_t rank = 0; rank < metadata->artistCount(); rank++) {
+        uint16_t artist = metadata->artistByRank(rank);
+        size_t count;
+        metadata->tracksByArtist(artist, count);
+        const char* name = metadata->artistName(artist);
+        Serial.printf("%4u: %s (%u tracks)\n", (unsigned)rank + 1, *name ? name : "Unknown artist", (unsigned)count);
+    }
+    Serial.println("---------------");
+}
+
+void MetadataManager::printAlbums() {
+    std::shared_ptr<const MetadataIndex> metadata = getIndex();
+    if (!metadata) {
+        printUnavailable();
+        return;
+    }
+    
+    Serial.println("\n--- Albums ---");
+    for (size_t rank = 0; rank < metadata->albumCount(); rank++) {
+        uint16_t album = metadata->albumByRank(rank);
+        size_t count;
+        metadata->tracksByAlbum(album, count);
+        const char* name = metadata->albumName(album);
+        const char* artist = metadata->artistName(metadata->albumArtist(album));
+        Serial.printf("%4u: %s - %s (%u tracks)\n", (unsigned)rank + 1,
+                      *name ? name : "Unknown album", *artist ? artist : "Unknown artist", (unsigned)count);
+    }
+    Serial.println("--------------");
+}
+
+void MetadataManager::printArtistTracks(int artist_rank) {
+    std::shared_ptr<const MetadataIndex> metadata = getIndex();
+    if (!metadata) {
+        printUnavailable();
+        return;
+    }
+    if (artist_rank < 0 || artist_rank >= (int)metadata->artistCount()) {
+        Serial.println("Artist number out of range");
+        return;
+    }
+    
+    uint16_t artist = metadata->artistByRank(artist_rank);
+    size_t count;
+    const uint32_t* tracks = metadata->tracksByArtist(artist, count);
+    
+    Serial.printf("\n--- %s ---\n", *metadata->artistName(artist) ? metadata->artistName(artist) : "Unknown artist");
+    uint16_t album = 0xFFFF;
+    for (size_t i = 0; i < count; i++) {
+        if (metadata->albumId(tracks[i]) != album) {
+            album = metadata->albumId(tracks[i]);
+            Serial.printf(" [%s]\n", *metadata->albumName(album) ? metadata->albumName(album) : "Unknown album");
+        }
+        printTrackLine(*metadata, tracks[i]);
+    }
+}
+
+void MetadataManager::printAlbumTracks(int album_rank) {
+    std::shared_ptr<const MetadataIndex> metadata = getIndex();
+    if (!metadata) {
+        printUnavailable();
+        return;
+    }
+    if (album_rank < 0 || album_rank >= (int)metadata->albumCount()) {
+        Serial.println("Album number out of range");
+        return;
+    }
+    
+    uint16_t album = metadata->albumByRank(album_rank);
+    size_t count;
+    const uint32_t* tracks = metadata->tracksByAlbum(album, count);
+    
+    Serial.printf("\n--- %s ---\n", *metadata->albumName(album) ? metadata->albumName(album) : "Unknown album");
+    for (size_t i = 0; i < count; i++) {
+        printTrackLine(*metadata, tracks[i]);
+    }
+}
+
+void MetadataManager::printTrackInfo(int track_index) {
+    std::shared_ptr<const MetadataIndex> metadata = getIndex();
+    if (!metadata) {
+        printUnavailable();
+        return;
+    }
+    if (track_index < 0 || track_index >= (int)metadata->size()) {
+        Serial.println("No track selected");
+        return;
+    }
+    
+    char duration[16];
+    formatDuration(metadata->durationMs(track_index), duration, sizeof(duration));
+    Serial.printf("Title:    %s\n", *metadata->title(track_index) ? metadata->title(track_index)
+                                                                 : playlist_manager->getTrackName(track_index).c_str());
+    Serial.printf("Artist:   %s\n", metadata->artist(track_index));
+    Serial.printf("Album:    %s\n", metadata->album(track_index));
+    Serial.printf("Track:    %u\n", (unsigned)metadata->trackNumber(track_index));
+    Serial.printf("Duration: %s\n", duration);
+    
+    int16_t gain = metadata->replayGain(track_index);
+    if (gain == REPLAY_GAIN_UNKNOWN) {
+        Serial.printf("Gain:     not measured yet (%u tracks pending)\n", (unsigned)loudness_pending);
+    } else {
+        int magnitude = gain < 0 ? -gain : gain;
+        Serial.printf("Gain:     %c%d.%02d dB, peak %u%%\n", gain < 0 ? '-' : '+', magnitude / 100, magnitude % 100,
+                      (unsigned)(metadata->replayPeak(track_index) * 100u / 32768u));
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef METADATAMANAGER_H
+#define METADATAMANAGER_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include <atomic>
+#include <memory>
+#include "MetadataIndex.h"
+#include "TrackTable.h"
+
+class PlaylistManager;
+
+// A loudness result not yet folded into the published index
+struct MeasuredGain {
+    uint32_t track;
+    int16_t gain;  // 0.01 dB
+    uint16_t peak; // Q15
+};
+
+// Builds the metadata index in a background task, persists it next to the
+// playlist index and serves browse lookups. The index is tied to one
+// playlist table; after a rescan it is rebuilt lazily, reusing every track
+// whose path is unchanged. Tracks without ReplayGain tags are then decoded
+// once in the same task to measure their loudness.
+class MetadataManager {
+private:
+    PlaylistManager* playlist_manager;
+    String index_path;
+    
+    std::shared_ptr<const MetadataIndex> index;
+    std::shared_ptr<const TrackTable> indexed_tracks; // Table the index belongs to
+    
+    TaskHandle_t build_task;
+    std::atomic<bool> build_running;
+    std::atomic<uint32_t> build_done;
+    std::atomic<uint32_t> build_total;
+    std::atomic<uint32_t> loudness_pending; // Tracks still to be measured
+    int task_core;
+    int task_priority;
+    
+public:
+    MetadataManager(const String& root = "/");
+    
+    void setPlaylistManager(PlaylistManager* playlist);
+    
+    // Loads the on-card metadata index, or starts building it in the background
+    bool begin(int core, int priority);
+    
+    // Current index, or nullptr while it is missing or stale; a stale index
+    // kicks off a rebuild
+    std::shared_ptr<const MetadataIndex> getIndex();
+    bool isBuilding() const { return build_running; }
+    uint32_t getBuildProgress() const { return build_done; }
+    uint32_t getBuildTotal() const { return build_total; }
+    uint32_t getLoudnessPending() const { return loudness_pending; }
+    
+    // Serial browsing
+    void printArtists();
+    void printAlbums();
+    void printArtistTracks(int artist_rank);
+    void printAlbumTracks(int album_rank);
+    void printTrackInfo(int track_index);
+    
+private:
+    bool startBuild();
+    static void buildTaskEntry(void* param);
+    void runBuild();
+    void rebuildIndex(const std::shared_ptr<const TrackTable>& tracks);
+    void measureLoudness(const std::shared_ptr<const TrackTable>& tracks);
+    void publish(const std::shared_ptr<MetadataIndex>& metadata, const std::shared_ptr<const TrackTable>& tracks);
+    bool publishGains(const std::vector<MeasuredGain>& gains, const std::shared_ptr<const TrackTable>& tracks);
+    bool loadIndex(const TrackTable& tracks);
+    bool saveIndex(MetadataIndex& metadata, const TrackTable& tracks);
+    static uint32_t tableHash(const TrackTable& tracks);
+    static uint32_t pathHash(const TrackTable& tracks, size_t index);
+    void printUnavailable();
+    void printTrackLine(const MetadataIndex& metadata, uint32_t track);
+};
+
+#endif
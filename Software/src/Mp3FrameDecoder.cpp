@@ -0,0 +1,71 @@
+#include "Mp3FrameDecoder.h"
+
+Mp3FrameDecoder::Mp3FrameDecoder() :
+    FrameDecoder(MAX_FRAME_BYTES, INPUT_BYTES),
+    helix(nullptr) {
+}
+
+Mp3FrameDecoder::~Mp3FrameDecoder() {
+    end();
+}
+
+bool Mp3FrameDecoder::startCodec() {
+    helix = MP3InitDecoder();
+    return helix != nullptr;
+}
+
+void Mp3FrameDecoder::stopCodec() {
+    if (helix) {
+        MP3FreeDecoder(helix);
+        helix = nullptr;
+    }
+}
+
+size_t Mp3FrameDecoder::decodeFrame(int16_t* output) {
+    while (true) {
+        if (bytes_left < 2 && !fillInput()) {
+            bytes_left = 0;
+            return 0;
+        }
+        
+        int offset = MP3FindSyncWord(read_ptr, bytes_left);
+        if (offset < 0) {
+            // The last byte may be the first half of a sync word
+            read_ptr += bytes_left - 1;
+            bytes_left = 1;
+            if (!fillInput()) {
+                bytes_left = 0;
+                return 0;
+            }
+            continue;
+        }
+        read_ptr += offset;
+        bytes_left -= offset;
+        
+        // A whole frame is buffered unless the file ends first
+        if (bytes_left < MAINBUF_SIZE) {
+            fillInput();
+        }
+        
+        uint8_t* frame_start = read_ptr;
+        int result = MP3Decode(helix, &read_ptr, &bytes_left, output, 0);
+        if (result == ERR_MP3_NONE) {
+            MP3FrameInfo info;
+            MP3GetLastFrameInfo(helix, &info);
+            sample_rate = info.samprate;
+            channels = info.nChans;
+            if (info.outputSamps > 0) {
+                return info.outputSamps * sizeof(int16_t);
+            }
+        } else if (result == ERR_MP3_INDATA_UNDERFLOW && !input->available()) {
+            // Truncated last frame
+            bytes_left = 0;
+            return 0;
+        } else if (read_ptr == frame_start) {
+            // False sync or damaged frame: search again past this sync word.
+            // A main data underflow (just after a seek) consumes its frame.
+            read_ptr++;
+            bytes_left--;
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef MP3FRAMEDECODER_H
+#define MP3FRAMEDECODER_H
+
+#include <Arduino.h>
+#include "AudioDecoder.h"
+#include "libhelix-mp3/mp3dec.h"
+
+// Frame-granular MP3 decoding on the Helix C API. The Helix instance is
+// only allocated between begin() and end().
+class Mp3FrameDecoder : public FrameDecoder {
+public:
+    // PCM of the largest frame: 1152 samples, 16-bit stereo
+    static const size_t MAX_FRAME_BYTES = MAX_NGRAN * MAX_NSAMP * MAX_NCHAN * sizeof(int16_t);
+    
+    // Topped up whenever less than a maximum-size frame is buffered
+    static const size_t INPUT_BYTES = MAINBUF_SIZE * 2;
+    
+private:
+    HMP3Decoder helix;
+    
+public:
+    Mp3FrameDecoder();
+    ~Mp3FrameDecoder();
+    
+protected:
+    bool startCodec() override;
+    void stopCodec() override;
+    size_t decodeFrame(int16_t* output) override;
+};
+
+#endif
@@ -0,0 +1,387 @@
+#include "Mp3HeaderParser.h"
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+// Text frames longer than this are not titles; skip them like pictures
+static const size_t MAX_TEXT_FRAME = 512;
+
+// How far past the tag to look for the first frame sync
+static const size_t FRAME_SEARCH_BYTES = 2048;
+
+// VBRI tables longer than this are not worth converting
+static const size_t MAX_VBRI_ENTRIES = 1024;
+
+static const uint16_t BITRATES_V1_L3[16] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 };
+static const uint16_t BITRATES_V2_L3[16] = { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 };
+static const uint32_t SAMPLE_RATES_V1[3] = { 44100, 48000, 32000 };
+
+static uint32_t readBigEndian32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t readSynchsafe32(const uint8_t* p) {
+    return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) |
+           ((uint32_t)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+static void appendUtf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out += (char)code_point;
+    } else if (code_point < 0x800) {
+        out += (char)(0xC0 | (code_point >> 6));
+        out += (char)(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += (char)(0xE0 | (code_point >> 12));
+        out += (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out += (char)(0x80 | (code_point & 0x3F));
+    } else {
+        out += (char)(0xF0 | (code_point >> 18));
+        out += (char)(0x80 | ((code_point >> 12) & 0x3F));
+        out += (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out += (char)(0x80 | (code_point & 0x3F));
+    }
+}
+
+static bool equalsIgnoreCase(const std::string& text, const char* expected) {
+    size_t len = strlen(expected);
+    if (text.size() != len) return false;
+    for (size_t i = 0; i < len; i++) {
+        char c = text[i];
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (c != expected[i]) return false;
+    }
+    return true;
+}
+
+static void trimTrailing(std::string& text) {
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\0')) {
+        text.pop_back();
+    }
+}
+
+Mp3HeaderParser::Mp3HeaderParser(BlockReader& source) :
+    reader(source),
+    file_size(source.totalSize()) {
+}
+
+bool Mp3HeaderParser::readAt(size_t position, uint8_t* buffer, size_t len) {
+    if (position + len > file_size) return false;
+    return reader.seekBlock(position) && reader.readBlock(buffer, len) == len;
+}
+
+std::string Mp3HeaderParser::decodeText(uint8_t encoding, const uint8_t* data, size_t len) {
+    std::string out;
+    
+    if (encoding == 0 || encoding == 3) {
+        // ISO-8859-1 or UTF-8, NUL-terminated or not
+        for (size_t i = 0; i < len && data[i] != 0; i++) {
+            if (encoding == 3 || data[i] < 0x80) {
+                out += (char)data[i];
+            } else {
+                appendUtf8(out, data[i]);
+            }
+        }
+    } else {
+        // UTF-16 with BOM (1) or big-endian without (2)
+        bool big_endian = true;
+        size_t i = 0;
+        if (encoding == 1 && len >= 2) {
+            if (data[0] == 0xFF && data[1] == 0xFE) { big_endian = false; i = 2; }
+            else if (data[0] == 0xFE && data[1] == 0xFF) { i = 2; }
+        }
+        
+        for (; i + 1 < len; i += 2) {
+            uint32_t unit = big_endian ? (data[i] << 8) | data[i + 1] : (data[i + 1] << 8) | data[i];
+            if (unit == 0) break;
+            
+            if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < len) {
+                uint32_t low = big_endian ? (data[i + 2] << 8) | data[i + 3] : (data[i + 3] << 8) | data[i + 2];
+                if (low >= 0xDC00 && low < 0xE000) {
+                    unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                    i += 2;
+                }
+            }
+            appendUtf8(out, unit);
+        }
+    }
+    
+    trimTrailing(out);
+    return out;
+}
+
+uint32_t Mp3HeaderParser::parseId3v2(TrackMetadata& metadata) {
+    uint8_t header[10];
+    if (!readAt(0, header, sizeof(header)) || memcmp(header, "ID3", 3) != 0) {
+        return 0;
+    }
+    
+    uint8_t version = header[3];
+    uint8_t flags = header[5];
+    uint32_t tag_size = 10 + readSynchsafe32(header + 6) + ((flags & 0x10) ? 10 : 0);
+    if (version < 2 || version > 4) {
+        return tag_size;
+    }
+    
+    size_t position = 10;
+    size_t tag_end = 10 + readSynchsafe32(header + 6);
+    
+    // Skip the extended header (v2.3 size excludes itself, v2.4 includes it)
+    if ((flags & 0x40) && version >= 3) {
+        uint8_t ext[4];
+        if (!readAt(position, ext, sizeof(ext))) return tag_size;
+        position += version == 4 ? readSynchsafe32(ext) : 4 + readBigEndian32(ext);
+    }
+    
+    size_t frame_header_size = version == 2 ? 6 : 10;
+    uint8_t content[MAX_TEXT_FRAME];
+    
+    while (position + frame_header_size <= tag_end) {
+        uint8_t frame[10];
+        if (!readAt(position, frame, frame_header_size) || frame[0] == 0) break;
+        
+        uint32_t size;
+        if (version == 2) {
+            size = ((uint32_t)frame[3] << 16) | ((uint32_t)frame[4] << 8) | frame[5];
+        } else if (version == 4) {
+            size = readSynchsafe32(frame + 4);
+        } else {
+            size = readBigEndian32(frame + 4);
+        }
+        position += frame_header_size;
+        if (size == 0 || position + size > tag_end) break;
+        
+        std::string* target = nullptr;
+        bool is_track = false;
+        bool is_user_text = false;
+        if (version == 2) {
+            if (memcmp(frame, "TT2", 3) == 0) target = &metadata.title;
+            else if (memcmp(frame, "TP1", 3) == 0) target = &metadata.artist;
+            else if (memcmp(frame, "TAL", 3) == 0) target = &metadata.album;
+            else if (memcmp(frame, "TRK", 3) == 0) is_track = true;
+            else if (memcmp(frame, "TXX", 3) == 0) is_user_text = true;
+        } else {
+            if (memcmp(frame, "TIT2", 4) == 0) target = &metadata.title;
+            else if (memcmp(frame, "TPE1", 4) == 0) target = &metadata.artist;
+            else if (memcmp(frame, "TALB", 4) == 0) target = &metadata.album;
+            else if (memcmp(frame, "TRCK", 4) == 0) is_track = true;
+            else if (memcmp(frame, "TXXX", 4) == 0) is_user_text = true;
+        }
+        
+        if (is_user_text && size >= 2 && size <= sizeof(content) && readAt(position, content, size)) {
+            parseUserText(content, size, metadata);
+        } else if ((target || is_track) && size >= 2 && size <= sizeof(content) &&
+            readAt(position, content, size)) {
+            std::string text = decodeText(content[0], content + 1, size - 1);
+            if (target) {
+                *target = text;
+            } else {
+                metadata.track_number = (uint16_t)atoi(text.c_str()); // "3/12" -> 3
+            }
+        }
+        position += size;
+    }
+    
+    return tag_size;
+}
+
+void Mp3HeaderParser::parseUserText(const uint8_t* content, size_t size, TrackMetadata& metadata) {
+    // TXXX: encoding, description, terminator, value. Only ReplayGain is kept.
+    uint8_t encoding = content[0];
+    bool wide = encoding == 1 || encoding == 2;
+    size_t unit = wide ? 2 : 1;
+    const uint8_t* text = content + 1;
+    size_t len = size - 1;
+    
+    size_t split = 0;
+    while (split + unit <= len && !(text[split] == 0 && (!wide || text[split + 1] == 0))) {
+        split += unit;
+    }
+    if (split + unit > len) return;
+    
+    std::string description = decodeText(encoding, text, split);
+    std::string value = decodeText(encoding, text + split + unit, len - split - unit);
+    
+    if (equalsIgnoreCase(description, "REPLAYGAIN_TRACK_GAIN")) {
+        // "-6.54 dB"
+        double gain = strtod(value.c_str(), nullptr) * 100.0;
+        if (gain > -32000.0 && gain < 32000.0) {
+            metadata.replay_gain = (int16_t)(gain < 0 ? gain - 0.5 : gain + 0.5);
+        }
+    } else if (equalsIgnoreCase(description, "REPLAYGAIN_TRACK_PEAK")) {
+        // "0.988547", relative to full scale
+        double peak = strtod(value.c_str(), nullptr) * 32768.0;
+        if (peak > 0) {
+            metadata.replay_peak = peak >= 65535.0 ? 65535 : (uint16_t)(peak + 0.5);
+        }
+    }
+}
+
+bool Mp3HeaderParser::parseId3v1(TrackMetadata& metadata) {
+    uint8_t tag[128];
+    if (file_size < sizeof(tag) || !readAt(file_size - sizeof(tag), tag, sizeof(tag)) ||
+        memcmp(tag, "TAG", 3) != 0) {
+        return false;
+    }
+    
+    // Only fill in what the ID3v2 tag did not provide
+    if (metadata.title.empty()) metadata.title = decodeText(0, tag + 3, 30);
+    if (metadata.artist.empty()) metadata.artist = decodeText(0, tag + 33, 30);
+    if (metadata.album.empty()) metadata.album = decodeText(0, tag + 63, 30);
+    if (metadata.track_number == 0 && tag[125] == 0) metadata.track_number = tag[126];
+    return true;
+}
+
+bool Mp3HeaderParser::parseFrameHeader(const uint8_t* header, Mp3StreamInfo& info, uint32_t& frame_bytes) {
+    if (header[0] != 0xFF || (header[1] & 0xE0) != 0xE0) return false;
+    
+    uint8_t version_bits = (header[1] >> 3) & 0x03; // 0: 2.5, 2: 2, 3: 1
+    uint8_t layer_bits = (header[1] >> 1) & 0x03;   // 1: Layer III
+    uint8_t bitrate_index = header[2] >> 4;
+    uint8_t rate_index = (header[2] >> 2) & 0x03;
+    uint8_t padding = (header[2] >> 1) & 0x01;
+    
+    if (version_bits == 1 || layer_bits != 1 || bitrate_index == 0 ||
+        bitrate_index == 15 || rate_index == 3) {
+        return false;
+    }
+    
+    bool mpeg1 = version_bits == 3;
+    uint32_t sample_rate = SAMPLE_RATES_V1[rate_index];
+    if (version_bits == 2) sample_rate /= 2;
+    if (version_bits == 0) sample_rate /= 4;
+    
+    info.bitrate = (mpeg1 ? BITRATES_V1_L3[bitrate_index] : BITRATES_V2_L3[bitrate_index]) * 1000;
+    info.sample_rate = sample_rate;
+    info.samples_per_frame = mpeg1 ? 1152 : 576;
+    info.channels = (header[3] >> 6) == 3 ? 1 : 2;
+    frame_bytes = info.samples_per_frame / 8 * info.bitrate / sample_rate + padding;
+    return true;
+}
+
+bool Mp3HeaderParser::findFirstFrame(Mp3StreamInfo& info) {
+    uint8_t buffer[FRAME_SEARCH_BYTES];
+    size_t len = info.audio_end > info.audio_start ? info.audio_end - info.audio_start : 0;
+    if (len > sizeof(buffer)) len = sizeof(buffer);
+    if (len < 4 || !readAt(info.audio_start, buffer, len)) return false;
+    
+    for (size_t i = 0; i + 4 <= len; i++) {
+        uint32_t frame_bytes;
+        Mp3StreamInfo candidate = info;
+        if (!parseFrameHeader(buffer + i, candidate, frame_bytes)) continue;
+        
+        // Require a second sync right after this frame to rule out false hits
+        if (i + frame_bytes + 4 <= len) {
+            Mp3StreamInfo next = info;
+            uint32_t next_bytes;
+            if (!parseFrameHeader(buffer + i + frame_bytes, next, next_bytes)) continue;
+        }
+        
+        info = candidate;
+        info.first_frame = info.audio_start + i;
+        return true;
+    }
+    return false;
+}
+
+void Mp3HeaderParser::readVbrHeader(Mp3StreamInfo& info) {
+    uint8_t frame[4 + 32 + 120];
+    if (!readAt(info.first_frame, frame, sizeof(frame))) return;
+    
+    bool mpeg1 = info.samples_per_frame == 1152;
+    size_t side_info = mpeg1 ? (info.channels == 1 ? 17 : 32) : (info.channels == 1 ? 9 : 17);
+    const uint8_t* xing = frame + 4 + side_info;
+    
+    if (memcmp(xing, "Xing", 4) == 0 || memcmp(xing, "Info", 4) == 0) {
+        // Optional fields follow the flags in a fixed order
+        uint32_t flags = readBigEndian32(xing + 4);
+        const uint8_t* field = xing + 8;
+        if (flags & 0x01) {
+            info.frame_count = readBigEndian32(field);
+            field += 4;
+        }
+        if (flags & 0x02) {
+            info.stream_bytes = readBigEndian32(field);
+            field += 4;
+        }
+        if (flags & 0x04) {
+            memcpy(info.toc, field, sizeof(info.toc));
+            info.has_toc = true;
+        }
+        return;
+    }
+    
+    // VBRI always sits 32 bytes after the frame header
+    const uint8_t* vbri = frame + 4 + 32;
+    if (memcmp(vbri, "VBRI", 4) == 0) {
+        info.stream_bytes = readBigEndian32(vbri + 10);
+        info.frame_count = readBigEndian32(vbri + 14);
+        readVbriTable(info, vbri, info.first_frame + 4 + 32 + 26);
+    }
+}
+
+void Mp3HeaderParser::readVbriTable(Mp3StreamInfo& info, const uint8_t* vbri, size_t table_position) {
+    uint16_t entries = (vbri[18] << 8) | vbri[19];
+    uint16_t scale = (vbri[20] << 8) | vbri[21];
+    uint16_t entry_size = (vbri[22] << 8) | vbri[23];
+    uint16_t frames_per_entry = (vbri[24] << 8) | vbri[25];
+    
+    if (entries == 0 || entries > MAX_VBRI_ENTRIES || entry_size == 0 || entry_size > 4 ||
+        frames_per_entry == 0 || info.frame_count == 0 || info.stream_bytes == 0) {
+        return;
+    }
+    
+    std::vector<uint8_t> table(entries * entry_size);
+    if (!readAt(table_position, table.data(), table.size())) return;
+    
+    // Byte position at the start of each entry's run of frames
+    std::vector<uint32_t> positions(entries + 1, 0);
+    for (size_t e = 0; e < entries; e++) {
+        uint32_t value = 0;
+        for (size_t b = 0; b < entry_size; b++) {
+            value = (value << 8) | table[e * entry_size + b];
+        }
+        positions[e + 1] = positions[e] + value * scale;
+    }
+    
+    // Resample onto the 100-point Xing layout so seeking has one code path
+    for (size_t percent = 0; percent < 100; percent++) {
+        uint64_t frame = (uint64_t)info.frame_count * percent / 100;
+        size_t e = frame / frames_per_entry;
+        uint64_t position;
+        if (e >= entries) {
+            position = positions[entries];
+        } else {
+            uint64_t within = frame - (uint64_t)e * frames_per_entry;
+            position = positions[e] + (positions[e + 1] - positions[e]) * within / frames_per_entry;
+        }
+        uint64_t scaled = position * 256 / info.stream_bytes;
+        info.toc[percent] = scaled > 255 ? 255 : (uint8_t)scaled;
+    }
+    info.has_toc = true;
+}
+
+bool Mp3HeaderParser::parse(TrackMetadata& metadata, Mp3StreamInfo& info) {
+    metadata = TrackMetadata();
+    memset(&info, 0, sizeof(info));
+    if (file_size == 0) return false;
+    
+    info.audio_start = parseId3v2(metadata);
+    info.audio_end = file_size;
+    if (parseId3v1(metadata)) {
+        info.audio_end = file_size - 128;
+    }
+    
+    if (!findFirstFrame(info)) {
+        return false;
+    }
+    readVbrHeader(info);
+    
+    if (info.frame_count > 0) {
+        metadata.duration_ms = (uint32_t)((uint64_t)info.frame_count * info.samples_per_frame * 1000 / info.sample_rate);
+    } else if (info.bitrate > 0) {
+        // No VBR header: assume constant bitrate
+        metadata.duration_ms = (uint32_t)((uint64_t)(info.audio_end - info.first_frame) * 8000 / info.bitrate);
+    }
+    return true;
+}
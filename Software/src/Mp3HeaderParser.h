@@ -0,0 +1,64 @@
+#ifndef MP3HEADERPARSER_H
+#define MP3HEADERPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "ReadAheadBuffer.h"
+
+static const int16_t REPLAY_GAIN_UNKNOWN = INT16_MIN;
+
+struct TrackMetadata {
+    std::string title;
+    std::string artist;
+    std::string album;
+    uint16_t track_number;
+    uint32_t duration_ms;
+    int16_t replay_gain = REPLAY_GAIN_UNKNOWN; // Track gain in 0.01 dB
+    uint16_t replay_peak = 0;                  // Sample peak, 32768 = full scale
+};
+
+// Layout of the MPEG audio stream, taken from the first frame header and
+// its Xing/Info or VBRI header when present
+struct Mp3StreamInfo {
+    uint32_t audio_start;   // First byte after the ID3v2 tag
+    uint32_t audio_end;     // Before the ID3v1 tag, if any
+    uint32_t first_frame;   // Offset of the first frame header
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint16_t samples_per_frame;
+    uint32_t bitrate;       // Of the first frame, bits per second
+    uint32_t frame_count;   // 0 when unknown (no VBR header)
+    uint32_t stream_bytes;  // From the VBR header, 0 when unknown
+    bool has_toc;           // Xing TOC, or a VBRI table converted to one
+    uint8_t toc[100];       // Byte position (/256) at each percent of duration
+};
+
+// Reads ID3v2.2-2.4 and ID3v1 tags plus the Xing/Info/VBRI header through a
+// BlockReader. Only small header regions are read; large frames such as
+// embedded pictures are skipped with a seek. No Arduino dependencies.
+class Mp3HeaderParser {
+private:
+    BlockReader& reader;
+    size_t file_size;
+    
+public:
+    explicit Mp3HeaderParser(BlockReader& source);
+    
+    bool parse(TrackMetadata& metadata, Mp3StreamInfo& info);
+    
+    // Decodes an ID3 text field (any of the four encodings) to UTF-8
+    static std::string decodeText(uint8_t encoding, const uint8_t* data, size_t len);
+    static bool parseFrameHeader(const uint8_t* header, Mp3StreamInfo& info, uint32_t& frame_bytes);
+    
+private:
+    bool readAt(size_t position, uint8_t* buffer, size_t len);
+    uint32_t parseId3v2(TrackMetadata& metadata);
+    static void parseUserText(const uint8_t* content, size_t size, TrackMetadata& metadata);
+    bool parseId3v1(TrackMetadata& metadata);
+    bool findFirstFrame(Mp3StreamInfo& info);
+    void readVbrHeader(Mp3StreamInfo& info);
+    void readVbriTable(Mp3StreamInfo& info, const uint8_t* vbri, size_t table_position);
+};
+
+#endif
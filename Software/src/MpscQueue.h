@@ -0,0 +1,77 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock-free multi-producer/single-consumer queue. Every cell carries
+// a sequence number, so producers claim slots with a single CAS and the
+// consumer never blocks them. Free of Arduino dependencies for host testing.
+template <typename T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "MpscQueue capacity must be a power of two");
+    
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    
+    Cell cells[Capacity];
+    std::atomic<size_t> enqueue_pos;
+    size_t dequeue_pos; // Only touched by the consumer
+    
+public:
+    MpscQueue() : enqueue_pos(0), dequeue_pos(0) {
+        for (size_t i = 0; i < Capacity; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    // Any thread. Returns false only when the queue is full.
+    bool push(const T& item) {
+        Cell* cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & (Capacity - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        
+        cell->data = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Consumer only
+    bool pop(T& item) {
+        Cell* cell = &cells[dequeue_pos & (Capacity - 1)];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(dequeue_pos + 1) < 0) {
+            return false;
+        }
+        
+        item = cell->data;
+        cell->sequence.store(dequeue_pos + Capacity, std::memory_order_release);
+        dequeue_pos++;
+        return true;
+    }
+    
+    bool empty() const {
+        const Cell& cell = cells[dequeue_pos & (Capacity - 1)];
+        return (intptr_t)cell.sequence.load(std::memory_order_acquire) - (intptr_t)(dequeue_pos + 1) < 0;
+    }
+};
+
+#endif
@@ -1,15 +1,99 @@
 #include "MusicPlayer.h"
 #include "PlaylistManager.h"
 #include "AudioProcessor.h"
+#include "ResumeManager.h"
+#include "MetadataManager.h"
+#include "PlaylistIndex.h"
 
 // Global objects defined in main.cpp
 extern PlaylistManager playlist_manager;
 extern AudioProcessor audio_processor;
+extern ResumeManager resume_manager;
+extern MetadataManager metadata_manager;
+
+// The player task wakes at least this often to checkpoint the position;
+// ResumeManager decides whether it is time to write
+static const TickType_t CHECKPOINT_POLL_TICKS = pdMS_TO_TICKS(1000);
+
+// Fades run inside the PCM path, so none of these block the player task
+static const uint32_t FADE_OUT_MS = 300;
+static const uint32_t FADE_IN_MS = 200;
+static const uint32_t VOLUME_RAMP_MS = 50;
+static const int VOLUME_STEP_DB = 2;
+
+static uint32_t pathHash(const String& path) {
+    return fnv1a(path.c_str(), path.length());
+}
 
 MusicPlayer::MusicPlayer() : 
     current_state(PlayerState::STOPPED),
     current_track_index(-1),
-    is_busy(false) {
+    queued_track_index(-1),
+    current_slot(-1),
+    queued_slot(-1),
+    volume_db(0),
+    shuffle(false),
+    repeat_mode(RepeatMode::ALL),
+    shuffle_seed(0),
+    shuffle_pass(0),
+    queued_pass(0),
+    shuffle_order_pass(0),
+    player_task(nullptr),
+    pending_events(0) {
+}
+
+bool MusicPlayer::begin(int task_core, int task_priority) {
+    if (player_task) return true;
+    
+    // A finished rescan is applied here, so the index swap and the table
+    // swap happen together on the task that owns the index
+    playlist_manager.setRescanReadyCallback([this]() {
+        executeCommand(PlayerCommand::RESCAN_READY);
+    });
+    
+    if (xTaskCreatePinnedToCore(playerTaskEntry, "player", 8192, this,
+                                task_priority, &player_task, task_core) != pdPASS) {
+        Serial.println("Failed to start player task");
+        player_task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void MusicPlayer::playerTaskEntry(void* param) {
+    static_cast<MusicPlayer*>(param)->playerLoop();
+}
+
+void MusicPlayer::playerLoop() {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, CHECKPOINT_POLL_TICKS);
+        
+        // Callback events first: they report audio that has already played
+        uint32_t events = pending_events.load(std::memory_order_acquire);
+        if (events & EVENT_TRACK_ADVANCED) {
+            pending_events.fetch_and(~EVENT_TRACK_ADVANCED, std::memory_order_acq_rel);
+            applyCommand(PlayerCommand::TRACK_ADVANCED, -1);
+        }
+        if (events & EVENT_TRACK_FINISHED) {
+            applyCommand(PlayerCommand::TRACK_FINISHED, -1);
+            // Only now: the callback keeps reporting the end until the next track is open
+            pending_events.fetch_and(~EVENT_TRACK_FINISHED, std::memory_order_acq_rel);
+        }
+        
+        QueuedCommand entry;
+        while (command_queue.pop(entry)) {
+            bool applied = applyCommand(entry.cmd, entry.parameter);
+            if (entry.tag != 0) {
+                for (auto& callback : command_callbacks) {
+                    callback(entry.tag, applied);
+                }
+            }
+        }
+        
+        if (getState() == PlayerState::PLAYING) {
+            checkpoint(false);
+        }
+    }
 }
 
 void MusicPlayer::addStateChangeCallback(StateChangeCallback callback) {
@@ -20,104 +104,404 @@ void MusicPlayer::addLogCallback(LogCallback callback) {
     log_callbacks.push_back(callback);
 }
 
-bool MusicPlayer::executeCommand(PlayerCommand cmd, int parameter) {
-    if (is_busy) return false; // Don't accept commands while busy
+void MusicPlayer::addCommandDoneCallback(CommandDoneCallback callback) {
+    command_callbacks.push_back(callback);
+}
+
+bool MusicPlayer::executeCommand(PlayerCommand cmd, int parameter, uint32_t tag) {
+    QueuedCommand entry = { cmd, parameter, tag };
+    
+    // Never drop a command: if the queue is full, wait for the player task
+    while (!command_queue.push(entry)) {
+        vTaskDelay(1);
+    }
+    
+    if (player_task) {
+        xTaskNotifyGive(player_task);
+    }
+    return true;
+}
 
+bool MusicPlayer::applyCommand(PlayerCommand cmd, int parameter) {
+    PlayerState state = getState();
+    
     switch (cmd) {
         case PlayerCommand::PLAY:
-            if (current_state == PlayerState::PAUSED) {
-                current_state = PlayerState::PLAYING;
+            if (state == PlayerState::PAUSED) {
+                setState(PlayerState::PLAYING);
+                audio_processor.fadeTo(volumeGain(), FADE_IN_MS);
                 logMessage("Resumed");
                 notifyStateChange();
                 return true;
-            } else if (current_track_index >= 0) {
-                current_state = PlayerState::PLAYING;
+            } else if (getCurrentTrackIndex() >= 0) {
+                setState(PlayerState::PLAYING);
+                audio_processor.fadeTo(volumeGain(), FADE_IN_MS);
                 logMessage("Playing");
                 notifyStateChange();
                 return true;
             }
             return false;
-            
+        
         case PlayerCommand::PAUSE:
-            if (current_state == PlayerState::PLAYING) {
-                current_state = PlayerState::PAUSED;
+            if (state == PlayerState::PLAYING) {
+                setState(PlayerState::PAUSED);
+                audio_processor.fadeTo(0, FADE_OUT_MS);
+                checkpoint(true);
                 logMessage("Paused");
                 notifyStateChange();
                 return true;
             }
             return false;
-            
+        
         case PlayerCommand::STOP:
-            current_state = PlayerState::STOPPED;
+            checkpoint(true);
+            setState(PlayerState::STOPPED);
+            audio_processor.fadeTo(0, FADE_OUT_MS);
             logMessage("Stopped");
             notifyStateChange();
             return true;
-            
+        
         case PlayerCommand::NEXT_TRACK:
-            nextTrack();
-            return true;
-            
+            return advance(1, true);
+        
         case PlayerCommand::PREV_TRACK:
-            prevTrack();
-            return true;
-            
+            return advance(-1, true);
+        
         case PlayerCommand::PLAY_TRACK:
             if (parameter >= 0) {
                 return openTrack(parameter);
             }
             return false;
-            
+        
         case PlayerCommand::VOLUME_UP:
+            changeVolume(VOLUME_STEP_DB);
+            return true;
+        
         case PlayerCommand::VOLUME_DOWN:
-            // To be implemented
+            changeVolume(-VOLUME_STEP_DB);
+            return true;
+        
+        case PlayerCommand::SET_VOLUME:
+            changeVolume(parameter - getVolumeDb());
+            return true;
+        
+        case PlayerCommand::SEEK:
+            return seekTo(parameter);
+        
+        case PlayerCommand::SEEK_RELATIVE: {
+            // In 64 bits: the offset can be anything an int holds
+            int64_t target = (int64_t)audio_processor.getPositionMs() + parameter;
+            return seekTo(target > INT32_MAX ? INT32_MAX : (int32_t)target);
+        }
+        
+        case PlayerCommand::SET_SHUFFLE:
+            if (parameter != 0 && !isShuffle()) {
+                // A fresh order, continuing from the current track
+                shuffle_seed = esp_random();
+                shuffle_pass = 0;
+                shuffle_order.reset(0, 0);
+            }
+            shuffle.store(parameter != 0, std::memory_order_relaxed);
+            logMessage(parameter != 0 ? "Shuffle on" : "Shuffle off");
+            queueNextTrack();
+            return true;
+        
+        case PlayerCommand::SET_REPEAT:
+            if (parameter < (int)RepeatMode::OFF || parameter > (int)RepeatMode::ONE) return false;
+            repeat_mode.store((RepeatMode)parameter, std::memory_order_relaxed);
+            logMessage(parameter == (int)RepeatMode::OFF ? "Repeat off" :
+                       parameter == (int)RepeatMode::ALL ? "Repeat all" : "Repeat one");
+            queueNextTrack();
+            return true;
+        
+        case PlayerCommand::SET_PLAYLIST: {
+            if (!playlist_manager.selectPlaylist(parameter)) {
+                logMessage("Playlist has no playable tracks");
+                return false;
+            }
+            if (parameter < 0) {
+                // Back to the whole card, carrying on from the current track
+                logMessage("Playing all tracks");
+                current_slot = playlist_manager.findOrderSlot(getCurrentTrackIndex());
+                queueNextTrack();
+                return true;
+            }
+            logMessage("Playlist: " + playlist_manager.getSelectedPlaylist());
+            uint32_t pass;
+            shuffle_pass = 0;
+            int slot = followingSlot(-1, 1, true, pass);
+            return openTrack(playlist_manager.getOrderTrack(slot), slot);
+        }
+        
+        case PlayerCommand::TRACK_FINISHED:
+            logMessage("Track finished");
+            advance(1, false);
+            return true;
+        
+        case PlayerCommand::TRACK_ADVANCED:
+            // The AudioProcessor already switched to the queued track without a gap
+            if (queued_track_index < 0) return false;
+            current_track_index.store(queued_track_index, std::memory_order_release);
+            current_slot = queued_slot;
+            shuffle_pass = queued_pass;
+            logMessage("Playing: " + playlist_manager.getTrackName(queued_track_index));
+            notifyStateChange();
+            queueNextTrack();
+            return true;
+        
+        case PlayerCommand::RESCAN_READY: {
+            int previous_index = getCurrentTrackIndex();
+            int remapped = playlist_manager.applyRescan(previous_index);
+            current_track_index.store(remapped, std::memory_order_release);
+            current_slot = playlist_manager.findOrderSlot(remapped, current_slot);
+            if (previous_index >= 0 && remapped < 0) {
+                logMessage("Current track was removed from the card");
+            }
+            logMessage("Playlist updated: " + String((unsigned)playlist_manager.getTrackCount()) + " tracks");
+            queueNextTrack();
+            return true;
+        }
+        
+        case PlayerCommand::CONNECTED:
+            logMessage("Bluetooth connected");
+            if (playlist_manager.getTrackCount() > 0 && getCurrentTrackIndex() == -1) {
+                if (!resumePlayback()) {
+                    openTrack(0);
+                }
+            } else {
+                setState(PlayerState::PLAYING);
+                notifyStateChange();
+            }
+            return true;
+        
+        case PlayerCommand::DISCONNECTED:
+            logMessage("Bluetooth disconnected");
+            checkpoint(true);
+            setState(PlayerState::STOPPED);
+            notifyStateChange();
             return true;
     }
     return false;
 }
 
-void MusicPlayer::nextTrack() {
-    if (playlist_manager.getTrackCount() == 0) return;
+bool MusicPlayer::advance(int direction, bool manual) {
+    if (playlist_manager.getOrderSize() == 0) return false;
     
-    int next_index = (current_track_index + 1) % playlist_manager.getTrackCount();
-    openTrack(next_index);
+    uint32_t pass;
+    int slot = followingSlot(current_slot, direction, manual, pass);
+    if (slot < 0) {
+        // Repeat off and the last track has ended
+        setState(PlayerState::STOPPED);
+        logMessage("End of playlist");
+        notifyStateChange();
+        return false;
+    }
+    
+    // A track that fails to open is passed over; once a whole pass has
+    // failed there is nothing playable left
+    if (crossfadeTo(slot, pass)) return true;
+    bool skip_manual = manual || getRepeatMode() == RepeatMode::ONE;
+    int count = (int)playlist_manager.getOrderSize();
+    for (int attempt = 0; attempt < count && slot >= 0; attempt++) {
+        shuffle_pass = pass;
+        if (openTrack(playlist_manager.getOrderTrack(slot), slot)) return true;
+        slot = followingSlot(slot, direction, skip_manual, pass);
+    }
+    
+    setState(PlayerState::STOPPED);
+    logMessage(slot < 0 ? "End of playlist" : "No playable track found");
+    notifyStateChange();
+    return false;
 }
 
-void MusicPlayer::prevTrack() {
-    if (playlist_manager.getTrackCount() == 0) return;
+int MusicPlayer::followingSlot(int slot, int direction, bool manual, uint32_t& pass) {
+    int count = (int)playlist_manager.getOrderSize();
+    pass = shuffle_pass;
+    if (count == 0) return -1;
+    
+    bool shuffled = isShuffle();
+    if (slot < 0 || slot >= count) {
+        return shuffled ? (int)shuffleOrder(pass).at(0) : 0;
+    }
     
-    int prev_index = (current_track_index - 1 + playlist_manager.getTrackCount()) % playlist_manager.getTrackCount();
-    openTrack(prev_index);
+    // Repeat one only holds the track when it ends by itself
+    RepeatMode repeat = getRepeatMode();
+    if (!manual && repeat == RepeatMode::ONE) return slot;
+    
+    int position = shuffled ? (int)shuffleOrder(pass).positionOf(slot) : slot;
+    position += direction;
+    if (position < 0 || position >= count) {
+        if (!manual && repeat == RepeatMode::OFF) return -1;
+        
+        // Into the next or previous pass, which has an order of its own
+        position = position < 0 ? count - 1 : 0;
+        pass += direction;
+    }
+    return shuffled ? (int)shuffleOrder(pass).at(position) : position;
+}
+
+const ShufflePermutation& MusicPlayer::shuffleOrder(uint32_t pass) {
+    // O(1): a new pass or playlist size only derives new round keys
+    uint32_t count = playlist_manager.getOrderSize();
+    if (shuffle_order.size() != count || shuffle_order_pass != pass) {
+        shuffle_order.reset(count, shuffle_seed ^ (pass * 0x9E3779B9));
+        shuffle_order_pass = pass;
+    }
+    return shuffle_order;
 }
 
-bool MusicPlayer::openTrack(int index) {
-    setBusy(true);
+bool MusicPlayer::crossfadeTo(int slot, uint32_t pass) {
+    // Only a playing track can be faded out of; TRACK_ADVANCED follows
+    // once the fade has started and makes the new index current
+    int index = playlist_manager.getOrderTrack(slot);
+    if (!audio_processor.canCrossfade() || getState() != PlayerState::PLAYING ||
+        getCurrentTrackIndex() < 0 || audio_processor.isCrossfading() ||
+        !playlist_manager.isValidIndex(index)) {
+        return false;
+    }
+    
+    queued_track_index = index;
+    queued_slot = slot;
+    queued_pass = pass;
+    audio_processor.setNextFile(playlist_manager.getTrackPath(index), trackGain(index));
+    audio_processor.crossfadeToNext();
+    return true;
+}
 
+bool MusicPlayer::openTrack(int index, int slot) {
     if (!playlist_manager.isValidIndex(index)) {
-        setBusy(false);
         return false;
     }
     
     String track_path = playlist_manager.getTrackPath(index);
-    if (!audio_processor.openFile(track_path)) {
+    if (!audio_processor.openFile(track_path, trackGain(index))) {
         logMessage("Failed to open: " + track_path);
-        setBusy(false);
         return false;
     }
     
-    current_track_index = index;
-    current_state = PlayerState::PLAYING;
+    current_track_index.store(index, std::memory_order_release);
+    current_slot = slot >= 0 ? slot : playlist_manager.findOrderSlot(index);
+    setState(PlayerState::PLAYING);
+    audio_processor.fadeTo(volumeGain(), FADE_IN_MS);
     
     logMessage("Playing: " + playlist_manager.getTrackName(index));
     notifyStateChange();
+    queueNextTrack();
+    
+    return true;
+}
+
+bool MusicPlayer::seekTo(int32_t position_ms) {
+    if (getCurrentTrackIndex() < 0 || getState() == PlayerState::STOPPED) {
+        return false;
+    }
+    if (position_ms < 0) position_ms = 0;
+    
+    uint32_t started = millis();
+    uint32_t actual_ms;
+    if (!audio_processor.seekTo(position_ms, actual_ms)) {
+        logMessage("Seek failed");
+        return false;
+    }
+    
+    uint32_t seconds = actual_ms / 1000;
+    logMessage("Seek to " + String(seconds / 60) + ":" + (seconds % 60 < 10 ? "0" : "") +
+               String(seconds % 60) + " (" + String(millis() - started) + " ms)");
+    return true;
+}
+
+void MusicPlayer::changeVolume(int delta_db) {
+    int db = getVolumeDb() + delta_db;
+    if (db > 0) db = 0;
+    if (db < MIN_VOLUME_DB) db = MIN_VOLUME_DB;
+    volume_db.store(db, std::memory_order_relaxed);
+    
+    if (getState() == PlayerState::PLAYING) {
+        audio_processor.fadeTo(volumeGain(), VOLUME_RAMP_MS);
+    }
+    logMessage("Volume: " + String(db) + " dB");
+}
+
+uint32_t MusicPlayer::volumeGain() const {
+    return GainStage::dbToGain(getVolumeDb());
+}
+
+uint32_t MusicPlayer::trackGain(int index) {
+    // Unmeasured tracks, or no index yet, play unchanged
+    std::shared_ptr<const MetadataIndex> metadata = metadata_manager.getIndex();
+    if (!metadata || index < 0 || index >= (int)metadata->size()) {
+        return GainStage::TRACK_UNITY;
+    }
+    return GainStage::replayGainToTrackGain(metadata->replayGain(index), metadata->replayPeak(index));
+}
+
+bool MusicPlayer::resumePlayback() {
+    ResumePoint point;
+    if (!resume_manager.getResumePoint(point)) {
+        return false;
+    }
+    
+    // The saved index is only a hint: a rescan may have renumbered tracks
+    int index = -1;
+    if (playlist_manager.isValidIndex(point.track_index) &&
+        pathHash(playlist_manager.getTrackPath(point.track_index)) == point.path_hash) {
+        index = point.track_index;
+    } else {
+        for (int i = 0; i < (int)playlist_manager.getTrackCount(); i++) {
+            if (pathHash(playlist_manager.getTrackPath(i)) == point.path_hash) {
+                index = i;
+                break;
+            }
+        }
+    }
     
-    setBusy(false);
+    if (index < 0 || !openTrack(index)) {
+        return false;
+    }
+    
+    if (point.byte_offset > 0 && audio_processor.seekToOffset(point.byte_offset, point.position_ms)) {
+        uint32_t seconds = point.position_ms / 1000;
+        logMessage("Resumed at " + String(seconds / 60) + ":" + (seconds % 60 < 10 ? "0" : "") +
+                   String(seconds % 60));
+    }
     return true;
 }
 
+void MusicPlayer::checkpoint(bool force) {
+    int track_index = getCurrentTrackIndex();
+    if (track_index < 0 || (!force && !resume_manager.isDue())) return;
+    
+    String track_path = playlist_manager.getTrackPath(track_index);
+    ResumePoint point;
+    point.track_index = track_index;
+    point.path_hash = pathHash(track_path);
+    if (audio_processor.getResumePoint(track_path, point.byte_offset, point.position_ms)) {
+        resume_manager.checkpoint(point, force);
+    }
+}
+
+void MusicPlayer::queueNextTrack() {
+    int track_index = getCurrentTrackIndex();
+    if (playlist_manager.getOrderSize() == 0 || track_index < 0) {
+        queued_track_index = -1;
+        audio_processor.setNextFile("");
+        return;
+    }
+    
+    // Nothing queued at the end of the playlist with repeat off
+    queued_slot = followingSlot(current_slot, 1, false, queued_pass);
+    queued_track_index = playlist_manager.getOrderTrack(queued_slot);
+    if (queued_track_index < 0) {
+        audio_processor.setNextFile("");
+        return;
+    }
+    audio_processor.setNextFile(playlist_manager.getTrackPath(queued_track_index), trackGain(queued_track_index));
+}
+
 void MusicPlayer::notifyStateChange() {
     String track_name = getCurrentTrackName();
     for (auto& callback : state_callbacks) {
-        callback(current_state, current_track_index, track_name);
+        callback(getState(), getCurrentTrackIndex(), track_name);
     }
 }
 
@@ -128,34 +512,34 @@ void MusicPlayer::logMessage(const String& message) {
 }
 
 void MusicPlayer::notifyTrackFinished() {
-    if (is_busy) return;
-    logMessage("Track finished");
-    nextTrack();
+    postEvent(EVENT_TRACK_FINISHED);
 }
 
-void MusicPlayer::notifyConnectionStateChanged(bool connected) {
-    if (connected) {
-        logMessage("Bluetooth connected");
-        if (playlist_manager.getTrackCount() > 0 && current_track_index == -1) {
-            openTrack(0);
-        }else{
-            current_state = PlayerState::PLAYING;
-            notifyStateChange();
-        }
-    } else {
-        logMessage("Bluetooth disconnected");
-        current_state = PlayerState::STOPPED;
-        notifyStateChange();
+void MusicPlayer::notifyTrackAdvanced() {
+    postEvent(EVENT_TRACK_ADVANCED);
+}
+
+void MusicPlayer::postEvent(uint32_t event) {
+    // Wait-free for the audio callback: a bit that is already set is
+    // still waiting for the player task, so a repeat changes nothing
+    uint32_t previous = pending_events.fetch_or(event, std::memory_order_acq_rel);
+    if (!(previous & event) && player_task) {
+        xTaskNotifyGive(player_task);
     }
 }
 
+void MusicPlayer::notifyConnectionStateChanged(bool connected) {
+    executeCommand(connected ? PlayerCommand::CONNECTED : PlayerCommand::DISCONNECTED);
+}
+
 int MusicPlayer::getTrackCount() const {
     return playlist_manager.getTrackCount();
 }
 
 String MusicPlayer::getCurrentTrackName() const {
-    if (current_track_index >= 0) {
-        return playlist_manager.getTrackName(current_track_index);
+    int track_index = getCurrentTrackIndex();
+    if (track_index >= 0) {
+        return playlist_manager.getTrackName(track_index);
     }
     return "None";
 }
\ No newline at end of file
@@ -2,7 +2,10 @@
 #define MUSICPLAYER_H
 
 #include <Arduino.h>
+#include <atomic>
 #include <vector>
+#include "MpscQueue.h"
+#include "ShufflePermutation.h"
 
 enum class PlayerState {
     STOPPED,
@@ -10,6 +13,12 @@ enum class PlayerState {
     PAUSED
 };
 
+enum class RepeatMode {
+    OFF, // Stop after the last track
+    ALL, // Start over; shuffle picks a new order each time round
+    ONE  // Replay the current track; next and previous still move on
+};
+
 enum class PlayerCommand {
     PLAY,
     PAUSE,
@@ -18,49 +27,127 @@ enum class PlayerCommand {
     PREV_TRACK,
     PLAY_TRACK,
     VOLUME_UP,
-    VOLUME_DOWN
+    VOLUME_DOWN,
+    SET_VOLUME,     // Parameter: level in dB, 0 down to MIN_VOLUME_DB
+    SEEK,           // Parameter: position in ms
+    SEEK_RELATIVE,  // Parameter: signed offset in ms
+    SET_SHUFFLE,    // Parameter: 1 on, 0 off
+    SET_REPEAT,     // Parameter: RepeatMode
+    SET_PLAYLIST,   // Parameter: playlist file number, -1 for the whole card
+    
+    // Internal events posted by the audio and Bluetooth callbacks
+    TRACK_FINISHED,
+    TRACK_ADVANCED,
+    RESCAN_READY,
+    CONNECTED,
+    DISCONNECTED
 };
 
 // Callback to notify state changes
 typedef std::function<void(PlayerState state, int track_index, const String& track_name)> StateChangeCallback;
 typedef std::function<void(const String& message)> LogCallback;
+// Outcome of a tagged command, called from the player task once applied
+typedef std::function<void(uint32_t tag, bool applied)> CommandDoneCallback;
+
+struct QueuedCommand {
+    PlayerCommand cmd;
+    int parameter;
+    uint32_t tag; // Nonzero: reported to the command callbacks
+};
 
 class MusicPlayer {
+public:
+    static const int MIN_VOLUME_DB = -60;
+    
 private:
-    PlayerState current_state;
-    int current_track_index;
+    // Written only by the player task, read wait-free from anywhere
+    std::atomic<PlayerState> current_state;
+    std::atomic<int> current_track_index;
+    int queued_track_index; // Handed to the AudioProcessor for a gapless start
+    
+    // Positions of those two in the play order, which is the whole card
+    // or a playlist file; -1 for a track picked from outside the playlist
+    int current_slot;
+    int queued_slot;
+    std::atomic<int> volume_db; // Software volume, 0 dB down to MIN_VOLUME_DB
+    std::atomic<bool> shuffle;
+    std::atomic<RepeatMode> repeat_mode;
+    
+    // Shuffle order of each pass through the playlist, derived from the
+    // seed and the pass number, so previous can step back across passes
+    // without any order being stored. The permutation is cached per pass.
+    uint32_t shuffle_seed;
+    uint32_t shuffle_pass;
+    uint32_t queued_pass; // Pass of queued_track_index
+    ShufflePermutation shuffle_order;
+    uint32_t shuffle_order_pass;
+    
     std::vector<StateChangeCallback> state_callbacks;
     std::vector<LogCallback> log_callbacks;
-    volatile bool is_busy; // Concurrency flag
+    std::vector<CommandDoneCallback> command_callbacks;
+    
+    // Commands from the serial loop and BT task, applied in order by the
+    // single player task
+    MpscQueue<QueuedCommand, 32> command_queue;
+    TaskHandle_t player_task;
+    
+    // Events from the audio callback, which must never wait on a full
+    // queue: one bit each, applied by the player task ahead of the queue
+    static const uint32_t EVENT_TRACK_FINISHED = 1 << 0;
+    static const uint32_t EVENT_TRACK_ADVANCED = 1 << 1;
+    std::atomic<uint32_t> pending_events;
     
 public:
     MusicPlayer();
     
+    // Starts the task that owns all player state
+    bool begin(int task_core, int task_priority);
+    
     // Callback management
     void addStateChangeCallback(StateChangeCallback callback);
     void addLogCallback(LogCallback callback);
+    void addCommandDoneCallback(CommandDoneCallback callback);
     
-    // Main controls
-    bool executeCommand(PlayerCommand cmd, int parameter = -1);
+    // Main controls: queues the command, safe from any task. Waits while
+    // the queue is full, so the audio callback uses the notify calls below.
+    // Returns once queued; a nonzero tag is passed to the command callbacks
+    // with the outcome when the player task has applied it.
+    bool executeCommand(PlayerCommand cmd, int parameter = -1, uint32_t tag = 0);
     
     // Player status
-    PlayerState getState() const { return current_state; }
-    int getCurrentTrackIndex() const { return current_track_index; }
+    PlayerState getState() const { return current_state.load(std::memory_order_acquire); }
+    int getCurrentTrackIndex() const { return current_track_index.load(std::memory_order_acquire); }
     int getTrackCount() const;
+    int getVolumeDb() const { return volume_db.load(std::memory_order_relaxed); }
+    bool isShuffle() const { return shuffle.load(std::memory_order_relaxed); }
+    RepeatMode getRepeatMode() const { return repeat_mode.load(std::memory_order_relaxed); }
     String getCurrentTrackName() const;
-    bool isBusy() const { return is_busy; }
     
-    // For internal use (calls from A2DP callbacks)
+    // For internal use (calls from A2DP callbacks); the track events never block
     void notifyTrackFinished();
+    void notifyTrackAdvanced();
     void notifyConnectionStateChanged(bool connected);
     
 private:
-    void setBusy(bool busy_state) { is_busy = busy_state; }
+    static void playerTaskEntry(void* param);
+    void playerLoop();
+    void postEvent(uint32_t event);
+    bool applyCommand(PlayerCommand cmd, int parameter);
+    void setState(PlayerState state) { current_state.store(state, std::memory_order_release); }
     void notifyStateChange();
     void logMessage(const String& message);
-    bool openTrack(int index);
-    void nextTrack();
-    void prevTrack();
+    bool openTrack(int index, int slot = -1);
+    void queueNextTrack();
+    bool seekTo(int32_t position_ms);
+    void changeVolume(int delta_db);
+    uint32_t volumeGain() const;
+    uint32_t trackGain(int index);
+    bool resumePlayback();
+    void checkpoint(bool force);
+    bool advance(int direction, bool manual);
+    int followingSlot(int slot, int direction, bool manual, uint32_t& pass);
+    const ShufflePermutation& shuffleOrder(uint32_t pass);
+    bool crossfadeTo(int slot, uint32_t pass);
 };
 
 #endif
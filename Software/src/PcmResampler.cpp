@@ -0,0 +1,207 @@
+#include "PcmResampler.h"
+#include <cmath>
+#include <cstring>
+#include <new>
+
+// Passband edge as a fraction of the lower Nyquist frequency; the rest is
+// the transition band of the 32-tap filter
+static const double CUTOFF = 0.90;
+
+// Kaiser window shape: about 65 dB of stopband attenuation
+static const double KAISER_BETA = 6.5;
+
+// Bits of the Q16 phase fraction used to blend neighbouring phases
+static const int BLEND_BITS = 10;
+
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+static inline int16_t saturate(int32_t value) {
+    if (value > 32767) return 32767;
+    if (value < -32768) return -32768;
+    return (int16_t)value;
+}
+
+PcmResampler::PcmResampler() :
+    input_rate(OUTPUT_RATE),
+    input_channels(2),
+    coefficients(nullptr),
+    head(0),
+    position(0),
+    carry_bytes(0) {
+    reset();
+}
+
+PcmResampler::~PcmResampler() {
+    delete[] coefficients;
+}
+
+bool PcmResampler::configure(uint32_t rate, uint16_t channels) {
+    if (rate == 0 || channels == 0 || channels > 2) {
+        return false;
+    }
+    
+    delete[] coefficients;
+    coefficients = nullptr;
+    input_rate = rate;
+    input_channels = channels;
+    
+    if (input_rate != OUTPUT_RATE) {
+        coefficients = new (std::nothrow) int16_t[(PHASES + 1) * TAPS];
+        if (!coefficients) {
+            input_rate = OUTPUT_RATE;
+            return false;
+        }
+        buildFilter();
+    }
+    
+    reset();
+    return true;
+}
+
+void PcmResampler::reset() {
+    memset(history, 0, sizeof(history));
+    head = 0;
+    position = 0;
+    carry_bytes = 0;
+}
+
+void PcmResampler::buildFilter() {
+    // Cutoff in cycles per input sample, below whichever Nyquist is lower
+    double ratio = input_rate > OUTPUT_RATE ? (double)OUTPUT_RATE / input_rate : 1.0;
+    double cutoff = 0.5 * CUTOFF * ratio;
+    double half = TAPS / 2;
+    double window_scale = besselI0(KAISER_BETA);
+    
+    double row[TAPS];
+    for (int p = 0; p <= PHASES; p++) {
+        // Tap k sits k + 1 - TAPS/2 - fraction input samples from the output time
+        double fraction = (double)p / PHASES;
+        double sum = 0.0;
+        for (int k = 0; k < TAPS; k++) {
+            double d = k + 1 - half - fraction;
+            double x = 2.0 * cutoff * d;
+            double sinc = fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double w = d / half;
+            double window = fabs(w) >= 1.0 ? 0.0 : besselI0(KAISER_BETA * sqrt(1.0 - w * w)) / window_scale;
+            row[k] = 2.0 * cutoff * sinc * window;
+            sum += row[k];
+        }
+        
+        // Unity gain at DC for every phase; rounding residue goes to the largest tap
+        int16_t* out = coefficients + p * TAPS;
+        int32_t total = 0;
+        int largest = 0;
+        for (int k = 0; k < TAPS; k++) {
+            out[k] = (int16_t)lround(row[k] / sum * 32768.0);
+            total += out[k];
+            if (out[k] > out[largest]) largest = k;
+        }
+        out[largest] += (int16_t)(32768 - total);
+    }
+}
+
+size_t PcmResampler::inputBytesFor(size_t output_bytes) const {
+    size_t frames = output_bytes / 4;
+    uint64_t input_frames;
+    if (input_rate == OUTPUT_RATE) {
+        input_frames = frames;
+    } else {
+        // N inputs yield at most N * OUTPUT_RATE / input_rate + 1 outputs
+        input_frames = frames > 1 ? (uint64_t)(frames - 1) * input_rate / OUTPUT_RATE : 0;
+    }
+    size_t bytes = (size_t)input_frames * input_channels * sizeof(int16_t);
+    return bytes > carry_bytes ? bytes - carry_bytes : 0;
+}
+
+size_t PcmResampler::process(const uint8_t* input, size_t input_bytes, int16_t* output, size_t output_frames) {
+    size_t frame_bytes = input_channels * sizeof(int16_t);
+    size_t written = 0;
+    
+    // Complete the frame split across the previous call
+    if (carry_bytes > 0) {
+        size_t needed = frame_bytes - carry_bytes;
+        if (input_bytes < needed) {
+            memcpy(carry + carry_bytes, input, input_bytes);
+            carry_bytes += input_bytes;
+            return 0;
+        }
+        memcpy(carry + carry_bytes, input, needed);
+        input += needed;
+        input_bytes -= needed;
+        carry_bytes = 0;
+        written += consumeFrame(carry, output, output_frames);
+    }
+    
+    while (input_bytes >= frame_bytes) {
+        written += consumeFrame(input, output + written * 2, output_frames - written);
+        input += frame_bytes;
+        input_bytes -= frame_bytes;
+    }
+    
+    memcpy(carry, input, input_bytes);
+    carry_bytes = input_bytes;
+    return written;
+}
+
+size_t PcmResampler::consumeFrame(const uint8_t* data, int16_t* output, size_t space) {
+    int16_t samples[2];
+    memcpy(samples, data, input_channels * sizeof(int16_t));
+    if (input_channels == 1) {
+        samples[1] = samples[0];
+    }
+    
+    if (!coefficients) {
+        if (space == 0) return 0;
+        output[0] = samples[0];
+        output[1] = samples[1];
+        return 1;
+    }
+    
+    for (int c = 0; c < 2; c++) {
+        history[c][head] = samples[c];
+        history[c][head + TAPS] = samples[c];
+    }
+    head = (head + 1) % TAPS;
+    
+    // Oldest to newest input sample, contiguous thanks to the double write
+    const int16_t* left = &history[0][head];
+    const int16_t* right = &history[1][head];
+    bool stereo = input_channels == 2;
+    
+    size_t written = 0;
+    while (position < OUTPUT_RATE) {
+        uint32_t fraction = (position << 16) / OUTPUT_RATE;
+        uint32_t phase = fraction >> BLEND_BITS;
+        int32_t blend = fraction & ((1 << BLEND_BITS) - 1);
+        const int16_t* c0 = coefficients + phase * TAPS;
+        const int16_t* c1 = c0 + TAPS;
+        
+        int32_t acc_left = 0;
+        int32_t acc_right = 0;
+        for (int k = 0; k < TAPS; k++) {
+            int32_t coefficient = c0[k] + (((c1[k] - c0[k]) * blend) >> BLEND_BITS);
+            acc_left += coefficient * left[k];
+            if (stereo) acc_right += coefficient * right[k];
+        }
+        
+        // Input sized with inputBytesFor() always fits; beyond that it is dropped
+        if (written < space) {
+            int16_t* frame = output + written * 2;
+            frame[0] = saturate((acc_left + 16384) >> 15);
+            frame[1] = stereo ? saturate((acc_right + 16384) >> 15) : frame[0];
+            written++;
+        }
+        position += input_rate;
+    }
+    position -= OUTPUT_RATE;
+    return written;
+}
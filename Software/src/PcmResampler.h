@@ -0,0 +1,62 @@
+#ifndef PCMRESAMPLER_H
+#define PCMRESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Converts 16-bit decoder PCM of any MP3 sample rate and 1 or 2 channels to
+// the 44.1 kHz stereo that A2DP expects. Rate conversion is a windowed-sinc
+// polyphase FIR: PHASES coefficient sets in Q15, linearly interpolated
+// between neighbouring phases, stepped by an exact rational position so the
+// output rate never drifts. Mono is duplicated to both channels. The filter
+// table is only allocated when the rates differ. No Arduino dependencies.
+class PcmResampler {
+public:
+    static const uint32_t OUTPUT_RATE = 44100;
+    static const int TAPS = 32;
+    static const int PHASES = 64;
+    
+private:
+    uint32_t input_rate;
+    uint16_t input_channels;
+    int16_t* coefficients;           // (PHASES + 1) rows of TAPS, Q15
+    int16_t history[2][TAPS * 2];    // Each sample written twice: the window is contiguous
+    int head;
+    uint32_t position;               // Next output time past the newest input, in 1/OUTPUT_RATE
+    uint8_t carry[4];                // Partial input frame left from the last call
+    size_t carry_bytes;
+    
+public:
+    PcmResampler();
+    ~PcmResampler();
+    
+    PcmResampler(const PcmResampler&) = delete;
+    PcmResampler& operator=(const PcmResampler&) = delete;
+    
+    // Rebuilds the filter for a new input format and resets the state
+    bool configure(uint32_t rate, uint16_t channels);
+    
+    // Clears filter history, e.g. after a seek; keeps the format
+    void reset();
+    
+    bool matches(uint32_t rate, uint16_t channels) const {
+        return rate == input_rate && channels == input_channels;
+    }
+    bool isPassthrough() const { return input_rate == OUTPUT_RATE && input_channels == 2; }
+    uint32_t getInputRate() const { return input_rate; }
+    uint16_t getInputChannels() const { return input_channels; }
+    
+    // Most input bytes whose output is sure to fit in output_bytes
+    size_t inputBytesFor(size_t output_bytes) const;
+    
+    // Consumes all of input; returns stereo frames written to output
+    size_t process(const uint8_t* input, size_t input_bytes, int16_t* output, size_t output_frames);
+    
+private:
+    void buildFilter();
+    
+    // Feeds one input frame; returns the output frames it completed
+    size_t consumeFrame(const uint8_t* data, int16_t* output, size_t space);
+};
+
+#endif
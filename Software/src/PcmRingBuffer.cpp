@@ -0,0 +1,127 @@
+#include "PcmRingBuffer.h"
+#include <cstdlib>
+#include <cstring>
+
+PcmRingBuffer::PcmRingBuffer() :
+    buffer(nullptr),
+    capacity(0),
+    mask(0),
+    write_pos(0),
+    read_pos(0),
+    spilled(false) {
+}
+
+PcmRingBuffer::~PcmRingBuffer() {
+    release();
+}
+
+bool PcmRingBuffer::allocate(size_t bytes) {
+    release();
+    if (bytes == 0) return false;
+    
+    size_t size = 1;
+    while (size < bytes) {
+        size <<= 1;
+    }
+    
+    buffer = static_cast<uint8_t*>(malloc(size));
+    if (!buffer) return false;
+    
+    capacity = size;
+    mask = size - 1;
+    write_pos.store(0, std::memory_order_relaxed);
+    read_pos.store(0, std::memory_order_relaxed);
+    spilled = false;
+    return true;
+}
+
+void PcmRingBuffer::release() {
+    free(buffer);
+    buffer = nullptr;
+    capacity = 0;
+    mask = 0;
+}
+
+size_t PcmRingBuffer::availableToWrite() const {
+    size_t w = write_pos.load(std::memory_order_relaxed);
+    size_t r = read_pos.load(std::memory_order_acquire);
+    return capacity - (w - r);
+}
+
+size_t PcmRingBuffer::write(const uint8_t* data, size_t len) {
+    size_t space = availableToWrite();
+    if (len > space) len = space;
+    if (len == 0) return 0;
+    
+    size_t w = write_pos.load(std::memory_order_relaxed);
+    size_t offset = w & mask;
+    size_t first = capacity - offset;
+    if (first > len) first = len;
+    
+    memcpy(buffer + offset, data, first);
+    memcpy(buffer, data + first, len - first);
+    
+    write_pos.store(w + len, std::memory_order_release);
+    return len;
+}
+
+size_t PcmRingBuffer::writeRegion(uint8_t** region) {
+    size_t space = availableToWrite();
+    size_t offset = write_pos.load(std::memory_order_relaxed) & mask;
+    size_t contiguous = capacity - offset;
+    
+    *region = buffer + offset;
+    spilled = false;
+    return space < contiguous ? space : contiguous;
+}
+
+size_t PcmRingBuffer::writeRegion(uint8_t** region, size_t minimum) {
+    size_t contiguous = writeRegion(region);
+    if (minimum > SPILL_BYTES) minimum = SPILL_BYTES;
+    if (contiguous >= minimum) return contiguous;
+    
+    // Too little before the wrap; worth it only if more is free after it
+    size_t space = availableToWrite();
+    if (space <= contiguous) return contiguous;
+    
+    *region = reinterpret_cast<uint8_t*>(spill);
+    spilled = true;
+    return space < SPILL_BYTES ? space : SPILL_BYTES;
+}
+
+void PcmRingBuffer::commitWrite(size_t len) {
+    if (spilled) {
+        spilled = false;
+        write(reinterpret_cast<const uint8_t*>(spill), len);
+        return;
+    }
+    size_t w = write_pos.load(std::memory_order_relaxed);
+    write_pos.store(w + len, std::memory_order_release);
+}
+
+size_t PcmRingBuffer::availableToRead() const {
+    size_t w = write_pos.load(std::memory_order_acquire);
+    size_t r = read_pos.load(std::memory_order_relaxed);
+    return w - r;
+}
+
+size_t PcmRingBuffer::read(uint8_t* data, size_t len) {
+    size_t filled = availableToRead();
+    if (len > filled) len = filled;
+    if (len == 0) return 0;
+    
+    size_t r = read_pos.load(std::memory_order_relaxed);
+    size_t offset = r & mask;
+    size_t first = capacity - offset;
+    if (first > len) first = len;
+    
+    memcpy(data, buffer + offset, first);
+    memcpy(data + first, buffer, len - first);
+    
+    read_pos.store(r + len, std::memory_order_release);
+    return len;
+}
+
+void PcmRingBuffer::discardAll() {
+    read_pos.store(write_pos.load(std::memory_order_acquire), std::memory_order_release);
+}
@@ -0,0 +1,55 @@
+#ifndef PCMRINGBUFFER_H
+#define PCMRINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer byte ring for decoded PCM.
+// The decoder task is the only writer, the A2DP callback the only reader.
+// Free of Arduino dependencies so it can be built and stressed on a host.
+class PcmRingBuffer {
+public:
+    static const size_t SPILL_BYTES = 256; // Largest minimum writeRegion() can honour
+    
+private:
+    uint8_t* buffer;
+    size_t capacity; // Always a power of two
+    size_t mask;
+    std::atomic<size_t> write_pos; // Free-running, owned by the producer
+    std::atomic<size_t> read_pos;  // Free-running, owned by the consumer
+    uint32_t spill[SPILL_BYTES / 4]; // Stands in for the storage just before the wrap
+    bool spilled;                    // Last region handed out was the spill area
+    
+public:
+    PcmRingBuffer();
+    ~PcmRingBuffer();
+    
+    PcmRingBuffer(const PcmRingBuffer&) = delete;
+    PcmRingBuffer& operator=(const PcmRingBuffer&) = delete;
+    
+    // Capacity is rounded up to the next power of two
+    bool allocate(size_t bytes);
+    void release();
+    size_t getCapacity() const { return capacity; }
+    
+    // Total bytes ever written/read; used to mark positions in the stream
+    size_t getWritePosition() const { return write_pos.load(std::memory_order_acquire); }
+    size_t getReadPosition() const { return read_pos.load(std::memory_order_acquire); }
+    
+    // Producer side
+    size_t availableToWrite() const;
+    size_t write(const uint8_t* data, size_t len);
+    size_t writeRegion(uint8_t** region); // Contiguous free space, no copy
+    // At least minimum bytes (up to SPILL_BYTES) whenever that much is free.
+    // Just before the wrap this is the spill area, copied across on commit.
+    size_t writeRegion(uint8_t** region, size_t minimum);
+    void commitWrite(size_t len);
+    
+    // Consumer side
+    size_t availableToRead() const;
+    size_t read(uint8_t* data, size_t len);
+    void discardAll();
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "PlaybackMetrics.h"
+
+uint32_t HistogramSnapshot::percentileUs(uint32_t percent) const {
+    if (total == 0) return 0;
+    
+    // Rank of the sample at this percentile, rounded up
+    uint64_t rank = ((uint64_t)total * percent + 99) / 100;
+    if (rank == 0) rank = 1;
+    
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS - 1; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint32_t upper = (2u << i) - 1;
+            return upper < max_us ? upper : max_us;
+        }
+    }
+    return max_us;
+}
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::record(uint32_t us) {
+    int bucket = 31 - __builtin_clz(us | 1);
+    if (bucket >= HistogramSnapshot::BUCKETS) bucket = HistogramSnapshot::BUCKETS - 1;
+    
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    
+    // Single writer, so a plain compare and store keeps the maximum
+    if (us > max_us.load(std::memory_order_relaxed)) {
+        max_us.store(us, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::snapshot(HistogramSnapshot& out) const {
+    // Not taken atomically as a whole: counts may be a sample apart
+    for (int i = 0; i < HistogramSnapshot::BUCKETS; i++) {
+        out.counts[i] = counts[i].load(std::memory_order_relaxed);
+    }
+    out.total = total.load(std::memory_order_relaxed);
+    out.max_us = max_us.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < HistogramSnapshot::BUCKETS; i++) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    max_us.store(0, std::memory_order_relaxed);
+}
+
+PlaybackMetrics::PlaybackMetrics() {
+    reset();
+}
+
+void PlaybackMetrics::noteCallback(size_t ring_fill, size_t silence) {
+    callbacks.fetch_add(1, std::memory_order_relaxed);
+    lowerTo(ring_low_water, ring_fill > UINT32_MAX ? UINT32_MAX : (uint32_t)ring_fill);
+    if (silence > 0) {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        silence_bytes.fetch_add((uint32_t)silence, std::memory_order_relaxed);
+    }
+}
+
+void PlaybackMetrics::noteFreeHeap(uint32_t free_bytes) {
+    lowerTo(heap_low_water, free_bytes);
+}
+
+void PlaybackMetrics::snapshot(PlaybackMetricsSnapshot& out) const {
+    callback_us.snapshot(out.callback);
+    decode_us.snapshot(out.decode);
+    sd_read_us.snapshot(out.sd_read);
+    out.callbacks = callbacks.load(std::memory_order_relaxed);
+    out.underruns = underruns.load(std::memory_order_relaxed);
+    out.silence_bytes = silence_bytes.load(std::memory_order_relaxed);
+    out.ring_low_water = ring_low_water.load(std::memory_order_relaxed);
+    out.heap_low_water = heap_low_water.load(std::memory_order_relaxed);
+}
+
+void PlaybackMetrics::reset() {
+    callback_us.reset();
+    decode_us.reset();
+    sd_read_us.reset();
+    callbacks.store(0, std::memory_order_relaxed);
+    underruns.store(0, std::memory_order_relaxed);
+    silence_bytes.store(0, std::memory_order_relaxed);
+    ring_low_water.store(UINT32_MAX, std::memory_order_relaxed);
+    heap_low_water.store(UINT32_MAX, std::memory_order_relaxed);
+}
+
+void PlaybackMetrics::lowerTo(std::atomic<uint32_t>& low_water, uint32_t value) {
+    // Each low-water mark has a single writer
+    if (value < low_water.load(std::memory_order_relaxed)) {
+        low_water.store(value, std::memory_order_relaxed);
+    }
+}
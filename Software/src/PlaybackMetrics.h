@@ -0,0 +1,82 @@
+#ifndef PLAYBACKMETRICS_H
+#define PLAYBACKMETRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Copy of a histogram taken for reporting
+struct HistogramSnapshot {
+    static const int BUCKETS = 16;
+    
+    uint32_t counts[BUCKETS];
+    uint32_t total;
+    uint32_t max_us;
+    
+    // Upper bound of the bucket holding the given percentile, capped at max_us
+    uint32_t percentileUs(uint32_t percent) const;
+};
+
+// Microsecond durations in power-of-two buckets: [0,2), [2,4), ... with
+// the last bucket open-ended (32 ms and up). record() only touches 32-bit
+// relaxed atomics, so it is wait-free from any task or the audio callback;
+// 64-bit atomics would take a lock on the ESP32. Each histogram has a
+// single writer; any task may take a snapshot.
+class LatencyHistogram {
+private:
+    std::atomic<uint32_t> counts[HistogramSnapshot::BUCKETS];
+    std::atomic<uint32_t> total;
+    std::atomic<uint32_t> max_us;
+    
+public:
+    LatencyHistogram();
+    
+    void record(uint32_t us);
+    void snapshot(HistogramSnapshot& out) const;
+    void reset();
+};
+
+struct PlaybackMetricsSnapshot {
+    HistogramSnapshot callback;
+    HistogramSnapshot decode;
+    HistogramSnapshot sd_read;
+    uint32_t callbacks;     // Callbacks while audio was flowing
+    uint32_t underruns;     // Callbacks that had to pad with silence
+    uint32_t silence_bytes; // Silence inserted by those callbacks
+    uint32_t ring_low_water; // Fewest PCM bytes buffered at a callback
+    uint32_t heap_low_water; // Least free heap seen by the decoder task
+};
+
+// Playback health: written from the audio callback and the decoder task
+// without locks or allocation, read on demand for the serial console. No
+// Arduino dependencies.
+class PlaybackMetrics {
+public:
+    LatencyHistogram callback_us; // Whole A2DP callback
+    LatencyHistogram decode_us;   // One decode step (one MP3 frame, two while crossfading)
+    LatencyHistogram sd_read_us;  // One SD read burst
+    
+private:
+    std::atomic<uint32_t> callbacks;
+    std::atomic<uint32_t> underruns;
+    std::atomic<uint32_t> silence_bytes;
+    std::atomic<uint32_t> ring_low_water;
+    std::atomic<uint32_t> heap_low_water;
+    
+public:
+    PlaybackMetrics();
+    
+    // Audio callback: PCM buffered when it started, and silence it had to add
+    void noteCallback(size_t ring_fill, size_t silence);
+    
+    // Decoder task
+    void noteFreeHeap(uint32_t free_bytes);
+    
+    void snapshot(PlaybackMetricsSnapshot& out) const;
+    void reset();
+    
+private:
+    static void lowerTo(std::atomic<uint32_t>& low_water, uint32_t value);
+};
+
+#endif
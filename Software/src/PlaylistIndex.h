@@ -0,0 +1,39 @@
+#ifndef PLAYLISTINDEX_H
+#define PLAYLISTINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+
+// On-card playlist index: this header followed by the TrackTable sections
+// (directory offsets, directory signatures, track entries, playlist file
+// entries, string arena),
+// stored exactly as they sit in memory so loading is a few bulk reads. Little-endian, as written
+// by the ESP32.
+struct PlaylistIndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t signature;       // Root listing signature the index was built against
+    uint32_t track_count;
+    uint32_t directory_count;
+    uint32_t arena_bytes;
+    uint32_t checksum;        // FNV-1a over the sections
+    uint32_t playlist_count;
+};
+
+static_assert(sizeof(PlaylistIndexHeader) == 32, "PlaylistIndexHeader must stay packed");
+
+static const uint32_t PLAYLIST_INDEX_MAGIC = 0x58494C50; // "PLIX"
+static const uint16_t PLAYLIST_INDEX_VERSION = 8;
+static const uint32_t FNV1A_OFFSET = 2166136261u;
+
+inline uint32_t fnv1a(const void* data, size_t len, uint32_t hash = FNV1A_OFFSET) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#endif
@@ -1,16 +1,80 @@
 #include "PlaylistManager.h"
+#include "PlaylistIndex.h"
+#include "AudioCodec.h"
+#include "M3uParser.h"
 #include <algorithm>
+#include <new>
+
+static const char* INDEX_FILE_NAME = ".playlist.idx";
+
+// Per-entry cost of the previous std::vector<String> storage: the String
+// object plus a heap block holding the path, with allocator bookkeeping.
+static const size_t STRING_HEAP_OVERHEAD = 8;
+
+// Directory entries listed between yields of the rescan task
+static const int RESCAN_YIELD_INTERVAL = 16;
+
+// Playlist files are read through a small stack buffer; entries past the
+// cap are dropped, so a huge file cannot exhaust the heap
+static const size_t PLAYLIST_READ_BYTES = 256;
+static const size_t PLAYLIST_MAX_ENTRIES = 4096;
+static const uint32_t PLAYLIST_UNRESOLVED_SHOWN = 3;
+
+// Name, size and modification time of a file the playlist is built from;
+// the signatures cover nothing else, so the player's own files never count
+static uint32_t hashEntry(File& entry, const String& name, uint32_t hash) {
+    uint32_t size = entry.size();
+    uint32_t modified = (uint32_t)entry.getLastWrite();
+    hash = fnv1a(name.c_str(), name.length(), hash);
+    hash = fnv1a(&size, sizeof(size), hash);
+    return fnv1a(&modified, sizeof(modified), hash);
+}
 
 PlaylistManager::PlaylistManager(const String& root) :
-    music_root(root) {
+    tracks(std::make_shared<TrackTable>()),
+    music_root(root),
+    card_signature(0),
+    needs_verification(false),
+    rescan_task(nullptr),
+    rescan_running(false),
+    last_diff() {
     if (!music_root.endsWith("/")) {
         music_root += "/";
     }
 }
 
-bool PlaylistManager::scanForMP3Files() {
-    clearPlaylist();
+bool PlaylistManager::loadOrScan() {
+    if (loadIndex()) {
+        Serial.printf("Loaded %d tracks from playlist index\n", getTrackCount());
+        return true;
+    }
     
+    Serial.println("Playlist index missing or stale, scanning card");
+    return scanForAudioFiles();
+}
+
+bool PlaylistManager::scanForAudioFiles() {
+    std::shared_ptr<TrackTable> table = std::make_shared<TrackTable>();
+    
+    Serial.println("Scanning for audio files in: " + music_root);
+    if (!buildTable(*table, false)) {
+        return false;
+    }
+    
+    std::atomic_store(&tracks, std::shared_ptr<const TrackTable>(table));
+    Serial.printf("Found %d audio files, %u playlists\n", table->size(), (unsigned)table->playlistCount());
+    if (table->getSkipped() > 0) {
+        Serial.printf("Skipped %u files with over-long names\n", (unsigned)table->getSkipped());
+    }
+    printMemoryUsage();
+    
+    if (!saveIndex(*table)) {
+        Serial.println("Failed to write playlist index");
+    }
+    return true;
+}
+
+bool PlaylistManager::buildTable(TrackTable& table, bool yield) {
     File root = SD.open(music_root);
     if (!root) {
         Serial.println("Failed to open music directory: " + music_root);
@@ -23,119 +87,537 @@ bool PlaylistManager::scanForMP3Files() {
         return false;
     }
     
-    Serial.println("Scanning for MP3 files in: " + music_root);
-    scanDirectory(root, "");
+    int listed = 0;
+    scanDirectory(root, "", table, yield, listed);
     root.close();
     
-    // Sort alphabetically
-    sortPlaylist();
-    
-    Serial.printf("Found %d MP3 files\n", playlist.size());
+    // Natural order, folder by folder
+    table.sort();
+    table.finish();
     return true;
 }
 
-void PlaylistManager::scanDirectory(File dir, const String& path) {
+void PlaylistManager::scanDirectory(File dir, const String& path, TrackTable& table, bool yield, int& listed) {
+    // Directory prefix from the SD card root, interned once by the table
+    String dir_prefix = path.isEmpty() ? music_root : music_root + path + "/";
+    dir_prefix.replace("//", "/");
+    
+    // Hash the listing while walking it; a rescan compares these to tell
+    // whether anything changed
+    uint32_t signature = FNV1A_OFFSET;
+    
     while (true) {
         File entry = dir.openNextFile();
         if (!entry) break;
         
         String entry_name = String(entry.name());
-        String full_path = path.isEmpty() ? entry_name : path + "/" + entry_name;
-        
-        // Normalize the path (remove double slashes)
-        full_path.replace("//", "/");
-        
         if (entry.isDirectory()) {
-            // Recursive scan of subdirectories
-            Serial.println("Scanning directory: " + full_path);
-            scanDirectory(entry, full_path);
-        } else if (hasMP3Extension(entry_name)) {
-            // Add the full path from the SD card root
-            String absolute_path = music_root + full_path;
-            absolute_path.replace("//", "/");
+            String full_path = path.isEmpty() ? entry_name : path + "/" + entry_name;
+            
+            // Normalize the path (remove double slashes)
+            full_path.replace("//", "/");
             
-            playlist.push_back(absolute_path);
-            Serial.println("Found: " + absolute_path);
+            // Recursive scan of subdirectories
+            scanDirectory(entry, full_path, table, yield, listed);
+        } else if (hasAudioExtension(entry_name)) {
+            table.add(dir_prefix.c_str(), entry_name.c_str());
+            signature = hashEntry(entry, entry_name, signature);
+        } else if (hasPlaylistExtension(entry_name)) {
+            table.addPlaylist(dir_prefix.c_str(), entry_name.c_str());
+            signature = hashEntry(entry, entry_name, signature);
         }
         
         entry.close();
+        
+        // Keep playback and serial control responsive during a rescan
+        if (yield && ++listed % RESCAN_YIELD_INTERVAL == 0) {
+            vTaskDelay(1);
+        }
     }
+    
+    table.setDirectorySignature(dir_prefix.c_str(), signature);
 }
 
-bool PlaylistManager::hasMP3Extension(const String& filename) {
+bool PlaylistManager::hasAudioExtension(const String& filename) {
+    // Only what AudioProcessor can decode; FLAC is recognised but not played
+    switch (codecForExtension(filename.c_str())) {
+        case AudioCodec::MP3:
+        case AudioCodec::AAC:
+        case AudioCodec::WAV:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool PlaylistManager::hasPlaylistExtension(const String& filename) {
     int dot_pos = filename.lastIndexOf('.');
     if (dot_pos < 0) return false;
     
     String extension = filename.substring(dot_pos + 1);
     extension.toLowerCase();
-    return extension == "mp3";
+    return extension == "m3u" || extension == "m3u8";
 }
 
-void PlaylistManager::clearPlaylist() {
-    playlist.clear();
+bool PlaylistManager::startRescan(int task_core, int task_priority) {
+    if (rescan_running.exchange(true)) {
+        return false;
+    }
+    
+    if (xTaskCreatePinnedToCore(rescanTaskEntry, "rescan", 8192, this,
+                                task_priority, &rescan_task, task_core) != pdPASS) {
+        rescan_task = nullptr;
+        rescan_running = false;
+        return false;
+    }
+    return true;
 }
 
-void PlaylistManager::sortPlaylist() {
-    std::sort(playlist.begin(), playlist.end());
+void PlaylistManager::rescanTaskEntry(void* param) {
+    PlaylistManager* self = static_cast<PlaylistManager*>(param);
+    self->runRescan();
+    self->rescan_task = nullptr;
+    self->rescan_running = false;
+    vTaskDelete(nullptr);
 }
 
-String PlaylistManager::getTrackPath(int index) const {
-    if (!isValidIndex(index)) {
+void PlaylistManager::runRescan() {
+    std::shared_ptr<const TrackTable> current = getTracks();
+    std::shared_ptr<TrackTable> table = std::make_shared<TrackTable>();
+    RescanDiff diff = {};
+    
+    if (!buildTable(*table, true)) {
+        Serial.println("Rescan failed");
+        return;
+    }
+    needs_verification = false;
+    
+    // Every directory listed as before: the current table is still exact.
+    // The index is only rewritten if the root listing it is checked
+    // against at boot moved on (an empty folder, say).
+    if (tableSignature(*table) == tableSignature(*current)) {
+        Serial.println("Rescan: playlist is up to date");
+        if (computeRootSignature() != card_signature && !saveIndex(*current)) {
+            Serial.println("Failed to write playlist index");
+        }
+        return;
+    }
+    
+    // Both tables are sorted, so one merge pass yields the add/remove diff
+    size_t i = 0;
+    size_t j = 0;
+    while (i < current->size() || j < table->size()) {
+        int order = i >= current->size() ? 1 :
+                    j >= table->size() ? -1 :
+                    TrackTable::comparePaths(*current, i, *table, j);
+        if (order < 0) {
+            diff.removed++;
+            i++;
+        } else if (order > 0) {
+            diff.added++;
+            j++;
+        } else {
+            i++;
+            j++;
+        }
+    }
+    last_diff = diff;
+    
+    Serial.printf("Rescan: +%u -%u tracks\n", (unsigned)diff.added, (unsigned)diff.removed);
+    
+    if (!saveIndex(*table)) {
+        Serial.println("Failed to write playlist index");
+    }
+    
+    std::atomic_store(&pending_tracks, std::shared_ptr<const TrackTable>(table));
+    if (rescan_ready_callback) {
+        rescan_ready_callback();
+    }
+}
+
+int PlaylistManager::applyRescan(int current_index) {
+    std::shared_ptr<const TrackTable> table = std::atomic_exchange(&pending_tracks, std::shared_ptr<const TrackTable>());
+    if (!table) {
+        return current_index;
+    }
+    
+    std::shared_ptr<const TrackTable> previous = getTracks();
+    int remapped = -1;
+    if (current_index >= 0 && current_index < (int)previous->size()) {
+        String path = String(previous->directory(current_index)) + previous->fileName(current_index);
+        remapped = table->findPath(path.c_str());
+    }
+    
+    std::atomic_store(&tracks, table);
+    
+    // Slots point into the old table: resolve the playlist file again,
+    // which also picks up any change to the file itself
+    std::shared_ptr<const PlaylistOrder> selected = std::atomic_load(&order);
+    if (selected) {
+        std::shared_ptr<PlaylistOrder> reloaded = std::make_shared<PlaylistOrder>();
+        if (loadPlaylist(selected->path, *table, *reloaded)) {
+            std::atomic_store(&order, std::shared_ptr<const PlaylistOrder>(reloaded));
+        } else {
+            std::atomic_store(&order, std::shared_ptr<const PlaylistOrder>());
+            Serial.println("Playlist file gone, playing the whole card");
+        }
+    }
+    return remapped;
+}
+
+String PlaylistManager::getPlaylistFilePath(int playlist) const {
+    std::shared_ptr<const TrackTable> table = getTracks();
+    if (playlist < 0 || playlist >= (int)table->playlistCount()) {
         return "";
     }
-    return playlist[index];
+    return String(table->playlistDirectory(playlist)) + table->playlistName(playlist);
 }
 
-String PlaylistManager::getTrackName(int index) const {
-    if (!isValidIndex(index)) {
-        return "Invalid";
+bool PlaylistManager::selectPlaylist(int playlist) {
+    if (playlist < 0) {
+        std::atomic_store(&order, std::shared_ptr<const PlaylistOrder>());
+        return true;
     }
     
-    String path = playlist[index];
+    std::shared_ptr<const TrackTable> table = getTracks();
+    String path = getPlaylistFilePath(playlist);
+    std::shared_ptr<PlaylistOrder> loaded = std::make_shared<PlaylistOrder>();
+    if (path.isEmpty() || !loadPlaylist(path, *table, *loaded) || loaded->tracks.empty()) {
+        return false;
+    }
+    std::atomic_store(&order, std::shared_ptr<const PlaylistOrder>(loaded));
+    return true;
+}
+
+bool PlaylistManager::loadPlaylist(const String& path, const TrackTable& table, PlaylistOrder& loaded) {
+    File file = SD.open(path);
+    if (!file) {
+        Serial.println("Failed to open playlist: " + path);
+        return false;
+    }
+    
+    loaded.path = path;
+    loaded.tracks.clear();
+    loaded.unresolved = 0;
+    uint32_t dropped = 0;
     
-    // Extract only the file name from the full path
-    int last_slash = path.lastIndexOf('/');
-    if (last_slash >= 0) {
-        path = path.substring(last_slash + 1);
+    // Each entry is looked up as it is parsed; FAT ignores case, and so
+    // do playlists written on a PC
+    M3uParser* parser = new (std::nothrow) M3uParser(path.c_str(), [&](const char* entry) {
+        int index = table.findPath(entry);
+        if (index < 0) index = table.findPath(entry, true);
+        if (index < 0) {
+            if (loaded.unresolved++ < PLAYLIST_UNRESOLVED_SHOWN) {
+                Serial.printf("Not on the card: %s\n", entry);
+            }
+        } else if (loaded.tracks.size() < PLAYLIST_MAX_ENTRIES) {
+            loaded.tracks.push_back(index);
+        } else {
+            dropped++;
+        }
+    });
+    if (!parser) {
+        file.close();
+        return false;
     }
     
-    // Remove the .mp3 extension
-    int dot_pos = path.lastIndexOf('.');
-    if (dot_pos > 0) {
-        path = path.substring(0, dot_pos);
+    uint8_t chunk[PLAYLIST_READ_BYTES];
+    while (true) {
+        size_t len = file.read(chunk, sizeof(chunk));
+        if (len == 0) break;
+        parser->feed(reinterpret_cast<const char*>(chunk), len);
     }
+    parser->finish();
+    uint32_t skipped = parser->getSkipped() + dropped;
+    delete parser;
+    file.close();
     
+    loaded.tracks.shrink_to_fit();
+    Serial.printf("Playlist %s: %u tracks, %u not found, %u skipped\n", path.c_str(),
+                  (unsigned)loaded.tracks.size(), (unsigned)loaded.unresolved, (unsigned)skipped);
+    return true;
+}
+
+String PlaylistManager::getSelectedPlaylist() const {
+    std::shared_ptr<const PlaylistOrder> selected = std::atomic_load(&order);
+    return selected ? selected->path : String();
+}
+
+size_t PlaylistManager::getOrderSize() const {
+    std::shared_ptr<const PlaylistOrder> selected = std::atomic_load(&order);
+    return selected ? selected->tracks.size() : getTrackCount();
+}
+
+int PlaylistManager::getOrderTrack(int slot) const {
+    std::shared_ptr<const PlaylistOrder> selected = std::atomic_load(&order);
+    if (!selected) {
+        return isValidIndex(slot) ? slot : -1;
+    }
+    return slot >= 0 && slot < (int)selected->tracks.size() ? (int)selected->tracks[slot] : -1;
+}
+
+int PlaylistManager::findOrderSlot(int track_index, int hint) const {
+    std::shared_ptr<const PlaylistOrder> selected = std::atomic_load(&order);
+    if (!selected) {
+        return isValidIndex(track_index) ? track_index : -1;
+    }
+    
+    const std::vector<uint32_t>& slots = selected->tracks;
+    if (hint >= 0 && hint < (int)slots.size() && (int)slots[hint] == track_index) {
+        return hint;
+    }
+    auto found = std::find(slots.begin(), slots.end(), (uint32_t)track_index);
+    return found != slots.end() ? (int)(found - slots.begin()) : -1;
+}
+
+void PlaylistManager::printPlaylistFiles() const {
+    std::shared_ptr<const TrackTable> table = getTracks();
+    String selected = getSelectedPlaylist();
+    Serial.println("\n--- Playlist Files ---");
+    
+    for (size_t i = 0; i < table->playlistCount(); i++) {
+        String path = String(table->playlistDirectory(i)) + table->playlistName(i);
+        Serial.printf("%s%2u: %s\n", path == selected ? " > " : "   ", (unsigned)(i + 1), path.c_str());
+    }
+    if (table->playlistCount() == 0) {
+        Serial.println("No .m3u/.m3u8 files found");
+    }
+    Serial.printf("%s 0: All tracks (%u)\n", selected.isEmpty() ? " > " : "   ", (unsigned)table->size());
+    Serial.println("----------------------");
+}
+
+String PlaylistManager::indexPath() const {
+    return music_root + INDEX_FILE_NAME;
+}
+
+uint32_t PlaylistManager::computeRootSignature() const {
+    // Checked at every boot, so it must not grow with the library: only
+    // the root's own listing, one open per top-level folder or file. That
+    // tells another card or a reorganised library from the one indexed;
+    // changes further down are found by the verification rescan, against
+    // the per-directory signatures kept in the index. The player's own
+    // files (indexes, resume log, loudness progress) never count.
+    File root = SD.open(music_root);
+    if (!root || !root.isDirectory()) {
+        return 0;
+    }
+    
+    uint32_t hash = FNV1A_OFFSET;
+    while (true) {
+        File entry = root.openNextFile();
+        if (!entry) break;
+        
+        String name = String(entry.name());
+        if (entry.isDirectory()) {
+            hash = fnv1a(name.c_str(), name.length(), hash);
+        } else if (hasAudioExtension(name) || hasPlaylistExtension(name)) {
+            hash = hashEntry(entry, name, hash);
+        }
+        entry.close();
+    }
+    root.close();
+    return hash;
+}
+
+uint32_t PlaylistManager::tableSignature(const TrackTable& table) {
+    // Every directory's own listing signature, as recorded by the scan
+    size_t count = table.directoryCount();
+    uint32_t hash = fnv1a(table.directorySignatureData(), count * sizeof(uint32_t));
+    for (size_t d = 0; d < count; d++) {
+        const char* prefix = table.directoryPrefix(d);
+        hash = fnv1a(prefix, strlen(prefix), hash);
+    }
+    return hash;
+}
+
+bool PlaylistManager::loadIndex() {
+    File in = SD.open(indexPath());
+    if (!in) return false;
+    
+    PlaylistIndexHeader header;
+    if (in.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != PLAYLIST_INDEX_MAGIC ||
+        header.version != PLAYLIST_INDEX_VERSION ||
+        header.header_size != sizeof(header)) {
+        in.close();
+        return false;
+    }
+    
+    size_t directory_bytes = header.directory_count * sizeof(uint32_t);
+    size_t entry_bytes = header.track_count * sizeof(TrackEntry);
+    size_t playlist_bytes = header.playlist_count * sizeof(TrackEntry);
+    uint32_t signature = computeRootSignature();
+    if (in.size() != sizeof(header) + 2 * directory_bytes + entry_bytes + playlist_bytes + header.arena_bytes ||
+        header.signature != signature) {
+        in.close();
+        return false;
+    }
+    
+    // Sections are stored in their in-memory layout: read them in place
+    std::shared_ptr<TrackTable> table = std::make_shared<TrackTable>();
+    bool ok = table->prepare(header.track_count, header.playlist_count, header.directory_count, header.arena_bytes) &&
+              in.read((uint8_t*)table->directoryData(), directory_bytes) == directory_bytes &&
+              in.read((uint8_t*)table->directorySignatureData(), directory_bytes) == directory_bytes &&
+              in.read((uint8_t*)table->entryData(), entry_bytes) == entry_bytes &&
+              in.read((uint8_t*)table->playlistData(), playlist_bytes) == playlist_bytes &&
+              in.read((uint8_t*)table->arenaData(), header.arena_bytes) == header.arena_bytes;
+    in.close();
+    
+    if (ok) {
+        uint32_t checksum = fnv1a(table->directoryData(), directory_bytes);
+        checksum = fnv1a(table->directorySignatureData(), directory_bytes, checksum);
+        checksum = fnv1a(table->entryData(), entry_bytes, checksum);
+        checksum = fnv1a(table->playlistData(), playlist_bytes, checksum);
+        checksum = fnv1a(table->arenaData(), header.arena_bytes, checksum);
+        ok = checksum == header.checksum && table->validate();
+    }
+    
+    if (!ok) {
+        return false;
+    }
+    
+    std::atomic_store(&tracks, std::shared_ptr<const TrackTable>(table));
+    card_signature = signature;
+    needs_verification = true;
+    return true;
+}
+
+bool PlaylistManager::saveIndex(const TrackTable& table) {
+    String path = indexPath();
+    File out = SD.open(path, FILE_WRITE);
+    if (!out) return false;
+    
+    size_t directory_bytes = table.directoryCount() * sizeof(uint32_t);
+    size_t entry_bytes = table.size() * sizeof(TrackEntry);
+    size_t playlist_bytes = table.playlistCount() * sizeof(TrackEntry);
+    
+    PlaylistIndexHeader header = {};
+    header.magic = PLAYLIST_INDEX_MAGIC;
+    header.version = PLAYLIST_INDEX_VERSION;
+    header.header_size = sizeof(header);
+    header.track_count = table.size();
+    header.directory_count = table.directoryCount();
+    header.arena_bytes = table.arenaSize();
+    header.playlist_count = table.playlistCount();
+    header.checksum = fnv1a(table.directoryData(), directory_bytes);
+    header.checksum = fnv1a(table.directorySignatureData(), directory_bytes, header.checksum);
+    header.checksum = fnv1a(table.entryData(), entry_bytes, header.checksum);
+    header.checksum = fnv1a(table.playlistData(), playlist_bytes, header.checksum);
+    header.checksum = fnv1a(table.arenaData(), table.arenaSize(), header.checksum);
+    
+    header.signature = computeRootSignature();
+    
+    bool ok = out.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              out.write((const uint8_t*)table.directoryData(), directory_bytes) == directory_bytes &&
+              out.write((const uint8_t*)table.directorySignatureData(), directory_bytes) == directory_bytes &&
+              out.write((const uint8_t*)table.entryData(), entry_bytes) == entry_bytes &&
+              out.write((const uint8_t*)table.playlistData(), playlist_bytes) == playlist_bytes &&
+              out.write((const uint8_t*)table.arenaData(), table.arenaSize()) == table.arenaSize();
+    out.close();
+    if (!ok) {
+        SD.remove(path);
+        return false;
+    }
+    
+    card_signature = header.signature;
+    return true;
+}
+
+void PlaylistManager::clearPlaylist() {
+    std::atomic_store(&tracks, std::shared_ptr<const TrackTable>(std::make_shared<TrackTable>()));
+}
+
+String PlaylistManager::getTrackPath(int index) const {
+    std::shared_ptr<const TrackTable> table = getTracks();
+    if (index < 0 || index >= (int)table->size()) {
+        return "";
+    }
+    
+    String path;
+    path.reserve(table->pathLength(index));
+    path += table->directory(index);
+    path += table->fileName(index);
     return path;
 }
 
+String PlaylistManager::getTrackName(int index) const {
+    std::shared_ptr<const TrackTable> table = getTracks();
+    if (index < 0 || index >= (int)table->size()) {
+        return "Invalid";
+    }
+    
+    // File name without the extension, offsets precomputed by the table
+    char name[TrackTable::MAX_NAME_LENGTH + 1];
+    size_t len = table->stemLength(index);
+    memcpy(name, table->fileName(index), len);
+    name[len] = '\0';
+    return String(name);
+}
+
+size_t PlaylistManager::searchTracks(const char* query, SearchMode mode, size_t offset, size_t limit,
+                                     std::vector<uint32_t>& page) {
+    std::shared_ptr<const TrackTable> table = getTracks();
+    if (table != search_table) {
+        // Drop the old index first, so both are never in memory at once
+        search_index.clear();
+        search_table = table;
+        
+        uint32_t started = millis();
+        search_index.build(*table, music_root.length());
+        Serial.printf("Search index: %u words, %u bytes, built in %u ms\n",
+                      (unsigned)search_index.wordCount(), (unsigned)search_index.memoryUsage(),
+                      (unsigned)(millis() - started));
+    }
+    return search_index.search(query, mode, offset, limit, page);
+}
+
 bool PlaylistManager::isValidIndex(int index) const {
-    return index >= 0 && index < (int)playlist.size();
+    return index >= 0 && index < (int)getTrackCount();
 }
 
 void PlaylistManager::printPlaylist(int current_index) const {
+    std::shared_ptr<const TrackTable> table = getTracks();
     Serial.println("\n--- Playlist ---");
     
-    if (playlist.empty()) {
+    if (table->size() == 0) {
         Serial.println("No tracks found");
         Serial.println("----------------");
         return;
     }
     
-    for (size_t i = 0; i < playlist.size(); i++) {
-        String marker = (i == current_index) ? " > " : "   ";
-        String track_name = getTrackName(i);
+    for (size_t i = 0; i < table->size(); i++) {
+        const char* marker = ((int)i == current_index) ? " > " : "   ";
         
-        Serial.printf("%s%2d: %s\n", 
-                     marker.c_str(), 
+        Serial.printf("%s%2d: %.*s\n", 
+                     marker, 
                      i + 1, 
-                     track_name.c_str());
+                     (int)table->stemLength(i),
+                     table->fileName(i));
         
         // Also show the full path for debugging (optional)
-        if (i == current_index) {
-            Serial.printf("     Path: %s\n", playlist[i].c_str());
+        if ((int)i == current_index) {
+            Serial.printf("     Path: %s%s\n", table->directory(i), table->fileName(i));
         }
     }
     
-    Serial.printf("Total: %d tracks\n", playlist.size());
+    Serial.printf("Total: %d tracks\n", table->size());
     Serial.println("----------------");
-}
\ No newline at end of file
+}
+
+void PlaylistManager::printMemoryUsage() const {
+    std::shared_ptr<const TrackTable> table = getTracks();
+    size_t count = table->size();
+    if (count == 0) return;
+    
+    size_t legacy = 0;
+    for (size_t i = 0; i < count; i++) {
+        legacy += sizeof(String) + ((table->pathLength(i) + 1 + 3) & ~(size_t)3) + STRING_HEAP_OVERHEAD;
+    }
+    
+    size_t used = table->memoryUsage();
+    Serial.printf("Playlist memory: %u bytes, %u bytes/track (String list: ~%u bytes/track), %u directories\n",
+                  (unsigned)used,
+                  (unsigned)(used / count),
+                  (unsigned)(legacy / count),
+                  (unsigned)table->directoryCount());
+}
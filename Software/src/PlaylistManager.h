@@ -3,34 +3,117 @@
 
 #include <Arduino.h>
 #include <SD.h>
-#include <vector>
+#include <atomic>
+#include <memory>
+#include "TrackTable.h"
+#include "TrackSearchIndex.h"
+
+// Outcome of a background rescan, relative to the table it replaces
+struct RescanDiff {
+    uint32_t added;
+    uint32_t removed;
+};
+
+typedef std::function<void()> RescanReadyCallback;
+
+// The tracks of one playlist file, as indices into the track table they
+// were resolved against: 4 bytes per entry, no path strings
+struct PlaylistOrder {
+    String path;              // The playlist file, to resolve it again after a rescan
+    std::vector<uint32_t> tracks;
+    uint32_t unresolved;      // Entries naming no track on the card
+};
 
 class PlaylistManager {
 private:
-    std::vector<String> playlist;
+    // Readers take a snapshot; a rescan swaps in a new table atomically
+    std::shared_ptr<const TrackTable> tracks;
+    std::shared_ptr<const TrackTable> pending_tracks; // Rescan result awaiting apply
     String music_root;
+    uint32_t card_signature; // Root listing the on-card index was written against
+    std::atomic<bool> needs_verification;
+    
+    TaskHandle_t rescan_task;
+    std::atomic<bool> rescan_running;
+    RescanReadyCallback rescan_ready_callback;
+    RescanDiff last_diff;
+    
+    // Built on the first search of each table, and kept with the table it
+    // points into
+    std::shared_ptr<const TrackTable> search_table;
+    TrackSearchIndex search_index;
+    
+    // Selected playlist file; none plays the whole card in table order
+    std::shared_ptr<const PlaylistOrder> order;
     
 public:
     PlaylistManager(const String& root = "/");
     
     // Playlist management
-    bool scanForMP3Files();
+    bool loadOrScan(); // Uses the on-card index when it is still valid
+    
+    // The table came from the on-card index, which is only checked against
+    // the root listing at boot: a rescan confirms the folders below
+    bool needsVerification() const { return needs_verification; }
+    bool scanForAudioFiles();
     void clearPlaylist();
-    void sortPlaylist();
+    
+    // Background rescan: one walk of the card, compared with the current
+    // table by its per-directory signatures. Only when something changed
+    // does the callback fire; applyRescan must then be called by the owner
+    // of the current track index to swap the table in.
+    void setRescanReadyCallback(RescanReadyCallback callback) { rescan_ready_callback = callback; }
+    bool startRescan(int task_core, int task_priority);
+    bool isRescanning() const { return rescan_running; }
+    int applyRescan(int current_index); // Returns the remapped index, -1 if gone
     
     // Data access
-    size_t getTrackCount() const { return playlist.size(); }
+    std::shared_ptr<const TrackTable> getTracks() const { return std::atomic_load(&tracks); }
+    size_t getTrackCount() const { return getTracks()->size(); }
     String getTrackPath(int index) const;
     String getTrackName(int index) const;
-    const std::vector<String>& getPlaylist() const { return playlist; }
+    const String& getMusicRoot() const { return music_root; }
+    
+    // Loop task only: the index is rebuilt here after the table changed.
+    // Fills page with matching track indices and returns the total count.
+    size_t searchTracks(const char* query, SearchMode mode, size_t offset, size_t limit,
+                        std::vector<uint32_t>& page);
+    
+    // Playlist files (.m3u/.m3u8) found by the scan, in table order
+    size_t getPlaylistFileCount() const { return getTracks()->playlistCount(); }
+    String getPlaylistFilePath(int playlist) const;
+    void printPlaylistFiles() const;
+    
+    // Play order: the whole card, or the tracks of the selected playlist
+    // file. A slot is a position in it; a playlist may hold a track in
+    // several slots. selectPlaylist() and applyRescan() run on the player
+    // task; -1 goes back to the whole card.
+    bool selectPlaylist(int playlist);
+    String getSelectedPlaylist() const;
+    size_t getOrderSize() const;
+    int getOrderTrack(int slot) const; // -1 outside the order
+    int findOrderSlot(int track_index, int hint = -1) const; // hint wins if it holds the track
     
     // Utilities
     bool isValidIndex(int index) const;
     void printPlaylist(int current_index = -1) const;
+    void printMemoryUsage() const;
     
 private:
-    bool hasMP3Extension(const String& filename);
-    void scanDirectory(File dir, const String& path = "");
+    static bool hasAudioExtension(const String& filename);
+    static bool hasPlaylistExtension(const String& filename);
+    bool loadPlaylist(const String& path, const TrackTable& table, PlaylistOrder& loaded);
+    bool buildTable(TrackTable& table, bool yield);
+    void scanDirectory(File dir, const String& path, TrackTable& table, bool yield, int& listed);
+    static void rescanTaskEntry(void* param);
+    void runRescan();
+    
+    // Persistent index
+    String indexPath() const;
+    uint32_t computeRootSignature() const;
+    static uint32_t tableSignature(const TrackTable& table);
+    bool loadIndex();
+    bool saveIndex(const TrackTable& table);
 };
 
-#endif
\ No newline at end of file
+#endif
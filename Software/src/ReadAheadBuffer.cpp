@@ -0,0 +1,159 @@
+#include "ReadAheadBuffer.h"
+#include <cstdlib>
+#include <cstring>
+
+ReadAheadBuffer::ReadAheadBuffer() :
+    front(0),
+    burst_size(0),
+    position(0),
+    source_position(0),
+    source_size(0),
+    source(nullptr),
+    clock(nullptr),
+    burst_histogram(nullptr) {
+    for (Block& block : blocks) {
+        block.data = nullptr;
+        block.offset = 0;
+        block.length = 0;
+        block.valid = false;
+    }
+    memset(&stats, 0, sizeof(stats));
+}
+
+ReadAheadBuffer::~ReadAheadBuffer() {
+    release();
+}
+
+bool ReadAheadBuffer::allocate(size_t burst_bytes) {
+    size_t size = (burst_bytes + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+    if (size == 0) size = SECTOR_SIZE;
+    
+    for (Block& block : blocks) {
+        free(block.data);
+        block.data = static_cast<uint8_t*>(malloc(size));
+        block.valid = false;
+        if (!block.data) return false;
+    }
+    
+    burst_size = size;
+    return true;
+}
+
+void ReadAheadBuffer::release() {
+    for (Block& block : blocks) {
+        free(block.data);
+        block.data = nullptr;
+        block.valid = false;
+    }
+    burst_size = 0;
+}
+
+void ReadAheadBuffer::attach(BlockReader* reader) {
+    source = reader;
+    source_size = reader ? reader->totalSize() : 0;
+    source_position = 0;
+    position = 0;
+    front = 0;
+    blocks[0].valid = false;
+    blocks[1].valid = false;
+}
+
+void ReadAheadBuffer::detach() {
+    attach(nullptr);
+}
+
+bool ReadAheadBuffer::contains(const Block& block, size_t pos) const {
+    return block.valid && pos >= block.offset && pos < block.offset + block.length;
+}
+
+bool ReadAheadBuffer::loadBlock(Block& block, size_t offset) {
+    block.valid = false;
+    if (!source || !block.data || offset >= source_size) return false;
+    
+    if (source_position != offset) {
+        if (!source->seekBlock(offset)) return false;
+        source_position = offset;
+    }
+    
+    size_t len = source_size - offset;
+    if (len > burst_size) len = burst_size;
+    
+    uint32_t start = clock ? clock() : 0;
+    size_t got = source->readBlock(block.data, len);
+    uint32_t elapsed = clock ? clock() - start : 0;
+    
+    stats.bursts++;
+    stats.bytes += got;
+    stats.busy_us += elapsed;
+    if (elapsed > stats.max_burst_us) stats.max_burst_us = elapsed;
+    if (burst_histogram) burst_histogram->record(elapsed);
+    
+    source_position += got;
+    if (got == 0) return false;
+    
+    block.offset = offset;
+    block.length = got;
+    block.valid = true;
+    return true;
+}
+
+const ReadAheadBuffer::Block* ReadAheadBuffer::blockFor(size_t pos) {
+    if (contains(blocks[front], pos)) {
+        return &blocks[front];
+    }
+    
+    // Moving on to the prefetched block frees the old one for the next burst
+    Block& back = blocks[front ^ 1];
+    if (contains(back, pos)) {
+        blocks[front].valid = false;
+        front ^= 1;
+        return &back;
+    }
+    
+    // Nothing buffered here: load synchronously at a burst-aligned offset
+    stats.stalls++;
+    size_t aligned = pos - pos % burst_size;
+    if (!loadBlock(blocks[front], aligned) || !contains(blocks[front], pos)) {
+        return nullptr;
+    }
+    return &blocks[front];
+}
+
+size_t ReadAheadBuffer::read(uint8_t* buffer, size_t len) {
+    size_t copied = 0;
+    while (copied < len && position < source_size) {
+        const Block* block = blockFor(position);
+        if (!block) break;
+        
+        size_t in_block = block->offset + block->length - position;
+        size_t n = len - copied < in_block ? len - copied : in_block;
+        memcpy(buffer + copied, block->data + (position - block->offset), n);
+        position += n;
+        copied += n;
+    }
+    return copied;
+}
+
+int ReadAheadBuffer::peek() {
+    if (position >= source_size) return -1;
+    const Block* block = blockFor(position);
+    return block ? block->data[position - block->offset] : -1;
+}
+
+bool ReadAheadBuffer::seek(size_t new_position) {
+    if (new_position > source_size) return false;
+    position = new_position;
+    return true;
+}
+
+bool ReadAheadBuffer::prefetch() {
+    const Block& current = blocks[front];
+    if (!current.valid) return false;
+    
+    size_t next_offset = current.offset + current.length;
+    Block& back = blocks[front ^ 1];
+    if (next_offset >= source_size || (back.valid && back.offset == next_offset)) {
+        return false;
+    }
+    return loadBlock(back, next_offset);
+}
@@ -0,0 +1,89 @@
+#ifndef READAHEADBUFFER_H
+#define READAHEADBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "PlaybackMetrics.h"
+
+// Where read bursts come from: the SD card on the device, a plain file on
+// a host build.
+class BlockReader {
+public:
+    virtual ~BlockReader() {}
+    virtual size_t readBlock(uint8_t* buffer, size_t len) = 0;
+    virtual bool seekBlock(size_t position) = 0;
+    virtual size_t totalSize() = 0;
+};
+
+struct ReadAheadStats {
+    uint32_t bursts;       // Block reads issued to the card
+    uint32_t stalls;       // Reads that had to wait for a burst
+    uint64_t bytes;        // Bytes fetched from the card
+    uint64_t busy_us;      // Time spent inside readBlock
+    uint32_t max_burst_us; // Slowest single burst
+    
+    uint32_t bytesPerSecond() const { return busy_us ? (uint32_t)(bytes * 1000000ULL / busy_us) : 0; }
+    uint32_t averageBurstUs() const { return bursts ? (uint32_t)(busy_us / bursts) : 0; }
+};
+
+typedef uint32_t (*MicrosClock)();
+
+// Double-buffered read-ahead over a BlockReader. Reads are issued as whole,
+// sector-aligned bursts; the consumer is served from memory while the other
+// buffer is refilled by prefetch(), so the card is idle between bursts.
+class ReadAheadBuffer {
+private:
+    struct Block {
+        uint8_t* data;
+        size_t offset;
+        size_t length;
+        bool valid;
+    };
+    
+    Block blocks[2];
+    int front;
+    size_t burst_size;
+    size_t position;
+    size_t source_position; // Where the reader's file pointer currently is
+    size_t source_size;
+    BlockReader* source;
+    MicrosClock clock;
+    ReadAheadStats stats;
+    LatencyHistogram* burst_histogram;
+    
+public:
+    static const size_t SECTOR_SIZE = 512;
+    
+    ReadAheadBuffer();
+    ~ReadAheadBuffer();
+    
+    ReadAheadBuffer(const ReadAheadBuffer&) = delete;
+    ReadAheadBuffer& operator=(const ReadAheadBuffer&) = delete;
+    
+    // Burst size is rounded up to a whole number of sectors
+    bool allocate(size_t burst_bytes);
+    void release();
+    void setClock(MicrosClock now_us) { clock = now_us; }
+    void setHistogram(LatencyHistogram* histogram) { burst_histogram = histogram; }
+    
+    void attach(BlockReader* reader);
+    void detach();
+    
+    size_t read(uint8_t* buffer, size_t len);
+    int peek();
+    size_t available() const { return position < source_size ? source_size - position : 0; }
+    size_t getPosition() const { return position; }
+    bool seek(size_t new_position);
+    
+    // Fills the idle buffer with the next burst; true if a burst was read
+    bool prefetch();
+    
+    const ReadAheadStats& getStats() const { return stats; }
+    
+private:
+    bool contains(const Block& block, size_t pos) const;
+    bool loadBlock(Block& block, size_t offset);
+    const Block* blockFor(size_t pos);
+};
+
+#endif
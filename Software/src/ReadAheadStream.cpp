@@ -0,0 +1,60 @@
+#include "ReadAheadStream.h"
+
+static uint32_t clockMicros() {
+    return micros();
+}
+
+ReadAheadStream::ReadAheadStream() {
+    buffer.setClock(clockMicros);
+}
+
+bool ReadAheadStream::begin(size_t burst_bytes) {
+    return buffer.allocate(burst_bytes);
+}
+
+bool ReadAheadStream::open(const String& filepath) {
+    close();
+    file = SD.open(filepath);
+    if (!file) {
+        return false;
+    }
+    buffer.attach(this);
+    return true;
+}
+
+void ReadAheadStream::close() {
+    buffer.detach();
+    if (file) {
+        file.close();
+    }
+}
+
+int ReadAheadStream::available() {
+    size_t remaining = buffer.available();
+    return remaining > INT32_MAX ? INT32_MAX : (int)remaining;
+}
+
+int ReadAheadStream::read() {
+    uint8_t value;
+    return buffer.read(&value, 1) == 1 ? value : -1;
+}
+
+int ReadAheadStream::peek() {
+    return buffer.peek();
+}
+
+size_t ReadAheadStream::readBytes(char* data, size_t len) {
+    return buffer.read(reinterpret_cast<uint8_t*>(data), len);
+}
+
+size_t ReadAheadStream::readBlock(uint8_t* data, size_t len) {
+    return file.read(data, len);
+}
+
+bool ReadAheadStream::seekBlock(size_t position) {
+    return file.seek(position);
+}
+
+size_t ReadAheadStream::totalSize() {
+    return file.size();
+}
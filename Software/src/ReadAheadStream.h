@@ -0,0 +1,47 @@
+#ifndef READAHEADSTREAM_H
+#define READAHEADSTREAM_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "ReadAheadBuffer.h"
+
+// Arduino Stream over an SD file that fetches data in large aligned bursts,
+// so the decoder's small reads never turn into small SPI transactions.
+class ReadAheadStream : public Stream, private BlockReader {
+private:
+    File file;
+    ReadAheadBuffer buffer;
+    
+public:
+    ReadAheadStream();
+    
+    bool begin(size_t burst_bytes);
+    void end() { close(); buffer.release(); }
+    bool open(const String& filepath);
+    void close();
+    bool isOpen() { return (bool)file; }
+    
+    // Reads the next burst ahead of time; call when the decoder is idle
+    bool prefetch() { return buffer.prefetch(); }
+    bool seek(size_t position) { return buffer.seek(position); }
+    size_t position() const { return buffer.getPosition(); }
+    size_t size() const { return file ? file.size() : 0; }
+    const ReadAheadStats& getStats() const { return buffer.getStats(); }
+    void setLatencyHistogram(LatencyHistogram* histogram) { buffer.setHistogram(histogram); }
+    
+    // Stream
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char* data, size_t len) override;
+    using Stream::readBytes;
+    size_t write(uint8_t) override { return 0; }
+    
+private:
+    // BlockReader
+    size_t readBlock(uint8_t* data, size_t len) override;
+    bool seekBlock(size_t position) override;
+    size_t totalSize() override;
+};
+
+#endif
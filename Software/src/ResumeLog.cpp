@@ -0,0 +1,116 @@
+#include "ResumeLog.h"
+#include "PlaylistIndex.h"
+#include <cstring>
+
+static const uint32_t RESUME_RECORD_MAGIC = 0x4D535252; // "RRSM"
+
+ResumeLog::ResumeLog(LogStorage& first, LogStorage& second, size_t records) :
+    active(0),
+    records_per_bank(records < 2 ? 2 : records),
+    active_records(0),
+    sequence(0),
+    needs_compaction(false) {
+    banks[0] = &first;
+    banks[1] = &second;
+}
+
+uint32_t ResumeLog::recordChecksum(const ResumeRecord& record) {
+    return fnv1a(&record, offsetof(ResumeRecord, checksum));
+}
+
+bool ResumeLog::scanBank(LogStorage& bank, ResumeRecord& newest, size_t& valid_records, bool& clean) {
+    size_t bytes = bank.size();
+    bool found = false;
+    valid_records = 0;
+    clean = bytes % sizeof(ResumeRecord) == 0;
+    
+    for (size_t position = 0; position + sizeof(ResumeRecord) <= bytes; position += sizeof(ResumeRecord)) {
+        ResumeRecord record;
+        if (bank.readAt(position, reinterpret_cast<uint8_t*>(&record), sizeof(record)) != sizeof(record) ||
+            record.magic != RESUME_RECORD_MAGIC || record.checksum != recordChecksum(record)) {
+            clean = false;
+            continue;
+        }
+        
+        valid_records++;
+        if (!found || (int32_t)(record.sequence - newest.sequence) > 0) {
+            newest = record;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool ResumeLog::load(ResumePoint& point) {
+    ResumeRecord newest[2];
+    size_t counts[2];
+    bool clean[2];
+    bool found[2];
+    for (int i = 0; i < 2; i++) {
+        found[i] = scanBank(*banks[i], newest[i], counts[i], clean[i]);
+    }
+    
+    if (!found[0] && !found[1]) {
+        // Nothing usable: start over in bank 0
+        active = 0;
+        active_records = 0;
+        sequence = 0;
+        needs_compaction = banks[0]->size() > 0 || banks[1]->size() > 0;
+        return false;
+    }
+    
+    // Both banks hold records only if a compaction was cut short
+    if (found[0] && found[1]) {
+        active = (int32_t)(newest[1].sequence - newest[0].sequence) > 0 ? 1 : 0;
+    } else {
+        active = found[0] ? 0 : 1;
+    }
+    
+    const ResumeRecord& record = newest[active];
+    sequence = record.sequence;
+    active_records = counts[active];
+    needs_compaction = !clean[active] || (found[0] && found[1]);
+    
+    point.track_index = record.track_index;
+    point.path_hash = record.path_hash;
+    point.byte_offset = record.byte_offset;
+    point.position_ms = record.position_ms;
+    return true;
+}
+
+bool ResumeLog::writeRecord(LogStorage& bank, const ResumePoint& point) {
+    ResumeRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = RESUME_RECORD_MAGIC;
+    record.sequence = sequence + 1;
+    record.track_index = point.track_index;
+    record.path_hash = point.path_hash;
+    record.byte_offset = point.byte_offset;
+    record.position_ms = point.position_ms;
+    record.checksum = recordChecksum(record);
+    
+    if (!bank.append(reinterpret_cast<const uint8_t*>(&record), sizeof(record))) {
+        return false;
+    }
+    sequence = record.sequence;
+    return true;
+}
+
+bool ResumeLog::append(const ResumePoint& point) {
+    if (!needs_compaction && active_records < records_per_bank) {
+        if (!writeRecord(*banks[active], point)) return false;
+        active_records++;
+        return true;
+    }
+    
+    // Compact: newest record goes into the other bank before this one is erased
+    int target = active ^ 1;
+    if (!banks[target]->erase() || !writeRecord(*banks[target], point)) {
+        return false;
+    }
+    banks[active]->erase();
+    active = target;
+    active_records = 1;
+    needs_compaction = false;
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef RESUMELOG_H
+#define RESUMELOG_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Append-only backing store for the resume log: an SD file on the device,
+// a plain file on a host build.
+class LogStorage {
+public:
+    virtual ~LogStorage() {}
+    virtual size_t size() = 0;
+    virtual size_t readAt(size_t position, uint8_t* buffer, size_t len) = 0;
+    virtual bool append(const uint8_t* data, size_t len) = 0;
+    virtual bool erase() = 0;
+};
+
+struct ResumePoint {
+    int32_t track_index;
+    uint32_t path_hash;    // FNV-1a of the track path, survives a rescan
+    uint32_t byte_offset;  // Frame-aligned offset to seek straight to
+    uint32_t position_ms;  // Track time at byte_offset
+};
+
+struct ResumeRecord {
+    uint32_t magic;
+    uint32_t sequence;
+    int32_t track_index;
+    uint32_t path_hash;
+    uint32_t byte_offset;
+    uint32_t position_ms;
+    uint32_t reserved;
+    uint32_t checksum;     // FNV-1a over the fields above
+};
+
+static_assert(sizeof(ResumeRecord) == 32, "ResumeRecord must stay packed");
+
+// Checkpoints as fixed-size records appended to one of two banks. A full
+// bank is compacted by writing the newest record into the other bank and
+// only then erasing the full one, so a power cut at any point leaves a
+// valid record behind. Each checkpoint costs one small append instead of a
+// rewrite of the same sectors. No Arduino dependencies.
+class ResumeLog {
+private:
+    LogStorage* banks[2];
+    int active;
+    size_t records_per_bank;
+    size_t active_records;
+    uint32_t sequence;
+    bool needs_compaction; // Active bank has a torn or foreign tail
+    
+public:
+    ResumeLog(LogStorage& first, LogStorage& second, size_t records_per_bank);
+    
+    // Newest valid record over both banks; false if there is none
+    bool load(ResumePoint& point);
+    bool append(const ResumePoint& point);
+    
+    int getActiveBank() const { return active; }
+    size_t getActiveRecords() const { return active_records; }
+    uint32_t getSequence() const { return sequence; }
+    
+private:
+    bool scanBank(LogStorage& bank, ResumeRecord& newest, size_t& valid_records, bool& clean);
+    bool writeRecord(LogStorage& bank, const ResumePoint& point);
+    static uint32_t recordChecksum(const ResumeRecord& record);
+};
+
+#endif
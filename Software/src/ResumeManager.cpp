@@ -0,0 +1,86 @@
+#include "ResumeManager.h"
+
+static const char* RESUME_BANK_NAMES[2] = { ".resume.0", ".resume.1" };
+
+// 4 KB per bank before it is compacted into the other one
+static const size_t RESUME_RECORDS_PER_BANK = 128;
+
+size_t SdLogStorage::size() {
+    File file = SD.open(path);
+    if (!file) return 0;
+    size_t bytes = file.size();
+    file.close();
+    return bytes;
+}
+
+size_t SdLogStorage::readAt(size_t position, uint8_t* buffer, size_t len) {
+    File file = SD.open(path);
+    if (!file) return 0;
+    size_t got = file.seek(position) ? file.read(buffer, len) : 0;
+    file.close();
+    return got;
+}
+
+bool SdLogStorage::append(const uint8_t* data, size_t len) {
+    File file = SD.open(path, FILE_APPEND);
+    if (!file) return false;
+    size_t written = file.write(data, len);
+    file.close();
+    return written == len;
+}
+
+bool SdLogStorage::erase() {
+    return !SD.exists(path) || SD.remove(path);
+}
+
+ResumeManager::ResumeManager(const String& root) :
+    log(banks[0], banks[1], RESUME_RECORDS_PER_BANK),
+    has_saved(false),
+    interval_ms(0),
+    last_write_ms(0) {
+    String prefix = root;
+    if (!prefix.endsWith("/")) {
+        prefix += "/";
+    }
+    for (int i = 0; i < 2; i++) {
+        banks[i].setPath(prefix + RESUME_BANK_NAMES[i]);
+    }
+}
+
+bool ResumeManager::begin(uint32_t checkpoint_interval_ms) {
+    interval_ms = checkpoint_interval_ms;
+    has_saved = log.load(saved);
+    if (has_saved) {
+        Serial.printf("Resume point: track %d at %u ms (bank %d, %u records)\n",
+                      (int)saved.track_index, (unsigned)saved.position_ms,
+                      log.getActiveBank(), (unsigned)log.getActiveRecords());
+    }
+    return has_saved;
+}
+
+bool ResumeManager::getResumePoint(ResumePoint& point) const {
+    if (!has_saved) return false;
+    point = saved;
+    return true;
+}
+
+bool ResumeManager::checkpoint(const ResumePoint& point, bool force) {
+    if (!force && !isDue()) {
+        return false;
+    }
+    
+    if (has_saved && saved.track_index == point.track_index &&
+        saved.path_hash == point.path_hash && saved.byte_offset == point.byte_offset) {
+        return false;
+    }
+    
+    if (!log.append(point)) {
+        Serial.println("Failed to write resume checkpoint");
+        return false;
+    }
+    
+    saved = point;
+    has_saved = true;
+    last_write_ms = millis();
+    return true;
+}
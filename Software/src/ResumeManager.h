@@ -0,0 +1,44 @@
+#ifndef RESUMEMANAGER_H
+#define RESUMEMANAGER_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "ResumeLog.h"
+
+// One bank of the resume log, kept as a file on the SD card
+class SdLogStorage : public LogStorage {
+private:
+    String path;
+    
+public:
+    void setPath(const String& file_path) { path = file_path; }
+    size_t size() override;
+    size_t readAt(size_t position, uint8_t* buffer, size_t len) override;
+    bool append(const uint8_t* data, size_t len) override;
+    bool erase() override;
+};
+
+// Remembers where playback was, so a power cycle resumes at the same track
+// and position. Checkpoints are throttled; forced ones (pause, stop,
+// disconnect) still skip the write when nothing has changed.
+class ResumeManager {
+private:
+    SdLogStorage banks[2];
+    ResumeLog log;
+    ResumePoint saved;
+    bool has_saved;
+    uint32_t interval_ms;
+    uint32_t last_write_ms;
+    
+public:
+    ResumeManager(const String& root = "/");
+    
+    // Loads the last checkpoint from the card
+    bool begin(uint32_t checkpoint_interval_ms);
+    
+    bool getResumePoint(ResumePoint& point) const;
+    bool isDue() const { return !has_saved || millis() - last_write_ms >= interval_ms; }
+    bool checkpoint(const ResumePoint& point, bool force);
+};
+
+#endif
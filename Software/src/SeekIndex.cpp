@@ -0,0 +1,148 @@
+#include "SeekIndex.h"
+#include <cstring>
+
+// Frames compared before a file without a VBR header is taken to be CBR
+static const uint32_t CBR_PROBE_FRAMES = 64;
+
+// Buffer for the header walk; frames are read 4 bytes at a time
+static const size_t WALK_BURST_BYTES = 4096;
+
+SeekIndex::SeekIndex() {
+    clear();
+}
+
+void SeekIndex::clear() {
+    mode = Mode::NONE;
+    memset(&info, 0, sizeof(info));
+    duration_ms = 0;
+    frame_offsets.clear();
+}
+
+bool SeekIndex::build(BlockReader& reader) {
+    clear();
+    
+    TrackMetadata metadata;
+    Mp3HeaderParser parser(reader);
+    if (!parser.parse(metadata, info)) {
+        return false;
+    }
+    duration_ms = metadata.duration_ms;
+    
+    if (info.stream_bytes == 0) {
+        info.stream_bytes = info.audio_end - info.first_frame;
+    }
+    
+    if (info.has_toc && duration_ms > 0) {
+        mode = Mode::TOC;
+        return true;
+    }
+    
+    // No TOC: a short probe tells CBR from VBR; only VBR pays for the walk
+    if (!scanFrames(reader, false)) {
+        mode = Mode::CONSTANT;
+        return true;
+    }
+    scanFrames(reader, true);
+    mode = frame_offsets.empty() ? Mode::CONSTANT : Mode::FRAME_INDEX;
+    return true;
+}
+
+bool SeekIndex::scanFrames(BlockReader& reader, bool full_walk) {
+    ReadAheadBuffer buffer;
+    if (!buffer.allocate(WALK_BURST_BYTES)) return false;
+    
+    // The parser left the file pointer elsewhere; attach() assumes 0
+    if (!reader.seekBlock(0)) return false;
+    buffer.attach(&reader);
+    
+    uint32_t position = info.first_frame;
+    uint32_t frames = 0;
+    uint32_t first_bitrate = 0;
+    bool variable = false;
+    
+    if (full_walk) {
+        frame_offsets.clear();
+        frame_offsets.reserve((info.audio_end - info.first_frame) / 400 / FRAMES_PER_ENTRY + 1);
+    }
+    
+    while (position + 4 <= info.audio_end) {
+        uint8_t header[4];
+        Mp3StreamInfo frame = info;
+        uint32_t frame_bytes;
+        if (!buffer.seek(position) || buffer.read(header, sizeof(header)) != sizeof(header) ||
+            !Mp3HeaderParser::parseFrameHeader(header, frame, frame_bytes) || frame_bytes < 4) {
+            break; // Lost sync: index what we have
+        }
+        
+        if (full_walk) {
+            if (frames % FRAMES_PER_ENTRY == 0) {
+                frame_offsets.push_back(position);
+            }
+        } else {
+            if (frames == 0) first_bitrate = frame.bitrate;
+            if (frame.bitrate != first_bitrate) {
+                variable = true;
+                break;
+            }
+            if (frames >= CBR_PROBE_FRAMES) break;
+        }
+        
+        position += frame_bytes;
+        frames++;
+    }
+    
+    buffer.detach();
+    
+    if (full_walk && frames > 0 && info.sample_rate > 0) {
+        duration_ms = (uint32_t)((uint64_t)frames * info.samples_per_frame * 1000 / info.sample_rate);
+    }
+    return variable;
+}
+
+uint32_t SeekIndex::offsetForTime(uint32_t position_ms, uint32_t& actual_ms) const {
+    actual_ms = position_ms;
+    
+    switch (mode) {
+        case Mode::TOC: {
+            if (position_ms >= duration_ms) {
+                actual_ms = duration_ms;
+                return info.audio_end;
+            }
+            
+            // Interpolate between the two TOC points around this percentage
+            uint32_t scaled = (uint32_t)((uint64_t)position_ms * 100 * 256 / duration_ms);
+            uint32_t percent = scaled >> 8;
+            uint32_t fraction = scaled & 0xFF;
+            uint32_t a = info.toc[percent];
+            uint32_t b = percent < 99 ? info.toc[percent + 1] : 256;
+            uint32_t toc_position = a * 256 + (b - a) * fraction; // In 1/65536 of the stream
+            return info.first_frame + (uint32_t)((uint64_t)toc_position * info.stream_bytes >> 16);
+        }
+        
+        case Mode::FRAME_INDEX: {
+            uint64_t frame = (uint64_t)position_ms * info.sample_rate / (1000ULL * info.samples_per_frame);
+            size_t entry = frame / FRAMES_PER_ENTRY;
+            if (entry >= frame_offsets.size()) {
+                actual_ms = duration_ms;
+                return info.audio_end;
+            }
+            actual_ms = (uint32_t)((uint64_t)entry * FRAMES_PER_ENTRY * info.samples_per_frame * 1000 / info.sample_rate);
+            return frame_offsets[entry];
+        }
+        
+        case Mode::CONSTANT: {
+            uint64_t offset = info.first_frame + (uint64_t)position_ms * info.bitrate / 8000;
+            if (offset >= info.audio_end) {
+                actual_ms = duration_ms;
+                return info.audio_end;
+            }
+            return (uint32_t)offset;
+        }
+        
+        case Mode::NONE:
+            break;
+    }
+    
+    actual_ms = 0;
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Mp3HeaderParser.h"
+#include "ReadAheadBuffer.h"
+
+// Maps a playback time to a byte offset in an MP3 file. Uses the Xing/VBRI
+// TOC when there is one; otherwise checks whether the bitrate varies and,
+// only for such VBR files, walks the frame headers once to build an index
+// of every FRAMES_PER_ENTRY-th frame. Constant-bitrate files are mapped
+// linearly. No Arduino dependencies.
+class SeekIndex {
+public:
+    enum class Mode {
+        NONE,
+        TOC,
+        FRAME_INDEX,
+        CONSTANT
+    };
+    
+    static const uint32_t FRAMES_PER_ENTRY = 16;
+    
+private:
+    Mode mode;
+    Mp3StreamInfo info;
+    uint32_t duration_ms;
+    std::vector<uint32_t> frame_offsets;
+    
+public:
+    SeekIndex();
+    
+    void clear();
+    bool build(BlockReader& reader);
+    
+    Mode getMode() const { return mode; }
+    uint32_t getDurationMs() const { return duration_ms; }
+    const Mp3StreamInfo& getStreamInfo() const { return info; }
+    
+    // Byte offset to resume decoding from; actual_ms is the time it maps to
+    uint32_t offsetForTime(uint32_t position_ms, uint32_t& actual_ms) const;
+    
+private:
+    bool scanFrames(BlockReader& reader, bool full_walk);
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "SerialCommandParser.h"
+
+SerialCommandParser::SerialCommandParser() {
+    reset();
+}
+
+void SerialCommandParser::reset() {
+    state = State::START;
+    current.name = 0;
+    current.has_argument = false;
+    current.argument = 0;
+    current.text[0] = '\0';
+    current.syntax = CommandSyntax::OK;
+    negative = false;
+    text_length = 0;
+}
+
+bool SerialCommandParser::feed(char c, SerialCommand& command) {
+    if (isTerminator(c)) {
+        if (state == State::START) return false;
+        if (state == State::SIGN) current.syntax = CommandSyntax::MALFORMED;
+        return finish(command);
+    }
+    if (state == State::TEXT) {
+        addText(c);
+        return false;
+    }
+    if (isSpace(c)) {
+        if (state == State::ARGUMENT) state = State::TRAILING;
+        return false;
+    }
+    
+    // Control characters and anything outside ASCII never belong to a command
+    bool printable = c > ' ' && c < 127;
+    
+    switch (state) {
+        case State::START:
+            if (!printable) return false; // Line noise between commands
+            if (isDigit(c)) {
+                current.name = 't';
+                addDigit(c);
+            } else if (takesText(c)) {
+                current.name = c;
+                state = State::TEXT;
+            } else {
+                current.name = c;
+                state = State::NAME;
+            }
+            break;
+        
+        case State::NAME:
+            if (c == '-') {
+                negative = true;
+                state = State::SIGN;
+            } else if (isDigit(c)) {
+                addDigit(c);
+            } else {
+                current.syntax = CommandSyntax::MALFORMED;
+                state = State::DISCARD;
+            }
+            break;
+        
+        case State::SIGN:
+        case State::ARGUMENT:
+            if (isDigit(c)) {
+                addDigit(c);
+            } else {
+                current.syntax = CommandSyntax::MALFORMED;
+                state = State::DISCARD;
+            }
+            break;
+        
+        case State::TRAILING:
+            current.syntax = CommandSyntax::MALFORMED;
+            state = State::DISCARD;
+            break;
+        
+        case State::TEXT:
+        case State::DISCARD:
+            break;
+    }
+    return false;
+}
+
+void SerialCommandParser::addDigit(char c) {
+    state = State::ARGUMENT;
+    current.has_argument = true;
+    if (current.syntax != CommandSyntax::OK) return;
+    
+    int32_t magnitude = negative ? -current.argument : current.argument;
+    magnitude = magnitude * 10 + (c - '0');
+    if (magnitude > MAX_ARGUMENT) {
+        current.syntax = CommandSyntax::TOO_LARGE;
+        state = State::DISCARD;
+        return;
+    }
+    current.argument = negative ? -magnitude : magnitude;
+}
+
+void SerialCommandParser::addText(char c) {
+    // Leading spaces are dropped here, trailing ones in finish(). Bytes
+    // outside ASCII are kept so UTF-8 names can be searched.
+    if (isSpace(c) && text_length == 0) return;
+    if ((unsigned char)c < ' ') return;
+    if (text_length == MAX_TEXT) {
+        current.syntax = CommandSyntax::TOO_LARGE;
+        state = State::DISCARD;
+        return;
+    }
+    current.text[text_length++] = c;
+    current.text[text_length] = '\0';
+}
+
+bool SerialCommandParser::finish(SerialCommand& command) {
+    while (text_length > 0 && isSpace(current.text[text_length - 1])) {
+        current.text[--text_length] = '\0';
+    }
+    command = current;
+    reset();
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef SERIALCOMMANDPARSER_H
+#define SERIALCOMMANDPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class CommandSyntax {
+    OK,
+    MALFORMED, // Unexpected character
+    TOO_LARGE  // Argument beyond MAX_ARGUMENT or text beyond MAX_TEXT
+};
+
+static const size_t SERIAL_COMMAND_MAX_TEXT = 32;
+
+struct SerialCommand {
+    char name;
+    bool has_argument;
+    int32_t argument;
+    char text[SERIAL_COMMAND_MAX_TEXT + 1]; // Text commands only, NUL-terminated
+    CommandSyntax syntax;
+};
+
+// Incremental parser for the serial control protocol. A command is one
+// character, optionally followed by a signed decimal argument ("n", "j90",
+// "v-20", "a12"); a command starting with a digit selects that track
+// ("12" is "t12"). Commands end at a newline, carriage return or ';', so
+// a batch can be sent in one line ("t3;j60;p"). Spaces are ignored,
+// except in text commands ('/' and '^'), which take the rest of the
+// command as free text ("/pink floyd").
+// Bytes are fed one at a time as they arrive, with no line buffer, so a
+// partial command simply waits for the rest. No Arduino dependencies.
+class SerialCommandParser {
+public:
+    static const int32_t MAX_ARGUMENT = 9999999;
+    static const size_t MAX_TEXT = SERIAL_COMMAND_MAX_TEXT;
+    
+private:
+    enum class State {
+        START,    // Before the command character
+        NAME,     // After it, waiting for an argument or the end
+        SIGN,     // After a '-', digits must follow
+        ARGUMENT,
+        TRAILING, // Spaces after the argument
+        TEXT,     // Free text, up to the end of the command
+        DISCARD   // Malformed: skip to the end of the command
+    };
+    
+    State state;
+    SerialCommand current;
+    bool negative;
+    size_t text_length;
+    
+public:
+    SerialCommandParser();
+    
+    // True when c completed a command, which is then in command. Empty
+    // commands (blank lines, ";;", CR LF pairs) produce nothing.
+    bool feed(char c, SerialCommand& command);
+    void reset();
+    
+    // A command has started but not ended yet
+    bool isPending() const { return state != State::START; }
+    
+private:
+    static bool isTerminator(char c) { return c == '\n' || c == '\r' || c == ';'; }
+    static bool isSpace(char c) { return c == ' ' || c == '\t'; }
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    static bool takesText(char c) { return c == '/' || c == '^'; }
+    void addText(char c);
+    void addDigit(char c);
+    bool finish(SerialCommand& command);
+};
+
+#endif
@@ -1,12 +1,77 @@
 #include "SerialController.h"
+#include "AudioProcessor.h"
+#include "LoopScheduler.h"
+#include "CpuGovernor.h"
+#include <algorithm>
 
-int ActualVolume = 70;
-int PausedVolume = 70;
+extern AudioProcessor audio_processor;
+extern LoopScheduler loop_scheduler;
+extern CpuGovernor cpu_governor;
+
+// Background rescan runs below the decoder and player tasks
+static const int RESCAN_TASK_CORE = 1;
+static const int RESCAN_TASK_PRIORITY = 1;
+
+// Default step for the > and < commands
+static const int SKIP_SECONDS = 10;
+
+// Largest argument, in seconds, whose milliseconds still fit in an int
+static const int MAX_ARGUMENT_SECONDS = INT32_MAX / 1000;
+
+// Most bytes parsed per handleInput() call, so a flood of input cannot
+// hold up the loop; at 115200 baud this is about 20 ms of data
+static const int INPUT_BYTES_PER_POLL = 256;
+
+// A command left without a terminator this long is run as it is, for
+// terminals that send keystrokes without a line ending
+static const uint32_t COMMAND_IDLE_MS = 250;
+
+// Results printed per page by the search commands
+static const size_t SEARCH_PAGE_SIZE = 10;
+
+// PCM leaving the ring: 44.1 kHz, 16-bit stereo
+static const uint32_t OUTPUT_BYTES_PER_SECOND = 44100 * 4;
+
+static const char* repeatName(RepeatMode mode) {
+    switch (mode) {
+        case RepeatMode::OFF: return "off";
+        case RepeatMode::ONE: return "one";
+        default:              return "all";
+    }
+}
+
+static void printHistogram(const char* label, const HistogramSnapshot& histogram) {
+    Serial.printf("%s p50 %u us, p99 %u us, max %u us (%u samples)\n", label,
+                  (unsigned)histogram.percentileUs(50), (unsigned)histogram.percentileUs(99),
+                  (unsigned)histogram.max_us, (unsigned)histogram.total);
+    
+    // Non-empty buckets only, by upper bound
+    String buckets = " ";
+    for (int i = 0; i < HistogramSnapshot::BUCKETS; i++) {
+        if (histogram.counts[i] == 0) continue;
+        char entry[24];
+        if (i == HistogramSnapshot::BUCKETS - 1) {
+            snprintf(entry, sizeof(entry), " >=%u:%u", 1u << i, (unsigned)histogram.counts[i]);
+        } else {
+            snprintf(entry, sizeof(entry), " <%u:%u", 2u << i, (unsigned)histogram.counts[i]);
+        }
+        buckets += entry;
+    }
+    if (buckets.length() > 1) Serial.println(buckets);
+}
 
 SerialController::SerialController() :
     music_player(nullptr),
     playlist_manager(nullptr),
-    bluetooth_manager(nullptr) {
+    bluetooth_manager(nullptr),
+    metadata_manager(nullptr),
+    last_input_ms(0),
+    telemetry_interval_ms(0),
+    last_telemetry_ms(0),
+    search_mode(SearchMode::SUBSTRING),
+    search_next(0),
+    next_tag(0) {
+    search_query[0] = '\0';
 }
 
 void SerialController::setMusicPlayer(MusicPlayer* player) {
@@ -21,6 +86,15 @@ void SerialController::setBluetoothManager(BluetoothManager* bluetooth) {
     bluetooth_manager = bluetooth;
 }
 
+void SerialController::setMetadataManager(MetadataManager* metadata) {
+    metadata_manager = metadata;
+}
+
+void SerialController::setTelemetryInterval(uint32_t interval_ms) {
+    telemetry_interval_ms = interval_ms;
+    last_telemetry_ms = millis();
+}
+
 void SerialController::initialize() {
     if (music_player) {
         // Registra i callback per ricevere notifiche
@@ -31,158 +105,286 @@ void SerialController::initialize() {
         music_player->addLogCallback([this](const String& message) {
             onLogMessage(message);
         });
+        
+        music_player->addCommandDoneCallback([this](uint32_t tag, bool applied) {
+            onCommandDone(tag, applied);
+        });
     }
     
     printHelp();
 }
 
-void SerialController::handleInput() {
-    if (!Serial.available()) return;
+bool SerialController::handleInput() {
+    // Never waits for a whole line: bytes are parsed as they arrive and
+    // each command runs as soon as its terminator is in
+    SerialCommand command;
+    int budget = INPUT_BYTES_PER_POLL;
+    if (Serial.available()) {
+        last_input_ms = millis();
+    } else if (parser.isPending() && millis() - last_input_ms >= COMMAND_IDLE_MS) {
+        if (parser.feed('\n', command)) {
+            CommandResult result = executeCommand(command);
+            if (result != CommandResult::QUEUED) acknowledge(command, result);
+        }
+    }
+    
+    while (budget-- > 0 && Serial.available()) {
+        if (parser.feed((char)Serial.read(), command)) {
+            CommandResult result = executeCommand(command);
+            if (result != CommandResult::QUEUED) acknowledge(command, result);
+        }
+    }
+    return Serial.available() > 0;
+}
+
+// The command as typed, for the replies
+static void formatEcho(char* echo, size_t size, char name, bool has_argument, long argument, const char* text) {
+    if (has_argument) {
+        snprintf(echo, size, "%c%ld", name, argument);
+    } else if (text[0] != '\0') {
+        snprintf(echo, size, "%c%s", name, text);
+    } else {
+        snprintf(echo, size, "%c", name);
+    }
+}
+
+CommandResult SerialController::queueCommand(const SerialCommand& command, PlayerCommand cmd, int parameter) {
+    // Tag 0 means untracked to the player
+    if (++next_tag == 0) next_tag = 1;
+    PendingCommand& entry = pending[next_tag % PENDING_COMMANDS];
+    entry.name = command.name;
+    entry.has_argument = command.has_argument;
+    entry.argument = command.argument;
     
-    char cmd = Serial.read();
+    // Answered before queuing: the player task can apply it straight away
+    acknowledge(command, CommandResult::QUEUED);
+    music_player->executeCommand(cmd, parameter, next_tag);
+    return CommandResult::QUEUED;
+}
+
+void SerialController::acknowledge(const SerialCommand& command, CommandResult result) {
+    char echo[SerialCommandParser::MAX_TEXT + 16];
+    bool valid = command.syntax == CommandSyntax::OK;
+    formatEcho(echo, sizeof(echo), command.name, valid && command.has_argument,
+               (long)command.argument, valid ? command.text : "");
     
-    // Consuma eventuali caratteri extra (newline, ecc.)
-    while (Serial.available()) {
-        Serial.read();
+    const char* reason = "unknown";
+    switch (result) {
+        case CommandResult::OK:
+            Serial.printf("ok %s\n", echo);
+            return;
+        case CommandResult::QUEUED:
+            Serial.printf("queued %s\n", echo);
+            return;
+        case CommandResult::SYNTAX:      reason = "syntax"; break;
+        case CommandResult::RANGE:       reason = "range"; break;
+        case CommandResult::UNAVAILABLE: reason = "unavailable"; break;
+        case CommandResult::UNKNOWN:     break;
     }
+    Serial.printf("err %s %s\n", echo, reason);
+}
+
+void SerialController::update() {
+    if (telemetry_interval_ms == 0) return;
     
-    executeCommand(cmd);
+    uint32_t now = millis();
+    if (now - last_telemetry_ms >= telemetry_interval_ms) {
+        last_telemetry_ms = now;
+        printTelemetry();
+    }
 }
 
-void SerialController::executeCommand(char cmd) {
-    switch (cmd) {
+CommandResult SerialController::executeCommand(const SerialCommand& command) {
+    if (command.syntax != CommandSyntax::OK) {
+        return CommandResult::SYNTAX;
+    }
+    
+    int argument = command.has_argument ? command.argument : -1;
+    switch (command.name) {
         case 'c':
-            if (bluetooth_manager) {
-                bluetooth_manager->connect();
-            } else {
-                Serial.println("Error: BluetoothManager not available");
-            }
-            break;
-            
+            if (!bluetooth_manager) return CommandResult::UNAVAILABLE;
+            bluetooth_manager->connect();
+            return CommandResult::OK;
+        
         case 'd':
-            if (bluetooth_manager) {
-                bluetooth_manager->disconnect();
-            } else {
-                Serial.println("Error: BluetoothManager not available");
-            }
-            break;
-            
+            if (!bluetooth_manager) return CommandResult::UNAVAILABLE;
+            bluetooth_manager->disconnect();
+            return CommandResult::OK;
+        
         case 'p':
-            if (music_player) {
-                PlayerState current_state = music_player->getState();
-                if (current_state == PlayerState::PLAYING) {
-                    if (bluetooth_manager) {
-                        PausedVolume = ActualVolume;
-                        while (ActualVolume > 10)
-                        {   delay(75);
-                            ActualVolume = ActualVolume - 5;
-                            bluetooth_manager->VolumeSet(ActualVolume);
-                        }
-                    music_player->executeCommand(PlayerCommand::PAUSE);
-                    ActualVolume = PausedVolume;
-                    bluetooth_manager->VolumeSet(ActualVolume);
-
-                    }
-                } else {
-                    music_player->executeCommand(PlayerCommand::PLAY);
-                        if (bluetooth_manager) {
-                            ActualVolume = 0;
-                        while (ActualVolume < PausedVolume)
-                        {    delay(50);
-                            ActualVolume = ActualVolume + 5;
-                            bluetooth_manager->VolumeSet(ActualVolume);
-                        }
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            // The fade runs in the audio path; this returns immediately
+            return queueCommand(command, music_player->getState() == PlayerState::PLAYING ?
+                                PlayerCommand::PAUSE : PlayerCommand::PLAY);
+        
+        case 'n':
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            return queueCommand(command, PlayerCommand::NEXT_TRACK);
+        
+        case 'b':
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            return queueCommand(command, PlayerCommand::PREV_TRACK);
+        
+        case 't':
+            if (!music_player || !playlist_manager) return CommandResult::UNAVAILABLE;
+            if (argument < 1 || argument > (int)playlist_manager->getTrackCount()) {
+                return CommandResult::RANGE;
+            }
+            return queueCommand(command, PlayerCommand::PLAY_TRACK, argument - 1);
+        
+        case '>':
+        case '<':
+            {
+                if (!music_player) return CommandResult::UNAVAILABLE;
+                if (command.has_argument && (argument <= 0 || argument > MAX_ARGUMENT_SECONDS)) {
+                    return CommandResult::RANGE;
                 }
+                int seconds = command.has_argument ? argument : SKIP_SECONDS;
+                int offset_ms = seconds * 1000;
+                return queueCommand(command, PlayerCommand::SEEK_RELATIVE, command.name == '>' ? offset_ms : -offset_ms);
             }
-        }
-            break;
-            
-        case 'n':
-            if (music_player) {
-                music_player->executeCommand(PlayerCommand::NEXT_TRACK);
+        
+        case 'u':
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            if (command.has_argument && argument != 0 && argument != 1) return CommandResult::RANGE;
+            return queueCommand(command, PlayerCommand::SET_SHUFFLE,
+                                command.has_argument ? argument : !music_player->isShuffle());
+        
+        case 'e':
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            if (command.has_argument && (argument < 0 || argument > (int)RepeatMode::ONE)) return CommandResult::RANGE;
+            // Without an argument: off -> all -> one -> off
+            return queueCommand(command, PlayerCommand::SET_REPEAT, command.has_argument ? argument :
+                                ((int)music_player->getRepeatMode() + 1) % ((int)RepeatMode::ONE + 1));
+        
+        case 'j':
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            if (argument < 0 || argument > MAX_ARGUMENT_SECONDS) return CommandResult::RANGE;
+            return queueCommand(command, PlayerCommand::SEEK, argument * 1000);
+        
+        case 'x':
+            if (command.has_argument) {
+                if (argument < 0 || argument > (int)(AudioProcessor::MAX_CROSSFADE_MS / 1000)) {
+                    return CommandResult::RANGE;
+                }
+                audio_processor.setCrossfade((uint32_t)argument * 1000);
             }
-            break;
-            
-        case 'b':
-            if (music_player) {
-                music_player->executeCommand(PlayerCommand::PREV_TRACK);
+            Serial.printf("Crossfade: %u s\n", (unsigned)(audio_processor.getCrossfade() / 1000));
+            return CommandResult::OK;
+        
+        case '/':
+        case '^':
+            if (!playlist_manager) return CommandResult::UNAVAILABLE;
+            if (command.text[0] != '\0') {
+                // A new search; without text, the next page of the last one
+                strcpy(search_query, command.text);
+                search_mode = command.name == '^' ? SearchMode::PREFIX : SearchMode::SUBSTRING;
+                search_next = 0;
+            } else if (search_query[0] == '\0') {
+                return CommandResult::RANGE;
             }
-            break;
-            
+            return printSearchPage();
+        
+        case 'g': {
+            if (!playlist_manager || !music_player) return CommandResult::UNAVAILABLE;
+            if (search_query[0] == '\0' || argument < 1) return CommandResult::RANGE;
+            std::vector<uint32_t> result;
+            playlist_manager->searchTracks(search_query, search_mode, argument - 1, 1, result);
+            if (result.empty()) return CommandResult::RANGE;
+            return queueCommand(command, PlayerCommand::PLAY_TRACK, result[0]);
+        }
+        
         case 'l':
-            if (playlist_manager) {
-                int current_index = music_player ? music_player->getCurrentTrackIndex() : -1;
-                playlist_manager->printPlaylist(current_index);
-            } else {
-                Serial.println("Error: PlaylistManager not available");
+            if (!playlist_manager) return CommandResult::UNAVAILABLE;
+            playlist_manager->printPlaylist(music_player ? music_player->getCurrentTrackIndex() : -1);
+            return CommandResult::OK;
+        
+        case 'o':
+            if (!playlist_manager) return CommandResult::UNAVAILABLE;
+            if (!command.has_argument) {
+                playlist_manager->printPlaylistFiles();
+                return CommandResult::OK;
             }
-            break;
-            
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            if (argument < 0 || argument > (int)playlist_manager->getPlaylistFileCount()) {
+                return CommandResult::RANGE;
+            }
+            // 0 goes back to the whole card
+            return queueCommand(command, PlayerCommand::SET_PLAYLIST, argument - 1);
+        
         case 'r':
-            if (playlist_manager) {
-                Serial.println("Rescanning SD card...");
-                if (playlist_manager->scanForMP3Files()) {
-                    Serial.printf("Scan completed. Found %d tracks.\n", playlist_manager->getTrackCount());
-                } else {
-                    Serial.println("Scan failed.");
-                }
+            if (!playlist_manager) return CommandResult::UNAVAILABLE;
+            if (playlist_manager->startRescan(RESCAN_TASK_CORE, RESCAN_TASK_PRIORITY)) {
+                Serial.println("Rescanning SD card in the background...");
             } else {
-                Serial.println("Error: PlaylistManager not available");
+                Serial.println("Rescan already running.");
             }
-            break;
-            
+            return CommandResult::OK;
+        
         case 's':
             printStatus();
-            break;
-            
-        case '+':
-            if (music_player) {
-                music_player->executeCommand(PlayerCommand::VOLUME_UP);
-            if (bluetooth_manager) {
-                if (ActualVolume < 120)
-                {ActualVolume = ActualVolume + 10;
-                bluetooth_manager->VolumeSet(ActualVolume);
-                }
-                } 
-                Serial.println(ActualVolume);
+            return CommandResult::OK;
+        
+        case '?':
+            printMachineStatus();
+            return CommandResult::OK;
+        
+        case 'm':
+            if (command.has_argument) {
+                if (argument < 0 || argument > MAX_ARGUMENT_SECONDS) return CommandResult::RANGE;
+                setTelemetryInterval((uint32_t)argument * 1000);
+                if (argument > 0) Serial.printf("Telemetry every %d s\n", argument);
+                else Serial.println("Telemetry off");
+            } else {
+                printMetrics();
             }
-            break;
-            
-        case '-':
-            if (music_player) {
-                music_player->executeCommand(PlayerCommand::VOLUME_DOWN);
-            if (bluetooth_manager) {
-                if (ActualVolume > 40)
-                {ActualVolume = ActualVolume - 10;
-                bluetooth_manager->VolumeSet(ActualVolume);
-                }
-                }
-                Serial.println(ActualVolume);
-
+            return CommandResult::OK;
+        
+        case 'M':
+            audio_processor.resetMetrics();
+            Serial.println("Playback metrics reset");
+            return CommandResult::OK;
+        
+        case 'a':
+        case 'A':
+            if (!metadata_manager) return CommandResult::UNAVAILABLE;
+            if (argument > 0) {
+                if (command.name == 'a') metadata_manager->printArtistTracks(argument - 1);
+                else metadata_manager->printAlbumTracks(argument - 1);
+            } else {
+                if (command.name == 'a') metadata_manager->printArtists();
+                else metadata_manager->printAlbums();
             }
-            break;
-            
-        case '1': case '2': case '3': case '4': case '5':
-        case '6': case '7': case '8': case '9':
-            {
-                int track_num = cmd - '0' - 1; // Converti a indice base 0
-                if (music_player && playlist_manager) {
-                    if (track_num < (int)playlist_manager->getTrackCount()) {
-                        Serial.printf("Playing track %d\n", track_num + 1);
-                        music_player->executeCommand(PlayerCommand::PLAY_TRACK, track_num);
-                    } else {
-                        Serial.println("Track number out of range");
-                    }
-                } else {
-                    Serial.println("Error: Player or playlist not available");
-                }
+            return CommandResult::OK;
+        
+        case 'i':
+            if (!metadata_manager || !music_player) return CommandResult::UNAVAILABLE;
+            metadata_manager->printTrackInfo(music_player->getCurrentTrackIndex());
+            return CommandResult::OK;
+        
+        case '+':
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            return queueCommand(command, PlayerCommand::VOLUME_UP);
+        
+        case '-':
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            return queueCommand(command, PlayerCommand::VOLUME_DOWN);
+        
+        case 'v':
+            if (!music_player) return CommandResult::UNAVAILABLE;
+            if (command.has_argument) {
+                if (argument > 0 || argument < MusicPlayer::MIN_VOLUME_DB) return CommandResult::RANGE;
+                return queueCommand(command, PlayerCommand::SET_VOLUME, argument);
             }
-            break;
-            
+            Serial.printf("Volume: %d dB\n", music_player->getVolumeDb());
+            return CommandResult::OK;
+        
         case 'h':
-        default:
             printHelp();
-            break;
+            return CommandResult::OK;
+        
+        default:
+            return CommandResult::UNKNOWN;
     }
 }
 
@@ -195,12 +397,35 @@ void SerialController::printHelp() {
     Serial.println(" n - Next track");
     Serial.println(" b - Previous track");
     Serial.println(" l - List playlist");
+    Serial.println(" o / oN - List playlist files / play playlist N (0 = all tracks)");
     Serial.println(" r - Rescan SD card");
-    Serial.println(" 1-9 - Play track number (1-9)");
+    Serial.println(" /text - Find tracks whose name or folder contains text");
+    Serial.println(" ^text - Find tracks with a word starting with text");
+    Serial.println(" / - Next page of results");
+    Serial.println(" gN - Play search result N");
+    Serial.println(" N / tN - Play track number N");
     Serial.println(" + - Volume up");
     Serial.println(" - - Volume down");
+    Serial.println(" v / vN - Show / set volume to N dB (0 to -60)");
+    Serial.println(" > / >N - Skip forward 10 / N seconds");
+    Serial.println(" < / <N - Skip back 10 / N seconds");
+    Serial.println(" jN - Jump to N seconds");
+    Serial.println(" u / uN - Toggle / set shuffle (1 = on, 0 = off)");
+    Serial.println(" e / eN - Cycle / set repeat (0 = off, 1 = all, 2 = one)");
+    Serial.println(" x / xN - Show / set crossfade to N seconds (0 = gapless, up to 10)");
+    Serial.println(" a / aN - List artists / tracks of artist N");
+    Serial.println(" A / AN - List albums / tracks of album N");
+    Serial.println(" i - Show current track info");
     Serial.println(" s - Show current status");
+    Serial.println(" ? - Status as one key=value line");
+    Serial.println(" m - Show playback health (underruns, buffer, timings)");
+    Serial.println(" mN - Print a telemetry line every N seconds (0 = off)");
+    Serial.println(" M - Reset playback health counters");
     Serial.println(" h - Show help");
+    Serial.println("Separate commands with ';' or newlines; each is answered");
+    Serial.println("with 'ok <command>' or 'err <command> <reason>'. Player");
+    Serial.println("commands first get 'queued <command>', then 'ok' or");
+    Serial.println("'err <command> failed' once the player has applied them.");
     Serial.println("------------------------------------");
 }
 
@@ -208,7 +433,13 @@ void SerialController::printStatus() {
     Serial.println("\n--- Status ---");
     
     if (playlist_manager) {
-        Serial.printf("Playlist: %d tracks\n", playlist_manager->getTrackCount());
+        Serial.printf("Playlist: %d tracks%s\n", playlist_manager->getTrackCount(),
+                      playlist_manager->isRescanning() ? " (rescan in progress)" : "");
+        String selected = playlist_manager->getSelectedPlaylist();
+        if (selected.length() > 0) {
+            Serial.printf("Playing: %s (%u tracks)\n", selected.c_str(),
+                          (unsigned)playlist_manager->getOrderSize());
+        }
     } else {
         Serial.println("Playlist: Not available");
     }
@@ -231,6 +462,14 @@ void SerialController::printStatus() {
             default: state_str = "Unknown"; break;
         }
         Serial.printf("State: %s\n", state_str);
+        Serial.printf("Volume: %d dB\n", music_player->getVolumeDb());
+        Serial.printf("Order: %s, repeat %s\n", music_player->isShuffle() ? "shuffle" : "in order",
+                      repeatName(music_player->getRepeatMode()));
+        
+        if (music_player->getCurrentTrackIndex() >= 0) {
+            uint32_t seconds = audio_processor.getPositionMs() / 1000;
+            Serial.printf("Position: %u:%02u\n", (unsigned)(seconds / 60), (unsigned)(seconds % 60));
+        }
     } else {
         Serial.println("Player: Not available");
     }
@@ -241,9 +480,139 @@ void SerialController::printStatus() {
         Serial.println("Bluetooth: Not available");
     }
     
+    ReadAheadStats read_stats = audio_processor.getReadStats();
+    Serial.printf("SD read: %u KB/s, %u bursts, avg %u us, max %u us, %u stalls\n",
+                  (unsigned)(read_stats.bytesPerSecond() / 1024),
+                  (unsigned)read_stats.bursts,
+                  (unsigned)read_stats.averageBurstUs(),
+                  (unsigned)read_stats.max_burst_us,
+                  (unsigned)read_stats.stalls);
+    
+    DecodeLoad decoding, crossfading;
+    audio_processor.getDecodeLoad(decoding, crossfading);
+    Serial.printf("Decoder load: %u%% (max step %u us), crossfade %u%% (max step %u us)\n",
+                  (unsigned)decoding.percent(), (unsigned)decoding.max_step_us,
+                  (unsigned)crossfading.percent(), (unsigned)crossfading.max_step_us);
+    
+    const GovernorStats& governor = cpu_governor.getStats();
+    Serial.printf("CPU: %u MHz (%u changes, %u low-buffer boosts)\n", (unsigned)getCpuFrequencyMhz(),
+                  (unsigned)governor.changes, (unsigned)governor.boosts);
+    
     Serial.println("-------------");
 }
 
+void SerialController::printMachineStatus() {
+    // Fixed keys, so scripts can parse it without knowing the other output
+    PlayerState state = music_player ? music_player->getState() : PlayerState::STOPPED;
+    const char* state_str;
+    switch (state) {
+        case PlayerState::PLAYING: state_str = "playing"; break;
+        case PlayerState::PAUSED:  state_str = "paused"; break;
+        default:                   state_str = "stopped"; break;
+    }
+    
+    PlaybackMetricsSnapshot metrics;
+    audio_processor.getMetrics(metrics);
+    Serial.printf("status state=%s track=%d tracks=%d pos_ms=%u vol_db=%d shuffle=%d repeat=%s bt=%d crossfade_ms=%u underruns=%u rescan=%d\n",
+                  state_str,
+                  music_player ? music_player->getCurrentTrackIndex() + 1 : 0,
+                  playlist_manager ? (int)playlist_manager->getTrackCount() : 0,
+                  (unsigned)audio_processor.getPositionMs(),
+                  music_player ? music_player->getVolumeDb() : 0,
+                  music_player && music_player->isShuffle() ? 1 : 0,
+                  music_player ? repeatName(music_player->getRepeatMode()) : "all",
+                  bluetooth_manager && bluetooth_manager->isConnected() ? 1 : 0,
+                  (unsigned)audio_processor.getCrossfade(),
+                  (unsigned)metrics.underruns,
+                  playlist_manager && playlist_manager->isRescanning() ? 1 : 0);
+}
+
+CommandResult SerialController::printSearchPage() {
+    std::vector<uint32_t> page;
+    uint32_t started = micros();
+    size_t total = playlist_manager->searchTracks(search_query, search_mode, search_next,
+                                                  SEARCH_PAGE_SIZE, page);
+    uint32_t elapsed = micros() - started;
+    
+    Serial.printf("\n--- %s \"%s\": %u matches (%u.%u ms) ---\n",
+                  search_mode == SearchMode::PREFIX ? "Words starting" : "Search",
+                  search_query, (unsigned)total,
+                  (unsigned)(elapsed / 1000), (unsigned)(elapsed % 1000 / 100));
+    
+    // Result number for g, then track number and folder below the music root
+    std::shared_ptr<const TrackTable> table = playlist_manager->getTracks();
+    size_t root_length = playlist_manager->getMusicRoot().length();
+    for (size_t i = 0; i < page.size(); i++) {
+        uint32_t track = page[i];
+        if (track >= table->size()) break; // Rescanned in between
+        const char* folder = table->directory(track);
+        folder += std::min(root_length, strlen(folder));
+        Serial.printf("%3u. %4u: %s%.*s\n", (unsigned)(search_next + i + 1), (unsigned)(track + 1),
+                      folder, (int)table->stemLength(track), table->fileName(track));
+    }
+    
+    search_next += page.size();
+    if (search_next < total) {
+        Serial.printf("'/' for more (%u left), 'gN' to play result N\n", (unsigned)(total - search_next));
+    } else if (total > 0) {
+        Serial.println("'gN' to play result N");
+    }
+    Serial.println("-----------------------");
+    return CommandResult::OK;
+}
+
+void SerialController::printMetrics() {
+    PlaybackMetricsSnapshot metrics;
+    audio_processor.getMetrics(metrics);
+    size_t buffered = audio_processor.getBufferedBytes();
+    size_t capacity = audio_processor.getBufferCapacity();
+    
+    Serial.println("\n--- Playback Health ---");
+    Serial.printf("Buffer: %u of %u bytes (%u%%)", (unsigned)buffered, (unsigned)capacity,
+                  capacity ? (unsigned)(buffered * 100 / capacity) : 0);
+    if (metrics.ring_low_water != UINT32_MAX) {
+        Serial.printf(", low-water %u bytes", (unsigned)metrics.ring_low_water);
+    }
+    Serial.println();
+    Serial.printf("Underruns: %u in %u callbacks, %u ms of silence\n",
+                  (unsigned)metrics.underruns, (unsigned)metrics.callbacks,
+                  (unsigned)((uint64_t)metrics.silence_bytes * 1000 / OUTPUT_BYTES_PER_SECOND));
+    if (metrics.heap_low_water != UINT32_MAX) {
+        Serial.printf("Free heap: %u KB, low-water %u KB\n",
+                      (unsigned)(ESP.getFreeHeap() / 1024), (unsigned)(metrics.heap_low_water / 1024));
+    }
+    printHistogram("Callback:", metrics.callback);
+    printHistogram("Decode:  ", metrics.decode);
+    printHistogram("SD read: ", metrics.sd_read);
+    
+    for (int id = 0; id < loop_scheduler.getTaskCount(); id++) {
+        LoopTaskStats step;
+        if (!loop_scheduler.getStats(id, step)) continue;
+        Serial.printf("Loop %s: every %u ms, %u runs, max slice %u us, max late %u ms\n",
+                      step.name, (unsigned)step.period_ms, (unsigned)step.runs,
+                      (unsigned)step.max_slice_us, (unsigned)step.max_late_ms);
+    }
+    Serial.println("-----------------------");
+}
+
+void SerialController::printTelemetry() {
+    // One line, easy to grep out of a long log
+    PlaybackMetricsSnapshot metrics;
+    audio_processor.getMetrics(metrics);
+    size_t capacity = audio_processor.getBufferCapacity();
+    unsigned fill = capacity ? (unsigned)(audio_processor.getBufferedBytes() * 100 / capacity) : 0;
+    unsigned low = capacity && metrics.ring_low_water != UINT32_MAX ?
+        (unsigned)((uint64_t)metrics.ring_low_water * 100 / capacity) : 0;
+    unsigned heap_low = metrics.heap_low_water != UINT32_MAX ? (unsigned)(metrics.heap_low_water / 1024) : 0;
+    
+    Serial.printf("[Metrics] ur=%u/%u buf=%u%%/%u%% cb=%u/%uus dec=%u/%uus sd=%u/%uus heap=%uk cpu=%uM\n",
+                  (unsigned)metrics.underruns, (unsigned)metrics.callbacks, fill, low,
+                  (unsigned)metrics.callback.percentileUs(99), (unsigned)metrics.callback.max_us,
+                  (unsigned)metrics.decode.percentileUs(99), (unsigned)metrics.decode.max_us,
+                  (unsigned)metrics.sd_read.percentileUs(99), (unsigned)metrics.sd_read.max_us,
+                  heap_low, (unsigned)getCpuFrequencyMhz());
+}
+
 void SerialController::onStateChange(PlayerState state, int track_index, const String& track_name) {
     // Callback called when the player state changes
     // You might want to print notifications here, but I avoid spamming
@@ -254,3 +623,15 @@ void SerialController::onLogMessage(const String& message) {
     // Print log messages from the MusicPlayer
     Serial.println("[Player] " + message);
 }
+
+void SerialController::onCommandDone(uint32_t tag, bool applied) {
+    // Player task: the final reply to a queued command
+    const PendingCommand& entry = pending[tag % PENDING_COMMANDS];
+    char echo[24];
+    formatEcho(echo, sizeof(echo), entry.name, entry.has_argument, (long)entry.argument, "");
+    if (applied) {
+        Serial.printf("ok %s\n", echo);
+    } else {
+        Serial.printf("err %s failed\n", echo);
+    }
+}
@@ -5,12 +5,51 @@
 #include "MusicPlayer.h"
 #include "PlaylistManager.h"
 #include "BluetoothManager.h"
+#include "MetadataManager.h"
+#include "SerialCommandParser.h"
+
+// Every command is answered with "ok <command>" or "err <command> <reason>",
+// in order, after any output of its own. Commands for the player are only
+// queued here: they are answered "queued <command>" at once, then "ok" or
+// "err <command> failed" when the player task has applied them, which can
+// come after the replies to later commands.
+enum class CommandResult {
+    OK,
+    QUEUED,      // Handed to the player; the outcome follows from its task
+    SYNTAX,      // Malformed command or argument out of bounds
+    UNKNOWN,     // No such command
+    RANGE,       // Argument not valid for this command
+    UNAVAILABLE  // Component it needs is missing
+};
 
 class SerialController {
 private:
     MusicPlayer* music_player;
     PlaylistManager* playlist_manager;
     BluetoothManager* bluetooth_manager;
+    MetadataManager* metadata_manager;
+    SerialCommandParser parser;
+    uint32_t last_input_ms;
+    
+    // Periodic one-line health report; 0 turns it off
+    uint32_t telemetry_interval_ms;
+    uint32_t last_telemetry_ms;
+    
+    // Last track search, for paging and for playing a result
+    char search_query[SerialCommandParser::MAX_TEXT + 1];
+    SearchMode search_mode;
+    size_t search_next; // First result of the next page
+    
+    // Player commands awaiting their outcome, by tag. More slots than the
+    // player's queue holds, so none is reused while still outstanding.
+    struct PendingCommand {
+        char name;
+        bool has_argument;
+        int32_t argument;
+    };
+    static const uint32_t PENDING_COMMANDS = 64;
+    PendingCommand pending[PENDING_COMMANDS];
+    uint32_t next_tag;
     
 public:
     SerialController();
@@ -18,18 +57,31 @@ public:
     void setMusicPlayer(MusicPlayer* player);
     void setPlaylistManager(PlaylistManager* playlist);
     void setBluetoothManager(BluetoothManager* bluetooth);
+    void setMetadataManager(MetadataManager* metadata);
+    
+    void setTelemetryInterval(uint32_t interval_ms);
     
     void initialize();
-    void handleInput(); // To be called in the loop
+    // Loop steps. handleInput() parses a bounded amount of input and
+    // returns true if more is waiting.
+    bool handleInput();
+    void update(); // Periodic telemetry
     
 private:
     void printHelp();
     void printStatus();
-    void executeCommand(char cmd);
+    void printMetrics();
+    void printTelemetry();
+    void printMachineStatus();
+    CommandResult printSearchPage();
+    CommandResult executeCommand(const SerialCommand& command);
+    CommandResult queueCommand(const SerialCommand& command, PlayerCommand cmd, int parameter = -1);
+    void acknowledge(const SerialCommand& command, CommandResult result);
     
     // Callbacks
     void onStateChange(PlayerState state, int track_index, const String& track_name);
     void onLogMessage(const String& message);
+    void onCommandDone(uint32_t tag, bool applied);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "ShufflePermutation.h"
+
+// 32-bit finalizer from MurmurHash3: every input bit affects every output bit
+static uint32_t mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x85EBCA6B;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    return x;
+}
+
+ShufflePermutation::ShufflePermutation() :
+    count(0),
+    half_bits(1),
+    half_mask(1) {
+    for (int i = 0; i < ROUNDS; i++) {
+        keys[i] = 0;
+    }
+}
+
+void ShufflePermutation::reset(uint32_t new_count, uint32_t seed) {
+    count = new_count > MAX_COUNT ? MAX_COUNT : new_count;
+    
+    // Both halves get the same width, at least one bit each
+    half_bits = 1;
+    while ((1ull << (2 * half_bits)) < count) {
+        half_bits++;
+    }
+    half_mask = (1u << half_bits) - 1;
+    
+    uint32_t state = seed;
+    for (int i = 0; i < ROUNDS; i++) {
+        state = mix(state + 0x9E3779B9);
+        keys[i] = state;
+    }
+}
+
+uint32_t ShufflePermutation::at(uint32_t position) const {
+    if (position >= count) return position;
+    
+    // The domain may be larger than count: keep going until back inside.
+    // Encryption is a bijection, so this stays one as well.
+    uint32_t x = encrypt(position);
+    while (x >= count) {
+        x = encrypt(x);
+    }
+    return x;
+}
+
+uint32_t ShufflePermutation::positionOf(uint32_t value) const {
+    if (value >= count) return value;
+    
+    uint32_t x = decrypt(value);
+    while (x >= count) {
+        x = decrypt(x);
+    }
+    return x;
+}
+
+uint32_t ShufflePermutation::round(uint32_t half, uint32_t key) const {
+    return mix(half ^ key) & half_mask;
+}
+
+uint32_t ShufflePermutation::encrypt(uint32_t x) const {
+    uint32_t left = x >> half_bits;
+    uint32_t right = x & half_mask;
+    for (int i = 0; i < ROUNDS; i++) {
+        uint32_t next = left ^ round(right, keys[i]);
+        left = right;
+        right = next;
+    }
+    return (left << half_bits) | right;
+}
+
+uint32_t ShufflePermutation::decrypt(uint32_t x) const {
+    uint32_t left = x >> half_bits;
+    uint32_t right = x & half_mask;
+    for (int i = ROUNDS - 1; i >= 0; i--) {
+        uint32_t previous = right ^ round(left, keys[i]);
+        right = left;
+        left = previous;
+    }
+    return (left << half_bits) | right;
+}
@@ -0,0 +1,42 @@
+#ifndef SHUFFLEPERMUTATION_H
+#define SHUFFLEPERMUTATION_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Seeded random permutation of [0, count) that is computed, not stored: a
+// six-round Feistel network over the smallest even-bit domain that holds
+// count, with cycle-walking to stay inside it. Memory is a few words for
+// any playlist size, reset() is O(1), and at()/positionOf() take a few
+// rounds each (the domain is under 4 * count, so under four walks on
+// average). No Arduino dependencies.
+class ShufflePermutation {
+public:
+    static const int ROUNDS = 6;
+    static const uint32_t MAX_COUNT = 1u << 30;
+    
+private:
+    uint32_t count;
+    uint32_t half_bits;
+    uint32_t half_mask;
+    uint32_t keys[ROUNDS];
+    
+public:
+    ShufflePermutation();
+    
+    // count up to MAX_COUNT; a different seed gives an unrelated order
+    void reset(uint32_t count, uint32_t seed);
+    uint32_t size() const { return count; }
+    
+    // Element at a position of the order, and the position of an element;
+    // both take values below size()
+    uint32_t at(uint32_t position) const;
+    uint32_t positionOf(uint32_t value) const;
+    
+private:
+    uint32_t encrypt(uint32_t x) const;
+    uint32_t decrypt(uint32_t x) const;
+    uint32_t round(uint32_t half, uint32_t key) const;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "TrackSearchIndex.h"
+#include <algorithm>
+#include <cstring>
+
+// Word layout: bit 31 set for a folder, the track or folder index in bits
+// 8-30, and the word's offset into its text in bits 0-7
+static const uint32_t FOLDER_FLAG = 0x80000000u;
+static const int OWNER_SHIFT = 8;
+static const uint32_t OFFSET_MASK = 0xFF;
+
+static char fold(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 'a';
+    if (c == '_') return ' ';
+    return c;
+}
+
+// Letters, digits and anything outside ASCII, so UTF-8 is never split
+static bool isWordChar(char c) {
+    unsigned char u = (unsigned char)c;
+    return (u >= '0' && u <= '9') || (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || u >= 0x80;
+}
+
+static int compareFolded(const char* a, const char* a_end, const char* b, const char* b_end) {
+    while (a < a_end && b < b_end) {
+        unsigned char ca = fold(*a++);
+        unsigned char cb = fold(*b++);
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    if (a < a_end) return 1;
+    return b < b_end ? -1 : 0;
+}
+
+// Compares only the first length characters of the text with the query,
+// which is already folded
+static int comparePrefix(const char* text, const char* text_end, const char* query, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (text + i == text_end) return -1;
+        unsigned char ct = fold(text[i]);
+        unsigned char cq = query[i];
+        if (ct != cq) return ct < cq ? -1 : 1;
+    }
+    return 0;
+}
+
+static bool containsFolded(const char* text, const char* text_end, const char* query, size_t length) {
+    if ((size_t)(text_end - text) < length) return false;
+    const char* last = text_end - length;
+    for (const char* p = text; p <= last; p++) {
+        if (fold(*p) != query[0]) continue;
+        if (comparePrefix(p, text_end, query, length) == 0) return true;
+    }
+    return false;
+}
+
+static void setBit(std::vector<uint32_t>& bits, size_t index) {
+    bits[index / 32] |= 1u << (index % 32);
+}
+
+static bool testBit(const std::vector<uint32_t>& bits, size_t index) {
+    return (bits[index / 32] >> (index % 32)) & 1;
+}
+
+TrackSearchIndex::TrackSearchIndex() :
+    table(nullptr),
+    root_length(0) {
+}
+
+void TrackSearchIndex::clear() {
+    table = nullptr;
+    root_length = 0;
+    std::vector<uint32_t>().swap(words);
+}
+
+void TrackSearchIndex::build(const TrackTable& source, size_t root) {
+    clear();
+    table = &source;
+    root_length = root;
+    
+    size_t track_count = std::min(source.size(), MAX_TRACKS);
+    for (size_t d = 0; d < source.directoryCount(); d++) {
+        addWords(folderText(d), FOLDER_FLAG | (uint32_t)d << OWNER_SHIFT);
+    }
+    for (size_t i = 0; i < track_count; i++) {
+        addWords(nameText(i), (uint32_t)i << OWNER_SHIFT);
+    }
+    words.shrink_to_fit();
+    
+    // By the folded text from each word to the end of its name or path
+    std::sort(words.begin(), words.end(), [this](uint32_t a, uint32_t b) {
+        Span ta = wordText(a);
+        Span tb = wordText(b);
+        int order = compareFolded(ta.begin, ta.end, tb.begin, tb.end);
+        return order != 0 ? order < 0 : a < b;
+    });
+}
+
+void TrackSearchIndex::addWords(Span text, uint32_t owner) {
+    // Words past OFFSET_MASK cannot be packed; only long folder paths have them
+    size_t length = std::min((size_t)(text.end - text.begin), (size_t)OFFSET_MASK + 1);
+    for (size_t i = 0; i < length; i++) {
+        if (isWordChar(text.begin[i]) && (i == 0 || !isWordChar(text.begin[i - 1]))) {
+            words.push_back(owner | (uint32_t)i);
+        }
+    }
+}
+
+TrackSearchIndex::Span TrackSearchIndex::folderText(size_t dir_index) const {
+    const char* path = table->directoryPrefix(dir_index);
+    size_t length = strlen(path);
+    size_t skip = std::min(root_length, length);
+    Span span = { path + skip, path + length };
+    return span;
+}
+
+TrackSearchIndex::Span TrackSearchIndex::nameText(size_t index) const {
+    const char* name = table->fileName(index);
+    Span span = { name, name + table->stemLength(index) };
+    return span;
+}
+
+TrackSearchIndex::Span TrackSearchIndex::wordText(uint32_t word) const {
+    size_t owner = (word & ~FOLDER_FLAG) >> OWNER_SHIFT;
+    Span span = (word & FOLDER_FLAG) ? folderText(owner) : nameText(owner);
+    span.begin += word & OFFSET_MASK;
+    return span;
+}
+
+size_t TrackSearchIndex::search(const char* query, SearchMode mode, size_t offset, size_t limit,
+                                std::vector<uint32_t>& page) const {
+    page.clear();
+    if (!table || !query) return 0;
+    
+    // Fold once, and drop spaces at either end
+    char folded[MAX_QUERY_LENGTH];
+    size_t length = 0;
+    for (const char* p = query; *p && length < MAX_QUERY_LENGTH; p++) {
+        char c = fold(*p);
+        if (c == ' ' && length == 0) continue;
+        folded[length++] = c;
+    }
+    while (length > 0 && folded[length - 1] == ' ') {
+        length--;
+    }
+    if (length == 0) return 0;
+    
+    size_t track_count = std::min(table->size(), MAX_TRACKS);
+    std::vector<uint32_t> tracks((track_count + 31) / 32, 0);
+    std::vector<uint32_t> folders((table->directoryCount() + 31) / 32, 0);
+    if (mode == SearchMode::PREFIX) {
+        markPrefix(folded, length, tracks, folders);
+    } else {
+        markSubstring(folded, length, tracks, folders);
+    }
+    
+    // A track matches on its own name or on its folder
+    const TrackEntry* entries = table->entryData();
+    size_t total = 0;
+    for (size_t i = 0; i < track_count; i++) {
+        if (!testBit(tracks, i) && !testBit(folders, entries[i].dir_index)) continue;
+        if (total >= offset && page.size() < limit) {
+            page.push_back(i);
+        }
+        total++;
+    }
+    return total;
+}
+
+void TrackSearchIndex::markPrefix(const char* query, size_t length, std::vector<uint32_t>& tracks,
+                                  std::vector<uint32_t>& folders) const {
+    // Every word starting with the query sits in one sorted run
+    auto first = std::lower_bound(words.begin(), words.end(), 0u, [&](uint32_t word, uint32_t) {
+        Span text = wordText(word);
+        return comparePrefix(text.begin, text.end, query, length) < 0;
+    });
+    auto last = std::upper_bound(first, words.end(), 0u, [&](uint32_t, uint32_t word) {
+        Span text = wordText(word);
+        return comparePrefix(text.begin, text.end, query, length) > 0;
+    });
+    
+    for (auto it = first; it != last; ++it) {
+        size_t owner = (*it & ~FOLDER_FLAG) >> OWNER_SHIFT;
+        setBit((*it & FOLDER_FLAG) ? folders : tracks, owner);
+    }
+}
+
+void TrackSearchIndex::markSubstring(const char* query, size_t length, std::vector<uint32_t>& tracks,
+                                     std::vector<uint32_t>& folders) const {
+    for (size_t d = 0; d < table->directoryCount(); d++) {
+        Span text = folderText(d);
+        if (containsFolded(text.begin, text.end, query, length)) setBit(folders, d);
+    }
+    
+    size_t track_count = std::min(table->size(), MAX_TRACKS);
+    for (size_t i = 0; i < track_count; i++) {
+        Span text = nameText(i);
+        if (containsFolded(text.begin, text.end, query, length)) setBit(tracks, i);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef TRACKSEARCHINDEX_H
+#define TRACKSEARCHINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "TrackTable.h"
+
+enum class SearchMode {
+    PREFIX,   // A word of the name or folder path starts with the query
+    SUBSTRING // The query appears anywhere in the name or folder path
+};
+
+// Search over a TrackTable's names (without extension) and folder paths
+// (below the music root). The index is a sorted array of word starts,
+// each packed into 4 bytes that point back into the table's own arena, so
+// no text is copied: a prefix query is two binary searches. Folders are
+// indexed once, not once per track. Matching ignores ASCII case and
+// treats '_' as a space. Substring queries have no index to use and scan
+// the arena instead, which is still a few milliseconds at 10k tracks.
+// Results come back in playlist order. No Arduino dependencies.
+class TrackSearchIndex {
+public:
+    static const size_t MAX_QUERY_LENGTH = 32;
+    static const size_t MAX_TRACKS = 1u << 23;
+    
+private:
+    const TrackTable* table; // Not owned; must outlive the index
+    size_t root_length;
+    std::vector<uint32_t> words; // Packed: folder flag, owner, offset
+    
+public:
+    TrackSearchIndex();
+    
+    // root_length characters at the start of every folder path are not
+    // searched (the music root is common to all tracks)
+    void build(const TrackTable& table, size_t root_length);
+    void clear();
+    const TrackTable* getTable() const { return table; }
+    
+    // Matching track indices from offset, at most limit of them, in
+    // playlist order; returns the total number of matches. An empty query
+    // matches nothing.
+    size_t search(const char* query, SearchMode mode, size_t offset, size_t limit,
+                  std::vector<uint32_t>& page) const;
+    
+    size_t wordCount() const { return words.size(); }
+    size_t memoryUsage() const { return words.capacity() * sizeof(uint32_t); }
+    
+private:
+    struct Span {
+        const char* begin;
+        const char* end;
+    };
+    
+    Span folderText(size_t dir_index) const;
+    Span nameText(size_t index) const;
+    Span wordText(uint32_t word) const;
+    void addWords(Span text, uint32_t owner);
+    void markPrefix(const char* query, size_t length, std::vector<uint32_t>& tracks,
+                    std::vector<uint32_t>& folders) const;
+    void markSubstring(const char* query, size_t length, std::vector<uint32_t>& tracks,
+                       std::vector<uint32_t>& folders) const;
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include "TrackTable.h"
+#include <algorithm>
+#include <cstring>
+
+TrackTable::TrackTable() : skipped(0) {
+}
+
+void TrackTable::clear() {
+    arena.clear();
+    directories.clear();
+    directory_signatures.clear();
+    entries.clear();
+    playlists.clear();
+    directory_lookup.clear();
+    skipped = 0;
+}
+
+uint32_t TrackTable::appendString(const char* text, size_t len) {
+    uint32_t offset = arena.size();
+    arena.insert(arena.end(), text, text + len);
+    arena.push_back('\0');
+    return offset;
+}
+
+int TrackTable::internDirectory(const char* directory) {
+    auto found = directory_lookup.find(directory);
+    if (found != directory_lookup.end()) {
+        return found->second;
+    }
+    if (directories.size() >= MAX_DIRECTORIES) {
+        return -1;
+    }
+    
+    uint16_t index = directories.size();
+    directories.push_back(appendString(directory, strlen(directory)));
+    directory_signatures.push_back(0);
+    directory_lookup.emplace(directory, index);
+    return index;
+}
+
+bool TrackTable::makeEntry(const char* directory, const char* file_name, TrackEntry& entry) {
+    size_t name_length = strlen(file_name);
+    int dir_index = name_length <= MAX_NAME_LENGTH ? internDirectory(directory) : -1;
+    if (dir_index < 0) {
+        skipped++;
+        return false;
+    }
+    
+    const char* dot = strrchr(file_name, '.');
+    size_t stem_length = (dot && dot != file_name) ? dot - file_name : name_length;
+    
+    entry.name_offset = appendString(file_name, name_length);
+    entry.dir_index = dir_index;
+    entry.name_length = name_length;
+    entry.stem_length = stem_length;
+    return true;
+}
+
+bool TrackTable::add(const char* directory, const char* file_name) {
+    TrackEntry entry;
+    if (!makeEntry(directory, file_name, entry)) return false;
+    entries.push_back(entry);
+    return true;
+}
+
+bool TrackTable::addPlaylist(const char* directory, const char* file_name) {
+    TrackEntry entry;
+    if (!makeEntry(directory, file_name, entry)) return false;
+    playlists.push_back(entry);
+    return true;
+}
+
+bool TrackTable::setDirectorySignature(const char* directory, uint32_t signature) {
+    int dir_index = internDirectory(directory);
+    if (dir_index < 0) return false;
+    directory_signatures[dir_index] = signature;
+    return true;
+}
+
+void TrackTable::finish() {
+    directory_lookup.clear();
+    std::unordered_map<std::string, uint16_t>().swap(directory_lookup);
+    arena.shrink_to_fit();
+    directories.shrink_to_fit();
+    directory_signatures.shrink_to_fit();
+    entries.shrink_to_fit();
+    playlists.shrink_to_fit();
+}
+
+size_t TrackTable::pathLength(size_t index) const {
+    return strlen(directory(index)) + entries[index].name_length;
+}
+
+size_t TrackTable::copyPath(size_t index, char* buffer, size_t capacity) const {
+    if (capacity == 0) return 0;
+    
+    const char* dir = directory(index);
+    size_t dir_length = strlen(dir);
+    size_t name_length = entries[index].name_length;
+    if (dir_length + name_length + 1 > capacity) {
+        buffer[0] = '\0';
+        return 0;
+    }
+    
+    memcpy(buffer, dir, dir_length);
+    memcpy(buffer + dir_length, fileName(index), name_length + 1);
+    return dir_length + name_length;
+}
+
+int TrackTable::comparePaths(size_t a, size_t b) const {
+    return compareEntries(entries[a], entries[b]);
+}
+
+int TrackTable::compareEntries(const TrackEntry& a, const TrackEntry& b) const {
+    if (a.dir_index != b.dir_index) {
+        const char* dir_a = &arena[directories[a.dir_index]];
+        const char* dir_b = &arena[directories[b.dir_index]];
+        int order = collate(dir_a, dir_a + strlen(dir_a), dir_b, dir_b + strlen(dir_b));
+        if (order != 0) return order;
+    }
+    const char* name_a = &arena[a.name_offset];
+    const char* name_b = &arena[b.name_offset];
+    return collate(name_a, name_a + a.name_length, name_b, name_b + b.name_length);
+}
+
+int TrackTable::comparePaths(const TrackTable& a, size_t index_a, const TrackTable& b, size_t index_b) {
+    const char* dir_a = a.directory(index_a);
+    const char* dir_b = b.directory(index_b);
+    int order = collate(dir_a, dir_a + strlen(dir_a), dir_b, dir_b + strlen(dir_b));
+    if (order != 0) return order;
+    
+    const char* name_a = a.fileName(index_a);
+    const char* name_b = b.fileName(index_b);
+    return collate(name_a, name_a + a.fileNameLength(index_a), name_b, name_b + b.fileNameLength(index_b));
+}
+
+int TrackTable::collate(const char* a, const char* a_end, const char* b, const char* b_end, bool fold_only) {
+    CollationReader reader_a(a, a_end);
+    CollationReader reader_b(b, b_end);
+    while (true) {
+        int ca = reader_a.next();
+        int cb = reader_b.next();
+        if (ca != cb) return ca < cb ? -1 : 1;
+        if (ca < 0) break;
+    }
+    if (fold_only) return 0;
+    
+    // Equal apart from case or leading zeros: plain bytes decide, so
+    // distinct names never compare equal
+    while (a < a_end && b < b_end) {
+        unsigned char ca = *a++;
+        unsigned char cb = *b++;
+        if (ca != cb) return ca < cb ? -1 : 1;
+    }
+    if (a < a_end) return 1;
+    return b < b_end ? -1 : 0;
+}
+
+int TrackTable::findPath(const char* path, bool ignore_case) const {
+    // The table is in collation order: binary search on folder, then name.
+    // Names differing only in case (or leading zeros) sort next to each
+    // other, so ignoring case lands on one of them.
+    const char* slash = strrchr(path, '/');
+    const char* dir = path;
+    const char* dir_end = slash ? slash + 1 : path;
+    const char* name = dir_end;
+    const char* name_end = name + strlen(name);
+    
+    size_t low = 0;
+    size_t high = entries.size();
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const char* mid_dir = directory(mid);
+        int order = collate(mid_dir, mid_dir + strlen(mid_dir), dir, dir_end, ignore_case);
+        if (order == 0) {
+            order = collate(fileName(mid), fileName(mid) + entries[mid].name_length, name, name_end, ignore_case);
+        }
+        if (order == 0) return mid;
+        if (order < 0) low = mid + 1;
+        else high = mid;
+    }
+    return -1;
+}
+
+uint32_t TrackTable::CollationReader::key(size_t bytes) {
+    // The first bytes of the sequence, big-endian, zero-padded: comparing
+    // two keys agrees with comparing the sequences as far as the key goes
+    uint32_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        int c = next();
+        value = (value << 8) | (c < 0 ? 0 : c);
+    }
+    return value;
+}
+
+int TrackTable::CollationReader::next() {
+    if (marker_pos < marker_length) return marker[marker_pos++];
+    if (digits_left > 0) {
+        digits_left--;
+        return (unsigned char)*p++;
+    }
+    if (p == end) return -1;
+    
+    unsigned char c = *p;
+    if (c >= '0' && c <= '9') {
+        // Leading zeros carry no weight; the count of the remaining digits
+        // goes first, so a shorter number sorts before a longer one
+        while (p < end && *p == '0') p++;
+        const char* run_end = p;
+        while (run_end < end && *run_end >= '0' && *run_end <= '9') run_end++;
+        size_t count = run_end - p;
+        
+        marker_length = 0;
+        marker_pos = 0;
+        if (count < 9) {
+            marker[marker_length++] = '0' + count;
+        } else {
+            marker[marker_length++] = '9';
+            marker[marker_length++] = count > 0xFF ? 0xFF : count;
+        }
+        digits_left = count;
+        return marker[marker_pos++];
+    }
+    
+    p++;
+    if (c == '/') return 1; // Below any other character: a folder sorts before "folder 2"
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 'a';
+    return c;
+}
+
+// Keys are built once per sort; entries are compared in full only when
+// the keys of two tracks are equal
+struct CollationKey {
+    uint32_t primary;   // Folder rank, then the first two bytes of the name
+    uint32_t secondary; // Next four bytes of the name
+    uint32_t index;     // Into entries, before sorting
+};
+
+void TrackTable::sort() {
+    // Playlist files are few: a plain comparison sort does
+    std::sort(playlists.begin(), playlists.end(), [this](const TrackEntry& a, const TrackEntry& b) {
+        return compareEntries(a, b) < 0;
+    });
+    
+    size_t dir_count = directories.size();
+    size_t count = entries.size();
+    if (count < 2) return;
+    
+    // Folders first: there are far fewer of them, and their rank then
+    // stands in for the whole folder path in every track's key
+    std::vector<uint16_t> ranks(dir_count);
+    for (size_t d = 0; d < dir_count; d++) {
+        ranks[d] = d;
+    }
+    std::sort(ranks.begin(), ranks.end(), [this](uint16_t a, uint16_t b) {
+        const char* dir_a = directoryPrefix(a);
+        const char* dir_b = directoryPrefix(b);
+        return collate(dir_a, dir_a + strlen(dir_a), dir_b, dir_b + strlen(dir_b)) < 0;
+    });
+    std::vector<uint16_t> dir_rank(dir_count);
+    for (size_t r = 0; r < dir_count; r++) {
+        dir_rank[ranks[r]] = r;
+    }
+    std::vector<uint16_t>().swap(ranks);
+    
+    std::vector<CollationKey> keys(count);
+    for (size_t i = 0; i < count; i++) {
+        const TrackEntry& entry = entries[i];
+        const char* name = &arena[entry.name_offset];
+        CollationReader reader(name, name + entry.name_length);
+        keys[i].primary = (uint32_t)dir_rank[entry.dir_index] << 16 | reader.key(2);
+        keys[i].secondary = reader.key(4);
+        keys[i].index = i;
+    }
+    
+    std::sort(keys.begin(), keys.end(), [this](const CollationKey& a, const CollationKey& b) {
+        if (a.primary != b.primary) return a.primary < b.primary;
+        if (a.secondary != b.secondary) return a.secondary < b.secondary;
+        return compareEntries(entries[a.index], entries[b.index]) < 0;
+    });
+    
+    // Apply the order in place, one cycle at a time; a used key's index is
+    // set to count, so no second entries vector is needed
+    for (size_t start = 0; start < count; start++) {
+        if (keys[start].index == count) continue;
+        TrackEntry first = entries[start];
+        size_t to = start;
+        while (true) {
+            size_t from = keys[to].index;
+            keys[to].index = count;
+            if (from == start) {
+                entries[to] = first;
+                break;
+            }
+            entries[to] = entries[from];
+            to = from;
+        }
+    }
+}
+
+size_t TrackTable::memoryUsage() const {
+    return arena.capacity() +
+           directories.capacity() * sizeof(uint32_t) +
+           directory_signatures.capacity() * sizeof(uint32_t) +
+           entries.capacity() * sizeof(TrackEntry) +
+           playlists.capacity() * sizeof(TrackEntry);
+}
+
+bool TrackTable::prepare(size_t track_count, size_t playlist_count, size_t directory_count, size_t arena_bytes) {
+    clear();
+    if (directory_count > MAX_DIRECTORIES) return false;
+    arena.resize(arena_bytes);
+    directories.resize(directory_count);
+    directory_signatures.resize(directory_count);
+    entries.resize(track_count);
+    playlists.resize(playlist_count);
+    return true;
+}
+
+bool TrackTable::validate() const {
+    // Every offset must point at a NUL-terminated string inside the arena
+    if (!arena.empty() && arena.back() != '\0') return false;
+    
+    for (uint32_t offset : directories) {
+        if (offset >= arena.size()) return false;
+    }
+    for (const std::vector<TrackEntry>* list : {&entries, &playlists}) {
+        for (const TrackEntry& entry : *list) {
+            if (entry.dir_index >= directories.size() ||
+                entry.stem_length > entry.name_length ||
+                (size_t)entry.name_offset + entry.name_length >= arena.size() ||
+                arena[entry.name_offset + entry.name_length] != '\0') {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+#ifndef TRACKTABLE_H
+#define TRACKTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One playlist entry: 8 bytes, pointing into the shared string arena
+struct TrackEntry {
+    uint32_t name_offset; // File name (with extension) in the arena
+    uint16_t dir_index;   // Interned directory prefix, ends with '/'
+    uint8_t name_length;
+    uint8_t stem_length;  // Name without the extension
+};
+
+static_assert(sizeof(TrackEntry) == 8, "TrackEntry must stay compact");
+
+// Compact playlist storage: every string lives in one arena, directory
+// prefixes are stored once, and name/extension lengths are computed when a
+// track is added so lookups never allocate.
+//
+// Playlist order is by folder, then by name, both in natural order:
+// case-folded, with numbers compared by value ("Track 2" before
+// "Track 10"), and a folder's own tracks before its subfolders. Playlist
+// files found next to the tracks are kept in a list of their own, in the
+// same order and sharing the same arena. No Arduino dependencies.
+class TrackTable {
+private:
+    std::vector<char> arena;            // NUL-terminated strings
+    std::vector<uint32_t> directories;  // Arena offsets of directory prefixes
+    std::vector<uint32_t> directory_signatures; // Listing hash, for incremental rescans
+    std::vector<TrackEntry> entries;
+    std::vector<TrackEntry> playlists;  // .m3u/.m3u8 files
+    std::unordered_map<std::string, uint16_t> directory_lookup; // Only while building
+    uint32_t skipped;
+    
+public:
+    static const size_t MAX_DIRECTORIES = 0xFFFF;
+    static const size_t MAX_NAME_LENGTH = 0xFF;
+    
+    TrackTable();
+    
+    void clear();
+    bool add(const char* directory, const char* file_name);
+    bool addPlaylist(const char* directory, const char* file_name);
+    bool setDirectorySignature(const char* directory, uint32_t signature);
+    void finish(); // Drops build-time lookups and trims spare capacity
+    
+    size_t size() const { return entries.size(); }
+    const char* directory(size_t index) const { return &arena[directories[entries[index].dir_index]]; }
+    const char* fileName(size_t index) const { return &arena[entries[index].name_offset]; }
+    size_t fileNameLength(size_t index) const { return entries[index].name_length; }
+    size_t stemLength(size_t index) const { return entries[index].stem_length; }
+    size_t pathLength(size_t index) const;
+    size_t copyPath(size_t index, char* buffer, size_t capacity) const;
+    int comparePaths(size_t a, size_t b) const; // In playlist order
+    void sort();
+    int findPath(const char* path, bool ignore_case = false) const; // Binary search: the table must be sorted
+    
+    size_t playlistCount() const { return playlists.size(); }
+    const char* playlistDirectory(size_t index) const { return &arena[directories[playlists[index].dir_index]]; }
+    const char* playlistName(size_t index) const { return &arena[playlists[index].name_offset]; }
+    uint16_t playlistDirIndex(size_t index) const { return playlists[index].dir_index; }
+    
+    static int comparePaths(const TrackTable& a, size_t index_a, const TrackTable& b, size_t index_b);
+    
+    // Footprint of the table itself, excluding allocator overhead
+    size_t memoryUsage() const;
+    uint32_t getSkipped() const { return skipped; }
+    
+    // Raw sections, used to persist and reload the table
+    size_t directoryCount() const { return directories.size(); }
+    const char* directoryPrefix(size_t dir_index) const { return &arena[directories[dir_index]]; }
+    uint32_t directorySignature(size_t dir_index) const { return directory_signatures[dir_index]; }
+    size_t arenaSize() const { return arena.size(); }
+    const uint32_t* directoryData() const { return directories.data(); }
+    const uint32_t* directorySignatureData() const { return directory_signatures.data(); }
+    const TrackEntry* entryData() const { return entries.data(); }
+    const TrackEntry* playlistData() const { return playlists.data(); }
+    const char* arenaData() const { return arena.data(); }
+    bool prepare(size_t track_count, size_t playlist_count, size_t directory_count, size_t arena_bytes);
+    uint32_t* directoryData() { return directories.data(); }
+    uint32_t* directorySignatureData() { return directory_signatures.data(); }
+    TrackEntry* entryData() { return entries.data(); }
+    TrackEntry* playlistData() { return playlists.data(); }
+    char* arenaData() { return arena.data(); }
+    bool validate() const;
+    
+private:
+    // Reads a string as its collation sequence: ASCII letters folded, '/'
+    // lowest, and each run of digits as its length, then the digits
+    // without leading zeros. Sequences compare byte by byte.
+    class CollationReader {
+    private:
+        const char* p;
+        const char* end;
+        size_t digits_left;
+        uint8_t marker[2];
+        uint8_t marker_length;
+        uint8_t marker_pos;
+        
+    public:
+        CollationReader(const char* text, const char* text_end) :
+            p(text), end(text_end), digits_left(0), marker_length(0), marker_pos(0) {}
+        int next(); // -1 at the end
+        uint32_t key(size_t bytes);
+    };
+    
+    uint32_t appendString(const char* text, size_t len);
+    int internDirectory(const char* directory);
+    bool makeEntry(const char* directory, const char* file_name, TrackEntry& entry);
+    int compareEntries(const TrackEntry& a, const TrackEntry& b) const;
+    static int collate(const char* a, const char* a_end, const char* b, const char* b_end, bool fold_only = false);
+};
+
+#endif
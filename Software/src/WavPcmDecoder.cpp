@@ -0,0 +1,135 @@
+#include "WavPcmDecoder.h"
+
+// WAVE_FORMAT_PCM, and WAVE_FORMAT_EXTENSIBLE whose sub-format says PCM
+static const uint16_t FORMAT_PCM = 1;
+static const uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+
+static uint16_t readLe16(const uint8_t* p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t readLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+WavPcmDecoder::WavPcmDecoder() :
+    input(nullptr),
+    data_start(0),
+    data_end(0),
+    sample_rate(0),
+    channels(0),
+    frame_bytes(0) {
+}
+
+bool WavPcmDecoder::begin(ReadAheadStream& source, const DecoderBuffers& /* buffers */) {
+    input = &source;
+    data_start = 0;
+    data_end = 0;
+    sample_rate = 0;
+    channels = 0;
+    frame_bytes = 0;
+    return true;
+}
+
+void WavPcmDecoder::end() {
+    input = nullptr;
+}
+
+bool WavPcmDecoder::prepare() {
+    if (!input) return false;
+    if (sample_rate != 0) return true;
+    return parseHeader();
+}
+
+bool WavPcmDecoder::parseHeader() {
+    uint8_t riff[12];
+    if (input->readBytes(reinterpret_cast<char*>(riff), sizeof(riff)) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    
+    // Chunks come in any order; the walk ends at "data"
+    uint16_t format = 0;
+    uint16_t bits = 0;
+    uint16_t file_channels = 0;
+    uint32_t rate = 0;
+    uint32_t data_size = 0;
+    while (true) {
+        uint8_t chunk[8];
+        if (input->readBytes(reinterpret_cast<char*>(chunk), sizeof(chunk)) != sizeof(chunk)) {
+            return false;
+        }
+        uint32_t size = readLe32(chunk + 4);
+        size_t body = input->position();
+        
+        if (memcmp(chunk, "data", 4) == 0) {
+            data_size = size;
+            break;
+        }
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[26];
+            size_t want = size < sizeof(fmt) ? size : sizeof(fmt);
+            if (want < 16 || input->readBytes(reinterpret_cast<char*>(fmt), want) != want) return false;
+            format = readLe16(fmt);
+            file_channels = readLe16(fmt + 2);
+            rate = readLe32(fmt + 4);
+            bits = readLe16(fmt + 14);
+            if (format == FORMAT_EXTENSIBLE && want >= 26) {
+                format = readLe16(fmt + 24);
+            }
+        }
+        
+        // Chunks are padded to an even size
+        if (!input->seek(body + size + (size & 1))) return false;
+    }
+    
+    if (format != FORMAT_PCM || bits != 16 || file_channels < 1 || file_channels > 2 || rate == 0) {
+        Serial.printf("Unsupported WAV format: type %u, %u-bit, %u channels\n",
+                      (unsigned)format, (unsigned)bits, (unsigned)file_channels);
+        return false;
+    }
+    
+    // A streamed recording may leave the size at 0 or all ones: play to the end
+    data_start = input->position();
+    size_t file_end = input->size();
+    data_end = data_size == 0 || data_start + (uint64_t)data_size > file_end ? file_end : data_start + data_size;
+    sample_rate = rate;
+    channels = file_channels;
+    frame_bytes = file_channels * sizeof(int16_t);
+    return true;
+}
+
+size_t WavPcmDecoder::read(uint8_t* buffer, size_t len) {
+    if (!input || frame_bytes == 0) return 0;
+    
+    size_t position = input->position();
+    if (position < data_start) {
+        input->seek(data_start);
+        position = data_start;
+    }
+    
+    // Nothing from chunks after the samples: skip them, so the input
+    // reads as finished
+    size_t left = position < data_end ? data_end - position : 0;
+    if (left < frame_bytes) {
+        input->seek(input->size());
+        return 0;
+    }
+    
+    // Whole frames only
+    size_t bytes = len < left ? len : left;
+    bytes -= bytes % frame_bytes;
+    if (bytes == 0) return 0;
+    return input->readBytes(reinterpret_cast<char*>(buffer), bytes);
+}
+
+bool WavPcmDecoder::offsetForTime(uint32_t position_ms, uint32_t& offset, uint32_t& actual_ms) const {
+    if (!input || sample_rate == 0) return false;
+    
+    uint64_t frame = (uint64_t)position_ms * sample_rate / 1000;
+    uint64_t frames = (data_end - data_start) / frame_bytes;
+    if (frame > frames) frame = frames;
+    offset = data_start + (uint32_t)(frame * frame_bytes);
+    actual_ms = (uint32_t)(frame * 1000 / sample_rate);
+    return true;
+}
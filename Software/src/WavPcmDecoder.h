@@ -0,0 +1,36 @@
+#ifndef WAVPCMDECODER_H
+#define WAVPCMDECODER_H
+
+#include <Arduino.h>
+#include "AudioDecoder.h"
+
+// 16-bit PCM from a RIFF/WAVE file, passed through with no decoding: read()
+// is one copy out of the read-ahead buffer into the caller's. Takes no
+// memory of its own, and any time maps straight to a byte offset.
+class WavPcmDecoder : public AudioDecoder {
+private:
+    ReadAheadStream* input;
+    uint32_t data_start;
+    uint32_t data_end;
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint16_t frame_bytes;
+    
+public:
+    WavPcmDecoder();
+    
+    bool begin(ReadAheadStream& source, const DecoderBuffers& buffers) override;
+    void end() override;
+    bool isActive() const override { return input != nullptr; }
+    void reset() override {} // Reads follow the stream position
+    bool prepare() override;
+    size_t read(uint8_t* buffer, size_t len) override;
+    uint32_t getSampleRate() const override { return sample_rate; }
+    uint16_t getChannels() const override { return channels; }
+    bool offsetForTime(uint32_t position_ms, uint32_t& offset, uint32_t& actual_ms) const override;
+    
+private:
+    bool parseHeader();
+};
+
+#endif
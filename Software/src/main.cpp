@@ -7,6 +7,10 @@
 #include "BluetoothManager.h"
 #include "SerialController.h"
 #include "AudioProcessor.h"
+#include "MetadataManager.h"
+#include "ResumeManager.h"
+#include "LoopScheduler.h"
+#include "CpuGovernor.h"
 
 // --- Configuration ---
 const char* TARGET_DEVICE_NAME = "Lenovo LP40";
@@ -16,17 +20,119 @@ const int SPI_MISO = 19;
 const int SPI_SCK = 18;
 const char* MUSIC_ROOT = "/";
 
+// Decode-ahead: ~185 ms of 44.1 kHz stereo PCM, decoded on the core
+// the Bluetooth stack does not use.
+const size_t PCM_RING_BYTES = 32 * 1024;
+const int DECODER_TASK_CORE = 1;
+const int DECODER_TASK_PRIORITY = 5;
+
+// SD read-ahead: bursts of 8 sectors, two buffers per decoder slot
+const size_t SD_READ_BURST_BYTES = 4 * 1024;
+
+// Player task: sole owner of player state, applies queued commands in order
+const int PLAYER_TASK_CORE = 1;
+const int PLAYER_TASK_PRIORITY = 3;
+
+// Background ID3/Xing pass, below everything on the playback path
+const int METADATA_TASK_CORE = 1;
+const int METADATA_TASK_PRIORITY = 1;
+
+// Background rescans; after a boot from the on-card index, one checks
+// the folders below the root while the first track already plays
+const int RESCAN_TASK_CORE = 1;
+const int RESCAN_TASK_PRIORITY = 1;
+
+// Resume checkpoints: at most one small SD append this often while playing
+const uint32_t RESUME_CHECKPOINT_MS = 30 * 1000;
+
+// Overlap between consecutive tracks; 0 keeps transitions gapless
+const uint32_t CROSSFADE_MS = 0;
+
+// Playback health line on the serial console; 0 turns it off
+const uint32_t TELEMETRY_INTERVAL_MS = 60 * 1000;
+
+// CPU clock follows the decoder's load and the ring's fill; 80 MHz is the
+// lowest the Bluetooth controller runs at. The step also runs as soon as
+// the ring drops below the governor's low watermark.
+const bool CPU_GOVERNOR_ENABLED = true;
+const uint32_t CPU_STEPS_MHZ[] = {80, 160, 240};
+const uint32_t GOVERNOR_POLL_MS = 250;
+
+// Main loop steps. Serial input runs as soon as bytes arrive; the poll
+// only catches commands typed without a line ending.
+const uint32_t SERIAL_POLL_MS = 20;
+const uint32_t TELEMETRY_POLL_MS = 1000;
+
+static uint32_t loopMillis() {
+    return millis();
+}
+
+static uint32_t loopMicros() {
+    return micros();
+}
+
 // --- Global Objects ---
 MusicPlayer music_player;
 PlaylistManager playlist_manager(MUSIC_ROOT);
 BluetoothManager bluetooth_manager(TARGET_DEVICE_NAME);
 SerialController serial_controller;
 AudioProcessor audio_processor;
+MetadataManager metadata_manager(MUSIC_ROOT);
+ResumeManager resume_manager(MUSIC_ROOT);
+LoopScheduler loop_scheduler(loopMillis, loopMicros);
+CpuGovernor cpu_governor(CPU_STEPS_MHZ, sizeof(CPU_STEPS_MHZ) / sizeof(CPU_STEPS_MHZ[0]));
+
+static TaskHandle_t loop_task = nullptr;
+static int serial_step = -1;
+static int governor_step = -1;
+
+static void onSerialReceive() {
+    // UART event task: run the serial step and cut the loop's sleep short
+    loop_scheduler.wake(serial_step);
+    if (loop_task) xTaskNotifyGive(loop_task);
+}
+
+static void onBufferLow() {
+    // A2DP callback: same wake-up, for the governor
+    loop_scheduler.wake(governor_step);
+    if (loop_task) xTaskNotifyGive(loop_task);
+}
+
+static bool runGovernor() {
+    // Decoder time and audio produced since the last run, crossfades included
+    static uint64_t last_busy_us = 0;
+    static uint64_t last_audio_us = 0;
+    DecodeLoad decoding, crossfading;
+    audio_processor.getDecodeLoad(decoding, crossfading);
+    uint64_t busy_us = decoding.busy_us + crossfading.busy_us;
+    uint64_t audio_us = decoding.audio_us + crossfading.audio_us;
+    size_t capacity = audio_processor.getBufferCapacity();
+    
+    GovernorSample sample;
+    sample.busy_us = busy_us - last_busy_us;
+    sample.audio_us = audio_us - last_audio_us;
+    sample.fill_percent = capacity ? (uint32_t)(audio_processor.getBufferedBytes() * 100 / capacity) : 0;
+    sample.playing = music_player.getState() == PlayerState::PLAYING;
+    last_busy_us = busy_us;
+    last_audio_us = audio_us;
+    
+    uint32_t mhz = cpu_governor.update(sample);
+    if (mhz != getCpuFrequencyMhz()) {
+        setCpuFrequencyMhz(mhz);
+    }
+    return false;
+}
 
 void setup() {
     Serial.begin(115200);
     while (!Serial) {}
     
+    // Console first, so commands work even if the rest of setup fails
+    loop_task = xTaskGetCurrentTaskHandle();
+    serial_step = loop_scheduler.addTask("serial", []() { return serial_controller.handleInput(); }, SERIAL_POLL_MS);
+    loop_scheduler.addTask("telemetry", []() { serial_controller.update(); return false; }, TELEMETRY_POLL_MS);
+    Serial.onReceive(onSerialReceive);
+    
     Serial.println("ESP32 Bluetooth MP3 Player Starting...");
     
     // Initialize SD card
@@ -39,19 +145,46 @@ void setup() {
     }
     Serial.println("SD card initialized successfully");
     
+    // Last playback position, picked up when the sink connects
+    resume_manager.begin(RESUME_CHECKPOINT_MS);
+    
+    // Start the decoder task before anything can open a track
+    if (!audio_processor.begin(PCM_RING_BYTES, SD_READ_BURST_BYTES, DECODER_TASK_CORE, DECODER_TASK_PRIORITY)) {
+        Serial.println("Failed to start audio decoder");
+        return;
+    }
+    audio_processor.setCrossfade(CROSSFADE_MS);
+    if (CPU_GOVERNOR_ENABLED) {
+        audio_processor.setBufferLowCallback(PCM_RING_BYTES * CpuGovernor::LOW_FILL_PERCENT / 100, onBufferLow);
+        governor_step = loop_scheduler.addTask("governor", runGovernor, GOVERNOR_POLL_MS);
+    }
+    if (!music_player.begin(PLAYER_TASK_CORE, PLAYER_TASK_PRIORITY)) {
+        Serial.println("Failed to start player task");
+        return;
+    }
+    
     // Build playlist
-    if (!playlist_manager.scanForMP3Files()) {
-        Serial.println("Failed to scan for MP3 files");
+    if (!playlist_manager.loadOrScan()) {
+        Serial.println("Failed to scan for audio files");
     }
     
     if (playlist_manager.getTrackCount() == 0) {
-        Serial.println("No MP3 files found on SD card!");
+        Serial.println("No audio files found on SD card!");
+    }
+    if (playlist_manager.needsVerification()) {
+        playlist_manager.startRescan(RESCAN_TASK_CORE, RESCAN_TASK_PRIORITY);
     }
     
+    // Track metadata: loaded from the card, or built in the background
+    metadata_manager.setPlaylistManager(&playlist_manager);
+    metadata_manager.begin(METADATA_TASK_CORE, METADATA_TASK_PRIORITY);
+    
     // Setup controllers
     serial_controller.setMusicPlayer(&music_player);
     serial_controller.setPlaylistManager(&playlist_manager);
     serial_controller.setBluetoothManager(&bluetooth_manager);
+    serial_controller.setMetadataManager(&metadata_manager);
+    serial_controller.setTelemetryInterval(TELEMETRY_INTERVAL_MS);
     serial_controller.initialize();
     
     // Setup bluetooth
@@ -65,6 +198,9 @@ void setup() {
 }
 
 void loop() {
-    serial_controller.handleInput();
-    delay(10);
+    // Sleeps until the next step is due or serial input wakes it
+    uint32_t idle_ms = loop_scheduler.runDue();
+    if (idle_ms > 0) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(idle_ms));
+    }
 }
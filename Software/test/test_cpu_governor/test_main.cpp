@@ -0,0 +1,139 @@
+// CpuGovernor on the host, fed synthetic load samples: the jump to the
+// top clock when the ring runs low, the hysteresis between the 50% target
+// and the 70% step-up load, and the six calm samples a step down waits for.
+//
+//   pio test -e native
+
+#include <unity.h>
+#include "CpuGovernor.h"
+
+static const uint32_t STEPS_MHZ[] = {80, 160, 240};
+static const int STEP_COUNT = sizeof(STEPS_MHZ) / sizeof(STEPS_MHZ[0]);
+
+// One governor poll's worth of audio
+static const uint64_t SAMPLE_AUDIO_US = 250000;
+
+void setUp() {}
+void tearDown() {}
+
+// Decoder load at the current clock, in percent of real time
+static GovernorSample playing(uint32_t load_percent, uint32_t fill_percent) {
+    GovernorSample sample;
+    sample.busy_us = SAMPLE_AUDIO_US * load_percent / 100;
+    sample.audio_us = SAMPLE_AUDIO_US;
+    sample.fill_percent = fill_percent;
+    sample.playing = true;
+    return sample;
+}
+
+// Feeds the same sample until the clock changes; returns how many it took
+static uint32_t samplesUntilChange(CpuGovernor& governor, const GovernorSample& sample, uint32_t limit) {
+    uint32_t start = governor.getFrequency();
+    for (uint32_t i = 1; i <= limit; i++) {
+        if (governor.update(sample) != start) return i;
+    }
+    return 0;
+}
+
+static void test_starts_at_the_top() {
+    CpuGovernor governor(STEPS_MHZ, STEP_COUNT);
+    TEST_ASSERT_EQUAL_UINT32(240, governor.getFrequency());
+    TEST_ASSERT_EQUAL_UINT32(240, governor.getMaxFrequency());
+}
+
+static void test_steps_down_after_six_calm_samples() {
+    CpuGovernor governor(STEPS_MHZ, STEP_COUNT);
+    
+    // 10% at 240 MHz is 30% at 80 MHz, under the target
+    TEST_ASSERT_EQUAL_UINT32(CpuGovernor::DOWN_SAMPLES,
+                             samplesUntilChange(governor, playing(10, 90), 20));
+    TEST_ASSERT_EQUAL_UINT32(80, governor.getFrequency());
+    TEST_ASSERT_EQUAL_UINT32(1, governor.getStats().changes);
+}
+
+static void test_step_down_restarts_after_an_unsettled_sample() {
+    CpuGovernor governor(STEPS_MHZ, STEP_COUNT);
+    for (uint32_t i = 0; i + 1 < CpuGovernor::DOWN_SAMPLES; i++) {
+        TEST_ASSERT_EQUAL_UINT32(240, governor.update(playing(10, 90)));
+    }
+    
+    // The ring below the high watermark starts the count over
+    TEST_ASSERT_EQUAL_UINT32(240, governor.update(playing(10, 60)));
+    for (uint32_t i = 0; i + 1 < CpuGovernor::DOWN_SAMPLES; i++) {
+        TEST_ASSERT_EQUAL_UINT32(240, governor.update(playing(10, 90)));
+    }
+    
+    // So does a stall, where nothing was decoded
+    GovernorSample stall = playing(0, 90);
+    stall.audio_us = 0;
+    TEST_ASSERT_EQUAL_UINT32(240, governor.update(stall));
+    TEST_ASSERT_EQUAL_UINT32(CpuGovernor::DOWN_SAMPLES,
+                             samplesUntilChange(governor, playing(10, 90), 20));
+    TEST_ASSERT_EQUAL_UINT32(80, governor.getFrequency());
+}
+
+static void test_holds_between_target_and_step_up_load() {
+    CpuGovernor governor(STEPS_MHZ, STEP_COUNT);
+    
+    // 30% at 240 MHz is 45% at 160 MHz, but 90% at 80 MHz
+    samplesUntilChange(governor, playing(30, 90), 20);
+    TEST_ASSERT_EQUAL_UINT32(160, governor.getFrequency());
+    
+    // Anywhere from 50% to 70% is too much to go down, too little to go up
+    const uint32_t loads[] = {50, 55, 60, 65, 70};
+    for (uint32_t load : loads) {
+        for (int i = 0; i < 20; i++) {
+            TEST_ASSERT_EQUAL_UINT32(160, governor.update(playing(load, 90)));
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, governor.getStats().changes);
+    
+    // Past 70% it goes up on the first sample, to the step that brings
+    // the load back under the target: 75% at 160 MHz is 50% at 240 MHz
+    TEST_ASSERT_EQUAL_UINT32(240, governor.update(playing(75, 90)));
+    TEST_ASSERT_EQUAL_UINT32(0, governor.getStats().boosts);
+}
+
+static void test_boosts_to_the_top_on_low_fill() {
+    CpuGovernor governor(STEPS_MHZ, STEP_COUNT);
+    samplesUntilChange(governor, playing(10, 90), 20);
+    TEST_ASSERT_EQUAL_UINT32(80, governor.getFrequency());
+    
+    // Whatever the load, a ring under the low watermark means the top clock
+    TEST_ASSERT_EQUAL_UINT32(240, governor.update(playing(5, CpuGovernor::LOW_FILL_PERCENT - 1)));
+    TEST_ASSERT_EQUAL_UINT32(1, governor.getStats().boosts);
+    
+    // Still low: no second boost is counted
+    TEST_ASSERT_EQUAL_UINT32(240, governor.update(playing(5, 10)));
+    TEST_ASSERT_EQUAL_UINT32(1, governor.getStats().boosts);
+    
+    // Refilled but not yet above the high watermark: it stays up
+    for (int i = 0; i < 20; i++) {
+        TEST_ASSERT_EQUAL_UINT32(240, governor.update(playing(10, CpuGovernor::HIGH_FILL_PERCENT - 1)));
+    }
+    TEST_ASSERT_EQUAL_UINT32(CpuGovernor::DOWN_SAMPLES,
+                             samplesUntilChange(governor, playing(10, 90), 20));
+}
+
+static void test_no_boost_when_not_playing() {
+    CpuGovernor governor(STEPS_MHZ, STEP_COUNT);
+    GovernorSample idle = playing(0, 0);
+    idle.audio_us = 0;
+    idle.playing = false;
+    
+    // An empty ring while paused is not a shortage; idling steps down
+    TEST_ASSERT_EQUAL_UINT32(CpuGovernor::DOWN_SAMPLES, samplesUntilChange(governor, idle, 20));
+    TEST_ASSERT_EQUAL_UINT32(80, governor.getFrequency());
+    TEST_ASSERT_EQUAL_UINT32(0, governor.getStats().boosts);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_starts_at_the_top);
+    RUN_TEST(test_steps_down_after_six_calm_samples);
+    RUN_TEST(test_step_down_restarts_after_an_unsettled_sample);
+    RUN_TEST(test_holds_between_target_and_step_up_load);
+    RUN_TEST(test_boosts_to_the_top_on_low_fill);
+    RUN_TEST(test_no_boost_when_not_playing);
+    return UNITY_END();
+}
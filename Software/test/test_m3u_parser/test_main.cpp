@@ -0,0 +1,154 @@
+// M3uParser on the host, fed a playlist in reads of every size the way
+// PlaylistManager feeds it from the card, with entries looked up in a
+// TrackTable standing in for the scanned library.
+//
+//   pio test -e native
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "M3uParser.h"
+#include "TrackTable.h"
+
+static const char* PLAYLIST_PATH = "/Music/Playlists/road trip.m3u8";
+
+void setUp() {}
+void tearDown() {}
+
+struct ParseResult {
+    std::vector<std::string> paths;
+    uint32_t entries;
+    uint32_t skipped;
+};
+
+// The file arrives read_bytes at a time, so lines, CR LF pairs and the
+// byte order mark are split at every possible point
+static ParseResult parse(const std::string& playlist, size_t read_bytes) {
+    ParseResult result;
+    M3uParser parser(PLAYLIST_PATH, [&](const char* path) {
+        result.paths.push_back(path);
+    });
+    for (size_t offset = 0; offset < playlist.size(); offset += read_bytes) {
+        size_t len = playlist.size() - offset < read_bytes ? playlist.size() - offset : read_bytes;
+        parser.feed(playlist.data() + offset, len);
+    }
+    parser.finish();
+    result.entries = parser.getEntries();
+    result.skipped = parser.getSkipped();
+    return result;
+}
+
+static ParseResult parseEveryWay(const std::string& playlist) {
+    ParseResult whole = parse(playlist, playlist.size() + 1);
+    for (size_t read_bytes = 1; read_bytes <= playlist.size(); read_bytes++) {
+        ParseResult split = parse(playlist, read_bytes);
+        TEST_ASSERT_EQUAL(whole.paths.size(), split.paths.size());
+        for (size_t i = 0; i < split.paths.size(); i++) {
+            TEST_ASSERT_EQUAL_STRING(whole.paths[i].c_str(), split.paths[i].c_str());
+        }
+        TEST_ASSERT_EQUAL(whole.entries, split.entries);
+        TEST_ASSERT_EQUAL(whole.skipped, split.skipped);
+    }
+    return whole;
+}
+
+static void test_crlf_bom_and_comments() {
+    ParseResult result = parseEveryWay(
+        "\xEF\xBB\xBF#EXTM3U\r\n"
+        "#EXTINF:215,Artist - Song\r\n"
+        "/Music/Artist/Song.mp3\r\n"
+        "\r\n"
+        "   # An indented comment\r\n"
+        "  /Music/Artist/Other.mp3  \r\n"
+        "/Music/Artist/Last.mp3"); // No line break at the end
+    TEST_ASSERT_EQUAL(3, result.entries);
+    TEST_ASSERT_EQUAL(0, result.skipped);
+    TEST_ASSERT_EQUAL_STRING("/Music/Artist/Song.mp3", result.paths[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("/Music/Artist/Other.mp3", result.paths[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("/Music/Artist/Last.mp3", result.paths[2].c_str());
+}
+
+// A byte order mark anywhere but the start is part of the name
+static void test_bom_only_at_the_start() {
+    ParseResult result = parseEveryWay("a.mp3\n\xEF\xBB\xBF" "b.mp3\n");
+    TEST_ASSERT_EQUAL(2, result.entries);
+    TEST_ASSERT_EQUAL_STRING("/Music/Playlists/a.mp3", result.paths[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("/Music/Playlists/\xEF\xBB\xBF" "b.mp3", result.paths[1].c_str());
+}
+
+static void test_relative_paths_resolve_from_the_playlist_folder() {
+    ParseResult result = parseEveryWay(
+        "song.mp3\n"
+        "../Artist/Album/01 Intro.mp3\n"
+        "..\\Artist\\Album\\02 Theme.mp3\n"
+        "./sub/./track.mp3\n"
+        "D:\\Music\\Other\\track.mp3\n"
+        "../../../../escape.mp3\n");
+    TEST_ASSERT_EQUAL(6, result.entries);
+    TEST_ASSERT_EQUAL_STRING("/Music/Playlists/song.mp3", result.paths[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("/Music/Artist/Album/01 Intro.mp3", result.paths[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("/Music/Artist/Album/02 Theme.mp3", result.paths[2].c_str());
+    TEST_ASSERT_EQUAL_STRING("/Music/Playlists/sub/track.mp3", result.paths[3].c_str());
+    TEST_ASSERT_EQUAL_STRING("/Music/Other/track.mp3", result.paths[4].c_str());
+    TEST_ASSERT_EQUAL_STRING("/escape.mp3", result.paths[5].c_str()); // The root has no parent
+}
+
+// URLs, folders and lines over the limit are counted and skipped whole;
+// the entries around them still come through
+static void test_unusable_entries_are_skipped() {
+    std::string long_line = "/Music/" + std::string(M3uParser::MAX_LINE, 'x') + ".mp3\n";
+    ParseResult result = parseEveryWay(
+        "http://radio.example/stream.mp3\n"
+        "first.mp3\n"
+        "../Artist/\n"
+        "./..\n" +
+        long_line +
+        "second.mp3\n");
+    TEST_ASSERT_EQUAL(2, result.entries);
+    TEST_ASSERT_EQUAL(4, result.skipped);
+    TEST_ASSERT_EQUAL_STRING("/Music/Playlists/first.mp3", result.paths[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("/Music/Playlists/second.mp3", result.paths[1].c_str());
+}
+
+// Entries that parse but name nothing on the card, looked up as
+// PlaylistManager does: exact case first, then ignoring it
+static void test_missing_paths_are_not_resolved() {
+    TrackTable table;
+    table.add("/Music/Artist/", "Song.mp3");
+    table.add("/Music/Playlists/", "local.mp3");
+    table.sort();
+    table.finish();
+    
+    ParseResult result = parseEveryWay(
+        "../artist/SONG.MP3\r\n"
+        "local.mp3\r\n"
+        "../Artist/Gone.mp3\r\n"
+        "/Music/Elsewhere/Song.mp3\r\n");
+    TEST_ASSERT_EQUAL(4, result.entries);
+    
+    std::vector<int> found;
+    uint32_t unresolved = 0;
+    for (size_t i = 0; i < result.paths.size(); i++) {
+        int index = table.findPath(result.paths[i].c_str());
+        if (index < 0) index = table.findPath(result.paths[i].c_str(), true);
+        if (index < 0) {
+            unresolved++;
+        } else {
+            found.push_back(index);
+        }
+    }
+    TEST_ASSERT_EQUAL(2, found.size());
+    TEST_ASSERT_EQUAL(2, unresolved);
+    TEST_ASSERT_EQUAL_STRING("Song.mp3", table.fileName(found[0]));
+    TEST_ASSERT_EQUAL_STRING("local.mp3", table.fileName(found[1]));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_crlf_bom_and_comments);
+    RUN_TEST(test_bom_only_at_the_start);
+    RUN_TEST(test_relative_paths_resolve_from_the_playlist_folder);
+    RUN_TEST(test_unusable_entries_are_skipped);
+    RUN_TEST(test_missing_paths_are_not_resolved);
+    return UNITY_END();
+}
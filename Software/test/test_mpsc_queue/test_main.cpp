@@ -0,0 +1,90 @@
+// MpscQueue on the host: several std::thread producers standing in for the
+// serial loop and the Bluetooth task, one consumer for the player task.
+//
+//   pio test -e native
+
+#include <unity.h>
+#include <thread>
+#include <vector>
+#include "MpscQueue.h"
+
+static const int PRODUCERS = 4;
+static const uint32_t ITEMS_PER_PRODUCER = 200000;
+
+struct Item {
+    uint32_t producer;
+    uint32_t sequence;
+};
+
+void setUp() {}
+void tearDown() {}
+
+static void test_push_fails_only_when_full() {
+    MpscQueue<Item, 4> queue;
+    Item item = { 0, 0 };
+    TEST_ASSERT_TRUE(queue.empty());
+    for (uint32_t i = 0; i < 4; i++) {
+        item.sequence = i;
+        TEST_ASSERT_TRUE(queue.push(item));
+    }
+    TEST_ASSERT_FALSE(queue.push(item));
+    
+    Item out;
+    TEST_ASSERT_TRUE(queue.pop(out));
+    TEST_ASSERT_EQUAL(0, out.sequence);
+    TEST_ASSERT_TRUE(queue.push(item));
+    for (uint32_t i = 1; i < 4; i++) {
+        TEST_ASSERT_TRUE(queue.pop(out));
+        TEST_ASSERT_EQUAL(i, out.sequence);
+    }
+    TEST_ASSERT_TRUE(queue.pop(out));
+    TEST_ASSERT_FALSE(queue.pop(out));
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+// Producers retry on a full queue the way executeCommand does, so nothing
+// may be lost, duplicated or reordered within one producer
+static void test_multiple_producers_lose_nothing() {
+    MpscQueue<Item, 32> queue;
+    
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.push_back(std::thread([&queue, p]() {
+            for (uint32_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+                Item item = { (uint32_t)p, i };
+                while (!queue.push(item)) {
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+    
+    uint32_t next[PRODUCERS] = {};
+    uint32_t received = 0;
+    uint32_t out_of_order = 0;
+    while (received < PRODUCERS * ITEMS_PER_PRODUCER) {
+        Item item;
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        TEST_ASSERT_LESS_THAN(PRODUCERS, item.producer);
+        if (item.sequence != next[item.producer]) out_of_order++;
+        next[item.producer] = item.sequence + 1;
+        received++;
+    }
+    for (std::thread& producer : producers) producer.join();
+    
+    TEST_ASSERT_EQUAL(0, out_of_order);
+    for (int p = 0; p < PRODUCERS; p++) {
+        TEST_ASSERT_EQUAL(ITEMS_PER_PRODUCER, next[p]);
+    }
+    TEST_ASSERT_TRUE(queue.empty());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_push_fails_only_when_full);
+    RUN_TEST(test_multiple_producers_lose_nothing);
+    return UNITY_END();
+}
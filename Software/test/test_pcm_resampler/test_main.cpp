@@ -0,0 +1,181 @@
+// PcmResampler on the host, fed the way AudioProcessor::decodeStep feeds
+// it: output straight into the PCM ring, sized by inputBytesFor().
+//
+//   pio test -e native
+
+#include <unity.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "PcmResampler.h"
+#include "PcmRingBuffer.h"
+
+// Same sizes as AudioProcessor.cpp
+static const size_t RING_BYTES = 32 * 1024;
+static const size_t CHUNK_BYTES = 4608;
+static const size_t MIN_SPACE = 1024;
+static const size_t CALLBACK_BYTES = 512;
+
+void setUp() {}
+void tearDown() {}
+
+static std::vector<int16_t> sine(uint32_t rate, uint16_t channels, double frequency, double seconds) {
+    size_t frames = (size_t)(rate * seconds);
+    std::vector<int16_t> pcm(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        int16_t value = (int16_t)lrint(12000.0 * sin(2.0 * M_PI * frequency * i / rate));
+        for (uint16_t c = 0; c < channels; c++) pcm[i * channels + c] = value;
+    }
+    return pcm;
+}
+
+// Decoder and callback taking turns on one thread. Returns the output
+// bytes produced, or 0 if the decoder stopped making progress.
+static size_t pushThroughRing(PcmResampler& resampler, const std::vector<int16_t>& source) {
+    PcmRingBuffer ring;
+    TEST_ASSERT_TRUE(ring.allocate(RING_BYTES));
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(source.data());
+    size_t remaining = source.size() * sizeof(int16_t);
+    std::vector<uint8_t> convert(CHUNK_BYTES * 9 / 8);
+    uint8_t callback[CALLBACK_BYTES];
+    size_t played = 0;
+    
+    while (remaining > 0) {
+        while (ring.availableToWrite() < MIN_SPACE) {
+            played += ring.read(callback, sizeof(callback));
+        }
+        
+        uint8_t* region;
+        size_t space = ring.writeRegion(&region, PcmRingBuffer::SPILL_BYTES);
+        if (space > CHUNK_BYTES) space = CHUNK_BYTES;
+        size_t budget = resampler.inputBytesFor(space);
+        if (budget > convert.size()) budget = convert.size();
+        if (budget > remaining) budget = remaining;
+        if (budget == 0) return 0;
+        
+        memcpy(convert.data(), input, budget);
+        input += budget;
+        remaining -= budget;
+        size_t frames = resampler.process(convert.data(), budget, reinterpret_cast<int16_t*>(region), space / 4);
+        ring.commitWrite(frames * 4);
+    }
+    while (ring.availableToRead() > 0) {
+        played += ring.read(callback, sizeof(callback));
+    }
+    return played;
+}
+
+// Several laps of the ring, so the write position lands a few bytes short
+// of the wrap over and over
+static void test_resampled_sources_run_past_the_wrap() {
+    static const struct { uint32_t rate; uint16_t channels; } formats[] = {
+        {48000, 2}, {32000, 2}, {22050, 1}, {8000, 1}, {11025, 2}
+    };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        PcmResampler resampler;
+        TEST_ASSERT_TRUE(resampler.configure(formats[f].rate, formats[f].channels));
+        std::vector<int16_t> source = sine(formats[f].rate, formats[f].channels, 440.0, 3.0);
+        
+        size_t played = pushThroughRing(resampler, source);
+        size_t expected = (size_t)(3.0 * PcmResampler::OUTPUT_RATE) * 4;
+        TEST_ASSERT_UINT32_WITHIN(8, expected, played);
+    }
+}
+
+// Output frames until the filter history holds only real input
+static size_t settleFrames(uint32_t rate) {
+    return (size_t)PcmResampler::TAPS * PcmResampler::OUTPUT_RATE / rate + 1;
+}
+
+// Fits a sine of the given frequency to the output by least squares;
+// returns its amplitude and the RMS of everything else (noise, distortion,
+// images), skipping the filter's start-up
+static void measureTone(const std::vector<int16_t>& output, uint32_t rate, double frequency,
+                        double& amplitude, double& residual) {
+    size_t start = settleFrames(rate);
+    size_t frames = output.size() / 2;
+    double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+    for (size_t i = start; i < frames; i++) {
+        double w = 2.0 * M_PI * frequency * i / PcmResampler::OUTPUT_RATE;
+        double s = sin(w), c = cos(w), y = output[i * 2];
+        ss += s * s; sc += s * c; cc += c * c;
+        ys += y * s; yc += y * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det;
+    double b = (yc * ss - ys * sc) / det;
+    amplitude = sqrt(a * a + b * b);
+    
+    double energy = 0;
+    for (size_t i = start; i < frames; i++) {
+        double w = 2.0 * M_PI * frequency * i / PcmResampler::OUTPUT_RATE;
+        double e = output[i * 2] - (a * sin(w) + b * cos(w));
+        energy += e * e;
+    }
+    residual = sqrt(energy / (frames - start));
+}
+
+static std::vector<int16_t> resample(uint32_t rate, uint16_t channels, double frequency) {
+    PcmResampler resampler;
+    TEST_ASSERT_TRUE(resampler.configure(rate, channels));
+    std::vector<int16_t> source = sine(rate, channels, frequency, 0.5);
+    std::vector<int16_t> output((source.size() / channels * PcmResampler::OUTPUT_RATE / rate + 2) * 2);
+    size_t frames = resampler.process(reinterpret_cast<const uint8_t*>(source.data()),
+                                      source.size() * sizeof(int16_t), output.data(), output.size() / 2);
+    output.resize(frames * 2);
+    return output;
+}
+
+// Tones across the passband of every MPEG rate: level kept, and the
+// filter's noise and images well below the signal
+static void test_sine_sweep_quality() {
+    static const uint32_t rates[] = {8000, 11025, 12000, 16000, 22050, 24000, 32000, 48000};
+    static const double tones[] = {50, 440, 1000, 3000, 7000, 12000, 18000};
+    char message[96];
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        double passband = 0.8 * 0.5 * (rates[r] < PcmResampler::OUTPUT_RATE ? rates[r] : PcmResampler::OUTPUT_RATE);
+        double worst_snr = 1e9;
+        double worst_gain = 0;
+        for (size_t t = 0; t < sizeof(tones) / sizeof(tones[0]); t++) {
+            if (tones[t] > passband) continue;
+            double amplitude, residual;
+            measureTone(resample(rates[r], 2, tones[t]), rates[r], tones[t], amplitude, residual);
+            double gain_db = 20 * log10(amplitude / 12000.0);
+            double snr_db = 20 * log10(amplitude / (residual * sqrt(2.0)));
+            if (fabs(gain_db) > fabs(worst_gain)) worst_gain = gain_db;
+            if (snr_db < worst_snr) worst_snr = snr_db;
+        }
+        snprintf(message, sizeof(message), "%u Hz: worst gain %.2f dB, worst SNR %.1f dB",
+                 (unsigned)rates[r], worst_gain, worst_snr);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_TRUE(fabs(worst_gain) < 0.5);
+        TEST_ASSERT_TRUE(worst_snr > 60.0);
+    }
+}
+
+// Above the output Nyquist frequency a 48 kHz source must not alias back
+static void test_stopband_rejects_aliases() {
+    static const double tones[] = {23000, 23800};
+    char message[64];
+    for (size_t t = 0; t < sizeof(tones) / sizeof(tones[0]); t++) {
+        std::vector<int16_t> output = resample(48000, 2, tones[t]);
+        size_t start = settleFrames(48000);
+        double energy = 0;
+        for (size_t i = start; i < output.size() / 2; i++) {
+            energy += (double)output[i * 2] * output[i * 2];
+        }
+        double rms = sqrt(energy / (output.size() / 2 - start));
+        double rejection_db = 20 * log10(12000.0 / sqrt(2.0) / (rms + 1e-9));
+        snprintf(message, sizeof(message), "%.0f Hz at 48000 Hz: %.1f dB down", tones[t], rejection_db);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_TRUE(rejection_db > 60.0);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_resampled_sources_run_past_the_wrap);
+    RUN_TEST(test_sine_sweep_quality);
+    RUN_TEST(test_stopband_rejects_aliases);
+    return UNITY_END();
+}
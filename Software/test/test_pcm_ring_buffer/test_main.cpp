@@ -0,0 +1,178 @@
+// PcmRingBuffer on the host, with std::thread standing in for the decoder
+// task and the A2DP callback.
+//
+//   pio test -e native
+
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "PcmRingBuffer.h"
+
+static const size_t STRESS_BYTES = 16 * 1024 * 1024;
+static const size_t STRESS_RING_BYTES = 1000; // Rounded up to 1024
+
+void setUp() {}
+void tearDown() {}
+
+// Small deterministic generator, so producer and consumer agree on chunk sizes
+static uint32_t nextRandom(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+static uint8_t patternAt(size_t position) {
+    return (uint8_t)(position * 7 + (position >> 10));
+}
+
+static void test_capacity_is_rounded_to_power_of_two() {
+    PcmRingBuffer ring;
+    TEST_ASSERT_TRUE(ring.allocate(STRESS_RING_BYTES));
+    TEST_ASSERT_EQUAL(1024, ring.getCapacity());
+    TEST_ASSERT_EQUAL(1024, ring.availableToWrite());
+    TEST_ASSERT_EQUAL(0, ring.availableToRead());
+    TEST_ASSERT_FALSE(ring.allocate(0));
+}
+
+static void test_write_and_read_across_the_wrap() {
+    PcmRingBuffer ring;
+    TEST_ASSERT_TRUE(ring.allocate(16));
+    uint8_t data[16];
+    uint8_t out[16];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)i;
+    
+    TEST_ASSERT_EQUAL(12, ring.write(data, 12));
+    TEST_ASSERT_EQUAL(12, ring.read(out, 12));
+    
+    // Starts 4 bytes before the end of the storage
+    TEST_ASSERT_EQUAL(16, ring.write(data, sizeof(data)));
+    TEST_ASSERT_EQUAL(0, ring.write(data, 1));
+    TEST_ASSERT_EQUAL(16, ring.read(out, sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY(data, out, sizeof(data));
+    TEST_ASSERT_EQUAL(28, ring.getWritePosition());
+    TEST_ASSERT_EQUAL(28, ring.getReadPosition());
+}
+
+static void test_write_region_stops_at_the_wrap() {
+    PcmRingBuffer ring;
+    TEST_ASSERT_TRUE(ring.allocate(16));
+    uint8_t scratch[16] = {};
+    ring.write(scratch, 10);
+    ring.read(scratch, 10);
+    
+    uint8_t* region = nullptr;
+    TEST_ASSERT_EQUAL(6, ring.writeRegion(&region));
+    ring.commitWrite(6);
+    TEST_ASSERT_EQUAL(10, ring.writeRegion(&region));
+    TEST_ASSERT_EQUAL(6, ring.availableToRead());
+    
+    ring.discardAll();
+    TEST_ASSERT_EQUAL(0, ring.availableToRead());
+    TEST_ASSERT_EQUAL(16, ring.availableToWrite());
+}
+
+static void test_write_region_spills_across_the_wrap() {
+    PcmRingBuffer ring;
+    TEST_ASSERT_TRUE(ring.allocate(1024));
+    uint8_t scratch[1024] = {};
+    ring.write(scratch, 1012);
+    ring.read(scratch, 1012);
+    
+    // 12 bytes before the wrap: the spill area stands in for them
+    uint8_t* region = nullptr;
+    TEST_ASSERT_EQUAL(12, ring.writeRegion(&region, 0));
+    TEST_ASSERT_EQUAL(PcmRingBuffer::SPILL_BYTES, ring.writeRegion(&region, 64));
+    for (size_t i = 0; i < 100; i++) region[i] = patternAt(i);
+    ring.commitWrite(100);
+    TEST_ASSERT_EQUAL(100, ring.availableToRead());
+    TEST_ASSERT_EQUAL(100, ring.read(scratch, sizeof(scratch)));
+    for (size_t i = 0; i < 100; i++) TEST_ASSERT_EQUAL(patternAt(i), scratch[i]);
+    
+    // Past the wrap the ring itself is contiguous again
+    TEST_ASSERT_EQUAL(1024 - 88, ring.writeRegion(&region, 64));
+    ring.commitWrite(4);
+    TEST_ASSERT_EQUAL(4, ring.availableToRead());
+    
+    // Nothing free past the wrap: only the bytes before it, until the
+    // reader frees some
+    PcmRingBuffer small;
+    TEST_ASSERT_TRUE(small.allocate(16));
+    small.write(scratch, 10);
+    TEST_ASSERT_EQUAL(6, small.writeRegion(&region, 64));
+    small.read(scratch, 4);
+    TEST_ASSERT_EQUAL(10, small.writeRegion(&region, 64));
+    small.commitWrite(10);
+    TEST_ASSERT_EQUAL(0, small.writeRegion(&region, 64));
+}
+
+// One producer and one consumer hammering a small ring with odd-sized
+// chunks, so every offset of the wrap is hit many times over
+static void test_threaded_producer_and_consumer() {
+    PcmRingBuffer ring;
+    TEST_ASSERT_TRUE(ring.allocate(STRESS_RING_BYTES));
+    std::atomic<size_t> errors(0);
+    
+    std::thread producer([&]() {
+        uint32_t state = 1;
+        uint8_t chunk[300];
+        size_t written = 0;
+        while (written < STRESS_BYTES) {
+            size_t want = 1 + nextRandom(state) % sizeof(chunk);
+            if (want > STRESS_BYTES - written) want = STRESS_BYTES - written;
+            
+            if (nextRandom(state) & 1) {
+                // The decoder's path: straight into the ring, no copy
+                uint8_t* region;
+                size_t space = ring.writeRegion(&region);
+                if (space == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (want > space) want = space;
+                for (size_t i = 0; i < want; i++) region[i] = patternAt(written + i);
+                ring.commitWrite(want);
+                written += want;
+            } else {
+                for (size_t i = 0; i < want; i++) chunk[i] = patternAt(written + i);
+                size_t done = ring.write(chunk, want);
+                if (done == 0) std::this_thread::yield();
+                written += done;
+            }
+        }
+    });
+    
+    std::thread consumer([&]() {
+        uint32_t state = 2;
+        uint8_t chunk[512];
+        size_t read = 0;
+        while (read < STRESS_BYTES) {
+            size_t want = 1 + nextRandom(state) % sizeof(chunk);
+            size_t got = ring.read(chunk, want);
+            if (got == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < got; i++) {
+                if (chunk[i] != patternAt(read + i)) errors++;
+            }
+            read += got;
+        }
+    });
+    
+    producer.join();
+    consumer.join();
+    
+    TEST_ASSERT_EQUAL(0, errors.load());
+    TEST_ASSERT_EQUAL(STRESS_BYTES, ring.getWritePosition());
+    TEST_ASSERT_EQUAL(STRESS_BYTES, ring.getReadPosition());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_capacity_is_rounded_to_power_of_two);
+    RUN_TEST(test_write_and_read_across_the_wrap);
+    RUN_TEST(test_write_region_stops_at_the_wrap);
+    RUN_TEST(test_write_region_spills_across_the_wrap);
+    RUN_TEST(test_threaded_producer_and_consumer);
+    return UNITY_END();
+}
@@ -0,0 +1,271 @@
+// SeekIndex against a generated corpus of MP3 streams: constant bitrate,
+// VBR with a Xing TOC, VBR without one, and MPEG-2 at 22.05 kHz. Each
+// seek is checked against the true frame positions, and the cost of
+// getting ready to seek (bytes read, build time) and of each lookup is
+// reported.
+//
+//   pio test -e native
+
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "SeekIndex.h"
+
+static const uint32_t TRACK_SECONDS = 180;
+static const uint32_t SEEK_STEP_MS = 997;
+
+// Version/layer byte of an MPEG-1 and an MPEG-2 Layer III header
+static const uint8_t MPEG1_L3 = 0xFB;
+static const uint8_t MPEG2_L3 = 0xF3;
+
+struct Mp3Fixture {
+    const char* name;
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> frame_offsets; // Audio frames only, not the Xing frame
+    uint32_t first_frame;                // The Xing frame when there is one
+    uint32_t sample_rate;
+    uint32_t samples_per_frame;
+    uint32_t padding_rest; // Encoder-style padding keeps the average bitrate exact
+};
+
+// An in-memory file that counts what is read from it
+class MemoryReader : public BlockReader {
+private:
+    const std::vector<uint8_t>& data;
+    size_t position;
+    
+public:
+    size_t bytes_read;
+    
+    explicit MemoryReader(const std::vector<uint8_t>& source) : data(source), position(0), bytes_read(0) {}
+    
+    size_t readBlock(uint8_t* buffer, size_t len) override {
+        if (position >= data.size()) return 0;
+        if (len > data.size() - position) len = data.size() - position;
+        memcpy(buffer, data.data() + position, len);
+        position += len;
+        bytes_read += len;
+        return len;
+    }
+    bool seekBlock(size_t new_position) override {
+        if (new_position > data.size()) return false;
+        position = new_position;
+        return true;
+    }
+    size_t totalSize() override { return data.size(); }
+};
+
+void setUp() {}
+void tearDown() {}
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void putBigEndian32(uint8_t* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+// Appends one silent stereo frame, padded the way an encoder pads
+static void appendFrame(std::vector<uint8_t>& data, uint8_t version, uint8_t bitrate_index,
+                        uint8_t rate_index, Mp3Fixture& fixture) {
+    uint8_t header[4] = { 0xFF, version, (uint8_t)(bitrate_index << 4 | rate_index << 2), 0x00 };
+    Mp3StreamInfo info = {};
+    uint32_t frame_bytes = 0;
+    Mp3HeaderParser::parseFrameHeader(header, info, frame_bytes);
+    fixture.sample_rate = info.sample_rate;
+    fixture.samples_per_frame = info.samples_per_frame;
+    
+    fixture.padding_rest += (uint64_t)info.samples_per_frame / 8 * info.bitrate % info.sample_rate;
+    if (fixture.padding_rest >= info.sample_rate) {
+        fixture.padding_rest -= info.sample_rate;
+        header[2] |= 0x02;
+        frame_bytes++;
+    }
+    
+    size_t start = data.size();
+    data.resize(start + frame_bytes, 0);
+    memcpy(data.data() + start, header, sizeof(header));
+}
+
+// bitrates cycles per frame; one entry makes a CBR stream
+static Mp3Fixture makeStream(const char* name, uint8_t version, uint8_t rate_index,
+                             const std::vector<uint8_t>& bitrates, bool xing, bool id3) {
+    Mp3Fixture fixture;
+    fixture.name = name;
+    fixture.padding_rest = 0;
+    std::vector<uint8_t>& data = fixture.data;
+    
+    if (id3) {
+        // Empty ID3v2.3 tag of 1000 bytes (syncsafe size 7 << 7 | 104)
+        const uint8_t tag[10] = { 'I', 'D', '3', 3, 0, 0, 0, 0, 7, 104 };
+        data.assign(tag, tag + sizeof(tag));
+        data.resize(data.size() + 1000, 0);
+    }
+    
+    size_t xing_frame = data.size();
+    fixture.first_frame = xing_frame;
+    if (xing) appendFrame(data, version, bitrates[0], rate_index, fixture);
+    
+    // Frame count for the wanted length, with the rate known after one frame
+    Mp3Fixture probe;
+    probe.padding_rest = 0;
+    std::vector<uint8_t> scratch;
+    appendFrame(scratch, version, bitrates[0], rate_index, probe);
+    uint32_t frames = TRACK_SECONDS * probe.sample_rate / probe.samples_per_frame;
+    for (uint32_t f = 0; f < frames; f++) {
+        fixture.frame_offsets.push_back(data.size());
+        appendFrame(data, version, bitrates[f % bitrates.size()], rate_index, fixture);
+    }
+    
+    if (xing) {
+        // Side info of a stereo frame: 32 bytes for MPEG-1, 17 for MPEG-2
+        uint8_t* tag = data.data() + xing_frame + 4 + (version == MPEG1_L3 ? 32 : 17);
+        uint32_t stream_bytes = data.size() - xing_frame;
+        memcpy(tag, "Xing", 4);
+        putBigEndian32(tag + 4, 0x07);
+        putBigEndian32(tag + 8, frames);
+        putBigEndian32(tag + 12, stream_bytes);
+        for (uint32_t percent = 0; percent < 100; percent++) {
+            uint32_t offset = fixture.frame_offsets[(uint64_t)frames * percent / 100] - xing_frame;
+            tag[16 + percent] = (uint8_t)((uint64_t)offset * 256 / stream_bytes);
+        }
+    }
+    return fixture;
+}
+
+static uint32_t frameTimeMs(const Mp3Fixture& fixture, size_t frame) {
+    return (uint32_t)((uint64_t)frame * fixture.samples_per_frame * 1000 / fixture.sample_rate);
+}
+
+// Frame that holds the given byte offset; the Xing frame counts as the first
+static size_t frameAt(const Mp3Fixture& fixture, uint32_t offset) {
+    if (offset <= fixture.frame_offsets.front()) return 0;
+    size_t low = 0;
+    size_t high = fixture.frame_offsets.size();
+    while (high - low > 1) {
+        size_t mid = (low + high) / 2;
+        if (fixture.frame_offsets[mid] <= offset) low = mid;
+        else high = mid;
+    }
+    return low;
+}
+
+static void checkSeeks(const Mp3Fixture& fixture, SeekIndex::Mode expected_mode, uint32_t tolerance_ms) {
+    MemoryReader reader(fixture.data);
+    SeekIndex index;
+    uint64_t started = nowNs();
+    TEST_ASSERT_TRUE(index.build(reader));
+    uint64_t build_ns = nowNs() - started;
+    TEST_ASSERT_EQUAL((int)expected_mode, (int)index.getMode());
+    
+    uint32_t duration_ms = frameTimeMs(fixture, fixture.frame_offsets.size());
+    TEST_ASSERT_UINT32_WITHIN(1000, duration_ms, index.getDurationMs());
+    
+    uint32_t seeks = 0;
+    uint32_t worst_ms = 0;
+    uint64_t lookup_ns = 0;
+    for (uint32_t position_ms = 0; position_ms + 2000 < duration_ms; position_ms += SEEK_STEP_MS) {
+        uint32_t actual_ms;
+        started = nowNs();
+        uint32_t offset = index.offsetForTime(position_ms, actual_ms);
+        lookup_ns += nowNs() - started;
+        seeks++;
+        
+        TEST_ASSERT_GREATER_OR_EQUAL(fixture.first_frame, offset);
+        TEST_ASSERT_LESS_THAN(fixture.data.size(), offset);
+        
+        // Where decoding actually picks up: the first frame at or after the offset
+        size_t frame = frameAt(fixture, offset);
+        if (fixture.frame_offsets[frame] < offset && frame + 1 < fixture.frame_offsets.size()) frame++;
+        uint32_t landed_ms = frameTimeMs(fixture, frame);
+        uint32_t error_ms = landed_ms > position_ms ? landed_ms - position_ms : position_ms - landed_ms;
+        if (error_ms > worst_ms) worst_ms = error_ms;
+        TEST_ASSERT_LESS_OR_EQUAL(tolerance_ms, error_ms);
+        
+        if (expected_mode == SeekIndex::Mode::FRAME_INDEX) {
+            // Indexed offsets are exact frame starts, and reported as such
+            TEST_ASSERT_EQUAL(fixture.frame_offsets[frame], offset);
+            TEST_ASSERT_EQUAL(landed_ms, actual_ms);
+            TEST_ASSERT_LESS_OR_EQUAL(position_ms, actual_ms);
+        }
+    }
+    
+    char line[200];
+    snprintf(line, sizeof(line), "%s: %u KB file, build read %u KB in %.2f ms, %u seeks at %.0f ns, worst error %u ms",
+             fixture.name, (unsigned)(fixture.data.size() / 1024), (unsigned)(reader.bytes_read / 1024),
+             build_ns / 1e6, (unsigned)seeks, (double)lookup_ns / seeks, (unsigned)worst_ms);
+    TEST_MESSAGE(line);
+    
+    // Only a file without a TOC that turns out to be VBR is walked
+    if (expected_mode == SeekIndex::Mode::FRAME_INDEX) {
+        TEST_ASSERT_LESS_OR_EQUAL(fixture.data.size() * 2, reader.bytes_read);
+    } else {
+        TEST_ASSERT_LESS_OR_EQUAL(64 * 1024, reader.bytes_read);
+    }
+}
+
+static void test_constant_bitrate_is_mapped_linearly() {
+    // 128 kbps, 44.1 kHz, behind an ID3v2 tag
+    Mp3Fixture fixture = makeStream("CBR 128k", MPEG1_L3, 0, { 9 }, false, true);
+    uint32_t frame_ms = frameTimeMs(fixture, 1);
+    checkSeeks(fixture, SeekIndex::Mode::CONSTANT, frame_ms);
+}
+
+static void test_vbr_with_toc_uses_the_toc() {
+    Mp3Fixture fixture = makeStream("VBR Xing TOC", MPEG1_L3, 0, { 9, 11, 5, 14, 9, 7 }, true, true);
+    // Interpolating within a percent of the track
+    checkSeeks(fixture, SeekIndex::Mode::TOC, TRACK_SECONDS * 1000 / 100);
+}
+
+static void test_vbr_without_toc_builds_a_frame_index() {
+    Mp3Fixture fixture = makeStream("VBR frame index", MPEG1_L3, 0, { 9, 11, 5, 14, 9, 7 }, false, false);
+    uint32_t entry_ms = frameTimeMs(fixture, SeekIndex::FRAMES_PER_ENTRY) + 1;
+    checkSeeks(fixture, SeekIndex::Mode::FRAME_INDEX, entry_ms);
+}
+
+static void test_mpeg2_half_rate() {
+    // 64 kbps at 22.05 kHz: 576-sample frames
+    Mp3Fixture fixture = makeStream("MPEG-2 22.05k VBR", MPEG2_L3, 0, { 8, 6, 10 }, false, false);
+    TEST_ASSERT_EQUAL(22050, fixture.sample_rate);
+    TEST_ASSERT_EQUAL(576, fixture.samples_per_frame);
+    uint32_t entry_ms = frameTimeMs(fixture, SeekIndex::FRAMES_PER_ENTRY) + 1;
+    checkSeeks(fixture, SeekIndex::Mode::FRAME_INDEX, entry_ms);
+}
+
+static void test_seeking_past_the_end() {
+    Mp3Fixture fixture = makeStream("VBR frame index", MPEG1_L3, 0, { 9, 11 }, false, false);
+    MemoryReader reader(fixture.data);
+    SeekIndex index;
+    TEST_ASSERT_TRUE(index.build(reader));
+    
+    uint32_t actual_ms;
+    uint32_t offset = index.offsetForTime(TRACK_SECONDS * 2000, actual_ms);
+    TEST_ASSERT_EQUAL(fixture.data.size(), offset);
+    TEST_ASSERT_EQUAL(index.getDurationMs(), actual_ms);
+}
+
+static void test_garbage_is_rejected() {
+    std::vector<uint8_t> noise(64 * 1024);
+    for (size_t i = 0; i < noise.size(); i++) noise[i] = (uint8_t)(i * 131 + 7) & 0x7F;
+    MemoryReader reader(noise);
+    SeekIndex index;
+    TEST_ASSERT_FALSE(index.build(reader));
+    TEST_ASSERT_EQUAL((int)SeekIndex::Mode::NONE, (int)index.getMode());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_constant_bitrate_is_mapped_linearly);
+    RUN_TEST(test_vbr_with_toc_uses_the_toc);
+    RUN_TEST(test_vbr_without_toc_builds_a_frame_index);
+    RUN_TEST(test_mpeg2_half_rate);
+    RUN_TEST(test_seeking_past_the_end);
+    RUN_TEST(test_garbage_is_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,157 @@
+// SerialCommandParser on the host, fed from a fake serial port that hands
+// bytes over in bursts the way the UART does, polled like
+// SerialController::handleInput.
+//
+//   pio test -e native
+
+#include <unity.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "SerialCommandParser.h"
+
+static const int INPUT_BYTES_PER_POLL = 256; // As in SerialController.cpp
+
+void setUp() {}
+void tearDown() {}
+
+// Bytes become available burst_bytes at a time, one burst per poll
+class FakeSerial {
+private:
+    std::string data;
+    size_t arrived;
+    size_t consumed;
+    size_t burst_bytes;
+    
+public:
+    FakeSerial(const std::string& input, size_t burst) : data(input), arrived(0), consumed(0), burst_bytes(burst) {}
+    
+    void tick() {
+        arrived += burst_bytes;
+        if (arrived > data.size()) arrived = data.size();
+    }
+    int available() const { return (int)(arrived - consumed); }
+    int read() { return consumed < arrived ? (unsigned char)data[consumed++] : -1; }
+    bool drained() const { return consumed == data.size(); }
+};
+
+static std::vector<SerialCommand> parseAll(const std::string& input, size_t burst) {
+    FakeSerial serial(input, burst);
+    SerialCommandParser parser;
+    std::vector<SerialCommand> commands;
+    SerialCommand command;
+    while (!serial.drained()) {
+        serial.tick();
+        int budget = INPUT_BYTES_PER_POLL;
+        while (budget-- > 0 && serial.available()) {
+            if (parser.feed((char)serial.read(), command)) {
+                commands.push_back(command);
+            }
+        }
+    }
+    return commands;
+}
+
+// Every burst size gives the same commands as the whole input at once
+static std::vector<SerialCommand> parseEveryWay(const std::string& input) {
+    std::vector<SerialCommand> expected = parseAll(input, input.size());
+    for (size_t burst = 1; burst < input.size(); burst++) {
+        std::vector<SerialCommand> got = parseAll(input, burst);
+        TEST_ASSERT_EQUAL(expected.size(), got.size());
+        for (size_t i = 0; i < got.size(); i++) {
+            TEST_ASSERT_EQUAL(expected[i].name, got[i].name);
+            TEST_ASSERT_EQUAL(expected[i].argument, got[i].argument);
+            TEST_ASSERT_EQUAL(expected[i].has_argument, got[i].has_argument);
+            TEST_ASSERT_TRUE(expected[i].syntax == got[i].syntax);
+            TEST_ASSERT_EQUAL_STRING(expected[i].text, got[i].text);
+        }
+    }
+    return expected;
+}
+
+static void assertCommand(const SerialCommand& command, char name, bool has_argument, int32_t argument) {
+    TEST_ASSERT_EQUAL(name, command.name);
+    TEST_ASSERT_EQUAL(has_argument, command.has_argument);
+    if (has_argument) TEST_ASSERT_EQUAL(argument, command.argument);
+    TEST_ASSERT_TRUE(command.syntax == CommandSyntax::OK);
+}
+
+static void test_batch_split_across_reads() {
+    std::vector<SerialCommand> commands = parseEveryWay("t3;j60;p\r\nv-20\n12\r\nn\r\n");
+    TEST_ASSERT_EQUAL(6, commands.size());
+    assertCommand(commands[0], 't', true, 3);
+    assertCommand(commands[1], 'j', true, 60);
+    assertCommand(commands[2], 'p', false, 0);
+    assertCommand(commands[3], 'v', true, -20);
+    assertCommand(commands[4], 't', true, 12);
+    assertCommand(commands[5], 'n', false, 0);
+}
+
+// Blank lines, CR LF pairs, stray separators and spaces produce nothing extra
+static void test_empty_commands_and_spaces() {
+    std::vector<SerialCommand> commands = parseEveryWay("\r\n\r\n;;  j 90 \r\n\n\t; x \n");
+    TEST_ASSERT_EQUAL(2, commands.size());
+    assertCommand(commands[0], 'j', true, 90);
+    assertCommand(commands[1], 'x', false, 0);
+}
+
+static void test_text_commands_keep_their_spaces() {
+    std::vector<SerialCommand> commands = parseEveryWay("/  pink floyd  \r\n^Caf\xC3\xA9 del Mar;n\n");
+    TEST_ASSERT_EQUAL(3, commands.size());
+    TEST_ASSERT_EQUAL('/', commands[0].name);
+    TEST_ASSERT_EQUAL_STRING("pink floyd", commands[0].text);
+    TEST_ASSERT_EQUAL('^', commands[1].name);
+    TEST_ASSERT_EQUAL_STRING("Caf\xC3\xA9 del Mar", commands[1].text);
+    assertCommand(commands[2], 'n', false, 0);
+}
+
+// A bad command is reported and skipped; the next one still parses
+static void test_malformed_commands_resynchronise() {
+    std::vector<SerialCommand> commands = parseEveryWay("j6x0\nv-\nj 6 0\nt99999999\np\n");
+    TEST_ASSERT_EQUAL(5, commands.size());
+    TEST_ASSERT_TRUE(commands[0].syntax == CommandSyntax::MALFORMED);
+    TEST_ASSERT_TRUE(commands[1].syntax == CommandSyntax::MALFORMED);
+    TEST_ASSERT_TRUE(commands[2].syntax == CommandSyntax::MALFORMED);
+    TEST_ASSERT_TRUE(commands[3].syntax == CommandSyntax::TOO_LARGE);
+    assertCommand(commands[4], 'p', false, 0);
+    
+    std::string long_text = "/" + std::string(SerialCommandParser::MAX_TEXT + 1, 'a') + "\nn\n";
+    commands = parseEveryWay(long_text);
+    TEST_ASSERT_EQUAL(2, commands.size());
+    TEST_ASSERT_TRUE(commands[0].syntax == CommandSyntax::TOO_LARGE);
+    assertCommand(commands[1], 'n', false, 0);
+}
+
+// Line noise between commands (a board reset, a terminal's escape codes)
+static void test_control_bytes_between_commands_are_ignored() {
+    std::vector<SerialCommand> commands = parseEveryWay(std::string("\x00\x1b\x7f", 3) + "n\n\x01p\n");
+    TEST_ASSERT_EQUAL(2, commands.size());
+    assertCommand(commands[0], 'n', false, 0);
+    assertCommand(commands[1], 'p', false, 0);
+}
+
+// A terminal that sends no line ending: the command waits until flushed,
+// as handleInput does after COMMAND_IDLE_MS
+static void test_unterminated_command_waits() {
+    SerialCommandParser parser;
+    SerialCommand command;
+    const char* input = "j120";
+    for (const char* c = input; *c; c++) {
+        TEST_ASSERT_FALSE(parser.feed(*c, command));
+    }
+    TEST_ASSERT_TRUE(parser.isPending());
+    TEST_ASSERT_TRUE(parser.feed('\n', command));
+    assertCommand(command, 'j', true, 120);
+    TEST_ASSERT_FALSE(parser.isPending());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_batch_split_across_reads);
+    RUN_TEST(test_empty_commands_and_spaces);
+    RUN_TEST(test_text_commands_keep_their_spaces);
+    RUN_TEST(test_malformed_commands_resynchronise);
+    RUN_TEST(test_control_bytes_between_commands_are_ignored);
+    RUN_TEST(test_unterminated_command_waits);
+    return UNITY_END();
+}
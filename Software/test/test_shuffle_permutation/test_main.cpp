@@ -0,0 +1,115 @@
+// ShufflePermutation on the host: every pass visits each track exactly
+// once, positionOf() undoes at(), and the smallest playlists still
+// shuffle.
+//
+//   pio test -e native
+
+#include <unity.h>
+#include <vector>
+#include "ShufflePermutation.h"
+
+static const uint32_t SEEDS = 8;
+
+void setUp() {}
+void tearDown() {}
+
+// Every position maps to a distinct value below count
+static void checkBijection(const ShufflePermutation& order) {
+    uint32_t count = order.size();
+    std::vector<bool> seen(count, false);
+    for (uint32_t position = 0; position < count; position++) {
+        uint32_t value = order.at(position);
+        TEST_ASSERT_LESS_THAN(count, value);
+        TEST_ASSERT_FALSE(seen[value]);
+        seen[value] = true;
+    }
+}
+
+static void test_full_pass_is_a_bijection() {
+    // Powers of two, one past them, and a few in between: the domain is
+    // padded to an even bit width, so these exercise the cycle-walking
+    const uint32_t counts[] = {4, 5, 16, 17, 100, 255, 256, 1000, 4097, 30011};
+    ShufflePermutation order;
+    for (uint32_t count : counts) {
+        for (uint32_t seed = 0; seed < SEEDS; seed++) {
+            order.reset(count, seed * 0x9E3779B9u);
+            TEST_ASSERT_EQUAL_UINT32(count, order.size());
+            checkBijection(order);
+        }
+    }
+}
+
+static void test_position_of_is_the_inverse() {
+    const uint32_t counts[] = {5, 64, 1000, 4097};
+    ShufflePermutation order;
+    for (uint32_t count : counts) {
+        for (uint32_t seed = 0; seed < SEEDS; seed++) {
+            order.reset(count, seed + 1);
+            for (uint32_t i = 0; i < count; i++) {
+                TEST_ASSERT_EQUAL_UINT32(i, order.positionOf(order.at(i)));
+                TEST_ASSERT_EQUAL_UINT32(i, order.at(order.positionOf(i)));
+            }
+        }
+    }
+}
+
+static void test_seeds_give_different_orders() {
+    ShufflePermutation first, second;
+    first.reset(1000, 1);
+    second.reset(1000, 2);
+    uint32_t same = 0;
+    for (uint32_t position = 0; position < 1000; position++) {
+        if (first.at(position) == second.at(position)) same++;
+    }
+    // Two unrelated orders agree on about one position in count
+    TEST_ASSERT_LESS_THAN(10u, same);
+}
+
+static void test_empty_and_single_track() {
+    ShufflePermutation order;
+    TEST_ASSERT_EQUAL_UINT32(0, order.size());
+    
+    order.reset(0, 42);
+    TEST_ASSERT_EQUAL_UINT32(0, order.size());
+    // Out of range values pass through unchanged
+    TEST_ASSERT_EQUAL_UINT32(0, order.at(0));
+    TEST_ASSERT_EQUAL_UINT32(3, order.positionOf(3));
+    
+    for (uint32_t seed = 0; seed < SEEDS; seed++) {
+        order.reset(1, seed);
+        TEST_ASSERT_EQUAL_UINT32(0, order.at(0));
+        TEST_ASSERT_EQUAL_UINT32(0, order.positionOf(0));
+    }
+}
+
+static void test_two_and_three_tracks_reach_every_order() {
+    // Over enough seeds, each of the 2 and 6 possible orders comes up
+    ShufflePermutation order;
+    bool seen_two[2] = {false, false};
+    bool seen_three[6] = {false, false, false, false, false, false};
+    for (uint32_t seed = 0; seed < 200; seed++) {
+        order.reset(2, seed);
+        checkBijection(order);
+        seen_two[order.at(0)] = true;
+        
+        order.reset(3, seed);
+        checkBijection(order);
+        for (uint32_t i = 0; i < 3; i++) {
+            TEST_ASSERT_EQUAL_UINT32(i, order.positionOf(order.at(i)));
+        }
+        // The first two values name the order
+        seen_three[order.at(0) * 2 + (order.at(1) > order.at(0) ? order.at(1) - 1 : order.at(1))] = true;
+    }
+    for (int i = 0; i < 2; i++) TEST_ASSERT_TRUE(seen_two[i]);
+    for (int i = 0; i < 6; i++) TEST_ASSERT_TRUE(seen_three[i]);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_full_pass_is_a_bijection);
+    RUN_TEST(test_position_of_is_the_inverse);
+    RUN_TEST(test_seeds_give_different_orders);
+    RUN_TEST(test_empty_and_single_track);
+    RUN_TEST(test_two_and_three_tracks_reach_every_order);
+    return UNITY_END();
+}